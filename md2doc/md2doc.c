@@ -2591,6 +2591,7 @@ void usage()
     printf("  --safe           Suppress raw HTML and dangerous URLs\n");
     printf("  --smart          Use smart punctuation\n");
     printf("  --normalize      Consolidate adjacent text nodes\n");
+    printf("  --validate-utf8  Replace invalid UTF-8 with U+FFFD\n");
     printf("  --rast           Output RAST format "
                                               "(ISO/IEC 13673:2000)\n");
     printf("  --help, -h       Print usage information\n");
@@ -2682,6 +2683,8 @@ int main(int argc, char *argv[])
          * -   collapse-whitespace
          * -   tables
          */
+	} else if (strcmp(argv[argi], "--validate-utf8") == 0) {
+		parser_options |= MD_FLAG_VALIDATEUTF8;
 	} else if ((strcmp(argv[argi], "--help") == 0) ||
 	    (strcmp(argv[argi], "-h") == 0)) {
 		usage();
@@ -28,6 +28,15 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 #include "render_html.h"
 #include "cmdline.h"
 
@@ -38,6 +47,13 @@ static unsigned parser_flags = 0;
 static unsigned renderer_flags = MD_RENDER_FLAG_DEBUG;
 static int want_fullhtml = 0;
 static int want_stat = 0;
+static int want_stream = 0;
+static unsigned n_threads = 0;
+static int want_tape = 0;
+static int want_image = 0;
+static int want_write_image = 0;
+static int want_read_image = 0;
+static int want_mmap = 0;
 
 
 /*********************************
@@ -106,6 +122,200 @@ process_output(const MD_CHAR* text, MD_SIZE size, void* userdata)
     membuf_append((struct membuffer*) userdata, text, size);
 }
 
+static MD_SIZE
+read_input(MD_CHAR* buffer, MD_SIZE size, void* userdata)
+{
+    return (MD_SIZE) fread(buffer, 1, size, (FILE*) userdata);
+}
+
+static void
+write_output(const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    fwrite(text, 1, size, (FILE*) userdata);
+}
+
+static void
+write_html_header(FILE* out)
+{
+    fprintf(out, "<!DOCTYPE html PUBLIC 'ISO/IEC 15445:2000//DTD HTML//EN'>\n");
+    fprintf(out, "<html>\n");
+    fprintf(out, "<head>\n");
+    fprintf(out, "<title>Untitled</title>\n");
+    fprintf(out, "<meta name=\"generator\" content=\"md2html\">\n");
+    fprintf(out, "</head>\n");
+    fprintf(out, "<body>\n");
+}
+
+static void
+write_html_footer(FILE* out)
+{
+    fprintf(out, "</body>\n");
+    fprintf(out, "</html>\n");
+}
+
+/* Convert the input as it is being read, without loading it all into memory.
+ * (The --stat option then measures the I/O as well.) */
+static int
+process_stream(FILE* in, FILE* out)
+{
+    int ret;
+    clock_t t0, t1;
+
+    if(want_fullhtml)
+        write_html_header(out);
+
+    t0 = clock();
+
+    ret = md_render_html_stream(read_input, (void*) in, write_output,
+                (void*) out, parser_flags, renderer_flags);
+
+    t1 = clock();
+    if(ret != 0) {
+        fprintf(stderr, "Parsing failed.\n");
+        return -1;
+    }
+
+    if(want_fullhtml)
+        write_html_footer(out);
+
+    if(want_stat) {
+        if(t0 != (clock_t)-1  &&  t1 != (clock_t)-1) {
+            double elapsed = (double)(t1 - t0) / CLOCKS_PER_SEC;
+            if (elapsed < 1)
+                fprintf(stderr, "Time spent on parsing: %7.2f ms.\n", elapsed*1e3);
+            else
+                fprintf(stderr, "Time spent on parsing: %6.3f s.\n", elapsed);
+        }
+    }
+
+    return 0;
+}
+
+/* Map the input file into memory and write the HTML as it is generated. This
+ * is meant for huge documents, which we do not want to copy into a buffer
+ * (nor to keep all the HTML in another one). */
+static int
+process_mapped(const char* path, FILE* out)
+{
+    const MD_CHAR* data = NULL;
+    unsigned long long size;
+    int ret;
+    clock_t t0, t1;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping = NULL;
+    LARGE_INTEGER file_size;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if(file == INVALID_HANDLE_VALUE  ||  !GetFileSizeEx(file, &file_size)) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return -1;
+    }
+    size = (unsigned long long) file_size.QuadPart;
+#else
+    int fd;
+    struct stat st;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0  ||  fstat(fd, &st) != 0) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    size = (unsigned long long) st.st_size;
+#endif
+
+    if(size > (MD_SIZE)(-1)  ||  size > (size_t)(-1)) {
+        fprintf(stderr, "The input is too large. (Build MD4C with "
+                        "MD4C_USE_64BIT_OFFSETS to parse it.)\n");
+        ret = -1;
+        goto out;
+    }
+
+    if(size > 0) {
+#ifdef _WIN32
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping != NULL)
+            data = (const MD_CHAR*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        data = (const MD_CHAR*) mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == (const MD_CHAR*) MAP_FAILED)
+            data = NULL;
+#endif
+        if(data == NULL) {
+            fprintf(stderr, "Cannot map %s into memory.\n", path);
+            ret = -1;
+            goto out;
+        }
+    }
+
+    if(want_fullhtml)
+        write_html_header(out);
+
+    t0 = clock();
+
+    ret = md_render_html_threads((data != NULL ? data : ""), (MD_SIZE) size,
+                write_output, (void*) out, parser_flags, renderer_flags,
+                n_threads, NULL);
+
+    t1 = clock();
+    if(ret != 0) {
+        fprintf(stderr, "Parsing failed.\n");
+        goto out;
+    }
+
+    if(want_fullhtml)
+        write_html_footer(out);
+
+    if(want_stat) {
+        if(t0 != (clock_t)-1  &&  t1 != (clock_t)-1) {
+            double elapsed = (double)(t1 - t0) / CLOCKS_PER_SEC;
+            if (elapsed < 1)
+                fprintf(stderr, "Time spent on parsing: %7.2f ms.\n", elapsed*1e3);
+            else
+                fprintf(stderr, "Time spent on parsing: %6.3f s.\n", elapsed);
+        }
+    }
+
+out:
+#ifdef _WIN32
+    if(data != NULL)
+        UnmapViewOfFile(data);
+    if(mapping != NULL)
+        CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    if(data != NULL)
+        munmap((void*) data, (size_t) size);
+    close(fd);
+#endif
+    return ret;
+}
+
+static void
+write_buffer_stats(const char* name, const MD_BUFFER_STATS* buffer_stats)
+{
+    fprintf(stderr, "Buffer %-12s %10u bytes, %u reallocations.\n", name,
+            (unsigned) buffer_stats->peak_bytes, buffer_stats->n_reallocs);
+}
+
+static void
+write_stats(const MD_STATS* stats)
+{
+    fprintf(stderr, "Lines:              %10u\n", stats->n_lines);
+    fprintf(stderr, "Blocks:             %10u\n", stats->n_blocks);
+    fprintf(stderr, "Marks:              %10u (resolved %u, rollbacks %u)\n",
+            stats->n_marks, stats->n_resolved_marks, stats->n_rollbacks);
+    fprintf(stderr, "Link ref. defs:     %10u\n", stats->n_link_ref_defs);
+    write_buffer_stats("marks:", &stats->marks);
+    write_buffer_stats("block_bytes:", &stats->block_bytes);
+    write_buffer_stats("containers:", &stats->containers);
+    write_buffer_stats("buffer:", &stats->buffer);
+    fprintf(stderr, "Block phase:        %10.2f ms\n", stats->block_time * 1e3);
+    fprintf(stderr, "Inline phase:       %10.2f ms\n", stats->inline_time * 1e3);
+}
+
 static int
 process_file(FILE* in, FILE* out)
 {
@@ -114,6 +324,7 @@ process_file(FILE* in, FILE* out)
     struct membuffer buf_out = {0};
     int ret = -1;
     clock_t t0, t1;
+    MD_STATS stats;
 
     membuf_init(&buf_in, 32 * 1024);
 
@@ -136,8 +347,44 @@ process_file(FILE* in, FILE* out)
      * md_renderer_t structure. */
     t0 = clock();
 
-    ret = md_render_html(buf_in.data, buf_in.size, process_output,
-                (void*) &buf_out, parser_flags, renderer_flags);
+    if(want_read_image) {
+        /* The input is the image. (The buffer is aligned well enough.) */
+        ret = md_render_html_image(buf_in.data, buf_in.size, process_output,
+                    (void*) &buf_out, renderer_flags);
+    } else if(want_tape || want_image || want_write_image) {
+        MD_TAPE* tape = md_parse_to_tape(buf_in.data, buf_in.size, parser_flags);
+        if(tape == NULL) {
+            ret = -1;
+        } else if(want_write_image) {
+            MD_SIZE image_size = md_tape_serialize(tape, NULL, 0);
+            if(buf_out.asize < image_size)
+                membuf_grow(&buf_out, image_size);
+            buf_out.size = md_tape_serialize(tape, buf_out.data, buf_out.asize);
+            ret = 0;
+        } else if(want_image) {
+            MD_SIZE image_size = md_tape_serialize(tape, NULL, 0);
+            void* image = malloc(image_size);
+            if(image != NULL) {
+                md_tape_serialize(tape, image, image_size);
+                ret = md_render_html_image(image, image_size, process_output,
+                            (void*) &buf_out, renderer_flags);
+                free(image);
+            } else {
+                ret = -1;
+            }
+        } else {
+            ret = md_render_html_tape(tape, process_output, (void*) &buf_out, renderer_flags);
+        }
+        if(tape != NULL)
+            md_tape_free(tape);
+    } else if(n_threads > 1  ||  want_stat) {
+        ret = md_render_html_threads(buf_in.data, buf_in.size, process_output,
+                    (void*) &buf_out, parser_flags, renderer_flags, n_threads,
+                    (want_stat ? &stats : NULL));
+    } else {
+        ret = md_render_html(buf_in.data, buf_in.size, process_output,
+                    (void*) &buf_out, parser_flags, renderer_flags);
+    }
 
     t1 = clock();
     if(ret != 0) {
@@ -145,23 +392,14 @@ process_file(FILE* in, FILE* out)
         goto out;
     }
 
-    /* Write down the document in the HTML format. */
-    if(want_fullhtml) {
-        fprintf(out, "<!DOCTYPE html PUBLIC 'ISO/IEC 15445:2000//DTD HTML//EN'>\n");
-        fprintf(out, "<html>\n");
-        fprintf(out, "<head>\n");
-        fprintf(out, "<title>Untitled</title>\n");
-        fprintf(out, "<meta name=\"generator\" content=\"md2html\">\n");
-        fprintf(out, "</head>\n");
-        fprintf(out, "<body>\n");
-    }
+    /* Write down the document in the HTML format (or the image). */
+    if(want_fullhtml  &&  !want_write_image)
+        write_html_header(out);
 
     fwrite(buf_out.data, 1, buf_out.size, out);
 
-    if(want_fullhtml) {
-        fprintf(out, "</body>\n");
-        fprintf(out, "</html>\n");
-    }
+    if(want_fullhtml  &&  !want_write_image)
+        write_html_footer(out);
 
     if(want_stat) {
         if(t0 != (clock_t)-1  &&  t1 != (clock_t)-1) {
@@ -171,6 +409,9 @@ process_file(FILE* in, FILE* out)
             else
                 fprintf(stderr, "Time spent on parsing: %6.3f s.\n", elapsed);
         }
+
+        if(!want_tape  &&  !want_image  &&  !want_write_image  &&  !want_read_image)
+            write_stats(&stats);
     }
 
     /* Success if we have reached here. */
@@ -192,6 +433,13 @@ static const option cmdline_options[] = {
     { "output",                     'o', 'o', OPTION_ARG_REQUIRED },
     { "full-html",                  'f', 'f', OPTION_ARG_NONE },
     { "stat",                       's', 's', OPTION_ARG_NONE },
+    { "stream",                      0,  'S', OPTION_ARG_NONE },
+    { "threads",                    'j', 'j', OPTION_ARG_REQUIRED },
+    { "tape",                        0,  'P', OPTION_ARG_NONE },
+    { "image",                       0,  'M', OPTION_ARG_NONE },
+    { "write-image",                 0,  'Y', OPTION_ARG_NONE },
+    { "read-image",                  0,  'R', OPTION_ARG_NONE },
+    { "mmap",                        0,  'm', OPTION_ARG_NONE },
     { "help",                       'h', 'h', OPTION_ARG_NONE },
     { "version",                    'v', 'v', OPTION_ARG_NONE },
     { "fverbatim-entities",          0,  'E', OPTION_ARG_NONE },
@@ -205,6 +453,10 @@ static const option cmdline_options[] = {
     { "fno-html",                    0,  'H', OPTION_ARG_NONE },
     { "fcollapse-whitespace",        0,  'W', OPTION_ARG_NONE },
     { "ftables",                     0,  'T', OPTION_ARG_NONE },
+    { "fvalidate-utf8",              0,  '8', OPTION_ARG_NONE },
+    { "fcoalesce-text",              0,  'C', OPTION_ARG_NONE },
+    { "fsoftbr-as-text",             0,  'B', OPTION_ARG_NONE },
+    { "fcontiguous-code",            0,  'K', OPTION_ARG_NONE },
     { 0 }
 };
 
@@ -218,7 +470,20 @@ usage(void)
         "General options:\n"
         "  -o  --output=FILE    Output file (default is standard output)\n"
         "  -f, --full-html      Generate full HTML document, including header\n"
-        "  -s, --stat           Measure time of input parsing\n"
+        "  -s, --stat           Measure time of input parsing and report statistics\n"
+        "                       of the parser\n"
+        "      --stream         Convert the input while reading it (link reference\n"
+        "                       definitions then have to precede their uses)\n"
+        "  -j, --threads=N      Use up to N threads for parsing a large input\n"
+        "      --tape           Parse the input into a tape first and render the\n"
+        "                       HTML from it\n"
+        "      --image          Same as --tape but serialize the tape into a binary\n"
+        "                       image and render the HTML from the image\n"
+        "      --write-image    Write the binary image instead of the HTML\n"
+        "      --read-image     Render the HTML from the binary image in the input\n"
+        "                       (as written by --write-image with the same build)\n"
+        "      --mmap           Map the input FILE into memory and write the HTML\n"
+        "                       as it is generated (for huge documents)\n"
         "  -h, --help           Display this help and exit\n"
         "  -v, --version        Display version and exit\n"
         "\n"
@@ -243,6 +508,14 @@ usage(void)
         "                       Disable raw HTML spans\n"
         "      --fno-html       Same as --fno-html-blocks --fno-html-spans\n"
         "      --ftables        Enable tables\n"
+        "      --fvalidate-utf8 Replace invalid UTF-8 sequences in the input with\n"
+        "                       U+FFFD\n"
+        "      --fcoalesce-text Merge adjacent text into single callbacks\n"
+        "      --fsoftbr-as-text\n"
+        "                       Pass soft line breaks as a text\n"
+        "      --fcontiguous-code\n"
+        "                       Pass contents of code blocks in single callbacks\n"
+        "                       where possible\n"
     );
 }
 
@@ -271,6 +544,13 @@ cmdline_callback(int opt, char const* value, void* data)
         case 'o':   output_path = value; break;
         case 'f':   want_fullhtml = 1; break;
         case 's':   want_stat = 1; break;
+        case 'S':   want_stream = 1; break;
+        case 'j':   n_threads = (unsigned) atoi(value); break;
+        case 'P':   want_tape = 1; break;
+        case 'M':   want_image = 1; break;
+        case 'Y':   want_write_image = 1; break;
+        case 'R':   want_read_image = 1; break;
+        case 'm':   want_mmap = 1; break;
         case 'h':   usage(); exit(0); break;
         case 'v':   version(); exit(0); break;
 
@@ -285,6 +565,10 @@ cmdline_callback(int opt, char const* value, void* data)
         case '@':   parser_flags |= MD_FLAG_PERMISSIVEEMAILAUTOLINKS; break;
         case 'V':   parser_flags |= MD_FLAG_PERMISSIVEAUTOLINKS; break;
         case 'T':   parser_flags |= MD_FLAG_TABLES; break;
+        case '8':   parser_flags |= MD_FLAG_VALIDATEUTF8; break;
+        case 'C':   parser_flags |= MD_FLAG_COALESCETEXT; break;
+        case 'B':   parser_flags |= MD_FLAG_SOFTBRASTEXT; break;
+        case 'K':   parser_flags |= MD_FLAG_CONTIGUOUSCODE; break;
 
         default:
             fprintf(stderr, "Illegal option: %s\n", value);
@@ -308,7 +592,12 @@ main(int argc, char** argv)
         exit(1);
     }
 
-    if(input_path != NULL && strcmp(input_path, "-") != 0) {
+    if(want_mmap  &&  (input_path == NULL || strcmp(input_path, "-") == 0)) {
+        fprintf(stderr, "The option --mmap needs an input file.\n");
+        exit(1);
+    }
+
+    if(input_path != NULL && strcmp(input_path, "-") != 0  &&  !want_mmap) {
         in = fopen(input_path, "rb");
         if(in == NULL) {
             fprintf(stderr, "Cannot open %s.\n", input_path);
@@ -316,14 +605,19 @@ main(int argc, char** argv)
         }
     }
     if(output_path != NULL && strcmp(output_path, "-") != 0) {
-        out = fopen(output_path, "wt");
+        out = fopen(output_path, (want_write_image ? "wb" : "wt"));
         if(out == NULL) {
             fprintf(stderr, "Cannot open %s.\n", input_path);
             exit(1);
         }
     }
 
-    ret = process_file(in, out);
+    if(want_mmap)
+        ret = process_mapped(input_path, out);
+    else if(want_stream)
+        ret = process_stream(in, out);
+    else
+        ret = process_file(in, out);
     if(in != stdin)
         fclose(in);
     if(out != stdout)
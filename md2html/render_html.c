@@ -484,3 +484,116 @@ md_render_html(const MD_CHAR* input, MD_SIZE input_size,
     return md_parse(input, input_size, &renderer, (void*) &render);
 }
 
+int
+md_render_html_threads(const MD_CHAR* input, MD_SIZE input_size,
+                       void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                       void* userdata, unsigned parser_flags, unsigned renderer_flags,
+                       unsigned n_threads, MD_STATS* stats)
+{
+    MD_RENDER_HTML render = { process_output, userdata, renderer_flags };
+
+    MD_RENDERER renderer = {
+        enter_block_callback,
+        leave_block_callback,
+        enter_span_callback,
+        leave_span_callback,
+        text_callback,
+        debug_log_callback,
+        parser_flags
+    };
+
+    MD_PARSER* parser;
+    int ret;
+
+    parser = md_parser_new(parser_flags);
+    if(parser == NULL)
+        return -1;
+
+    md_parser_set_threads(parser, n_threads);
+    md_parser_set_stats(parser, stats);
+    ret = md_parser_parse(parser, input, input_size, &renderer, (void*) &render);
+
+    md_parser_free(parser);
+    return ret;
+}
+
+int
+md_render_html_tape(const MD_TAPE* tape,
+                    void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                    void* userdata, unsigned renderer_flags)
+{
+    MD_RENDER_HTML render = { process_output, userdata, renderer_flags };
+
+    MD_RENDERER renderer = {
+        enter_block_callback,
+        leave_block_callback,
+        enter_span_callback,
+        leave_span_callback,
+        text_callback,
+        debug_log_callback,
+        0
+    };
+
+    return md_tape_replay(tape, &renderer, (void*) &render);
+}
+
+int
+md_render_html_image(const void* image, MD_SIZE image_size,
+                     void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                     void* userdata, unsigned renderer_flags)
+{
+    MD_RENDER_HTML render = { process_output, userdata, renderer_flags };
+
+    MD_RENDERER renderer = {
+        enter_block_callback,
+        leave_block_callback,
+        enter_span_callback,
+        leave_span_callback,
+        text_callback,
+        debug_log_callback,
+        0
+    };
+
+    return md_replay_mapped(image, image_size, &renderer, (void*) &render);
+}
+
+int
+md_render_html_stream(MD_SIZE (*read_input)(MD_CHAR*, MD_SIZE, void*),
+                      void* input_userdata,
+                      void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                      void* userdata, unsigned parser_flags, unsigned renderer_flags)
+{
+    MD_RENDER_HTML render = { process_output, userdata, renderer_flags };
+
+    MD_RENDERER renderer = {
+        enter_block_callback,
+        leave_block_callback,
+        enter_span_callback,
+        leave_span_callback,
+        text_callback,
+        debug_log_callback,
+        parser_flags
+    };
+
+    MD_PARSER* parser;
+    MD_CHAR buffer[16 * 1024];
+    MD_SIZE n;
+    int ret;
+
+    parser = md_parser_new(parser_flags);
+    if(parser == NULL)
+        return -1;
+
+    ret = md_parser_begin(parser, &renderer, (void*) &render);
+    while(ret == 0) {
+        n = read_input(buffer, sizeof(buffer) / sizeof(MD_CHAR), input_userdata);
+        if(n == 0)
+            break;
+        ret = md_parser_feed(parser, buffer, n);
+    }
+    ret = md_parser_finish(parser);
+
+    md_parser_free(parser);
+    return ret;
+}
+
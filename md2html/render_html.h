@@ -53,5 +53,42 @@ int md_render_html(const MD_CHAR* input, MD_SIZE input_size,
                    void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
                    void* userdata, unsigned parser_flags, unsigned renderer_flags);
 
+/* Same as md_render_html() but the parser may use up to n_threads threads
+ * if the input is large enough. See md_parser_set_threads() in md4c.h.
+ * If stats is not NULL, it is filled with statistics of the parsing (see
+ * md_parser_set_stats()).
+ */
+int md_render_html_threads(const MD_CHAR* input, MD_SIZE input_size,
+                           void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                           void* userdata, unsigned parser_flags, unsigned renderer_flags,
+                           unsigned n_threads, MD_STATS* stats);
+
+/* Same as md_render_html() but the HTML is generated from a tape made by
+ * md_parse_to_tape(). (The parser flags have been applied when the tape has
+ * been made.)
+ */
+int md_render_html_tape(const MD_TAPE* tape,
+                        void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                        void* userdata, unsigned renderer_flags);
+
+/* Same as md_render_html_tape() but the HTML is generated from a binary
+ * image of the tape (see md_tape_serialize()).
+ */
+int md_render_html_image(const void* image, MD_SIZE image_size,
+                         void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                         void* userdata, unsigned renderer_flags);
+
+/* Same as md_render_html() but the input is read in chunks by the callback
+ * read_input() (which returns number of MD_CHARs it has stored into the
+ * buffer, or zero at the end of the input) and the output is generated as
+ * soon as the parser gets through a chunk of blocks.
+ *
+ * See md_parser_feed() in md4c.h for how this differs from md_parse().
+ */
+int md_render_html_stream(MD_SIZE (*read_input)(MD_CHAR*, MD_SIZE, void*),
+                          void* input_userdata,
+                          void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                          void* userdata, unsigned parser_flags, unsigned renderer_flags);
+
 
 #endif  /* MD4C_RENDER_HTML_H */
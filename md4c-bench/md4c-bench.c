@@ -0,0 +1,586 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Throughput benchmark of MD4C.
+ *
+ * Each input file is parsed repeatedly (after few warmup runs) and the time
+ * of each run is measured with a monotonic wall clock. The files are grouped
+ * into categories by their names: The category is the part of the file name
+ * before the last '-' (e.g. "prose-10M.md" belongs to "prose"), which is how
+ * scripts/bench_corpus.py names the files it generates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#include "md4c.h"
+#include "render_html.h"
+#include "cmdline.h"
+
+
+
+/* Global options. */
+static unsigned parser_flags = 0;
+static unsigned n_warmup = 2;
+static unsigned n_repeat = 10;
+static double min_time = 0.5;
+static unsigned n_threads = 0;
+static int want_html = 0;
+
+
+/* Wall clock time in seconds. */
+static double
+bench_clock(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+#endif
+}
+
+
+/*******************************
+ ***  Benchmarked operation  ***
+ *******************************/
+
+/* When measuring just the parser, the callbacks do nothing but counting the
+ * text, so the compiler cannot optimize anything away. */
+static MD_SIZE text_size;
+
+static int
+enter_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    return 0;
+}
+
+static int
+leave_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    return 0;
+}
+
+static int
+enter_span_callback(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    return 0;
+}
+
+static int
+leave_span_callback(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    return 0;
+}
+
+static int
+text_callback(MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    text_size += size;
+    return 0;
+}
+
+static const MD_RENDERER null_renderer = {
+    enter_block_callback,
+    leave_block_callback,
+    enter_span_callback,
+    leave_span_callback,
+    text_callback,
+    NULL,
+    0
+};
+
+/* When rendering the HTML, it goes into a buffer which is reused by all the
+ * runs. */
+static char* html_data = NULL;
+static size_t html_size = 0;
+static size_t html_alloc = 0;
+
+static void
+process_output(const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    if(html_size + size > html_alloc) {
+        size_t new_alloc = (html_size + size) * 2;
+        char* new_data = realloc(html_data, new_alloc);
+        if(new_data == NULL) {
+            fprintf(stderr, "process_output: realloc() failed.\n");
+            exit(1);
+        }
+        html_data = new_data;
+        html_alloc = new_alloc;
+    }
+    memcpy(html_data + html_size, text, size);
+    html_size += size;
+}
+
+static int
+run_once(MD_PARSER* parser, const char* data, size_t size, double* p_time)
+{
+    double t0, t1;
+    int ret;
+
+    html_size = 0;
+
+    t0 = bench_clock();
+    if(want_html) {
+        ret = md_render_html_threads(data, (MD_SIZE) size, process_output, NULL,
+                    parser_flags, 0, n_threads, NULL);
+    } else {
+        ret = md_parser_parse(parser, data, (MD_SIZE) size, &null_renderer, NULL);
+    }
+    t1 = bench_clock();
+
+    *p_time = t1 - t0;
+    return ret;
+}
+
+
+/***********************************
+ ***  Statistics and the report  ***
+ ***********************************/
+
+typedef struct BENCH_RESULT {
+    const char* path;
+    char category[64];
+    unsigned category_index;    /* Order of the first appearance. */
+    size_t size;
+    unsigned n_runs;
+    double total_time;
+    double p50;
+    double p99;
+} BENCH_RESULT;
+
+static int
+cmp_double(const void* a, const void* b)
+{
+    double da = *(const double*) a;
+    double db = *(const double*) b;
+    return (da < db) ? -1 : (da > db) ? 1 : 0;
+}
+
+/* Nearest-rank percentile of the sorted samples. */
+static double
+percentile(const double* samples, unsigned n, unsigned pct)
+{
+    unsigned rank = (n * pct + 99) / 100;
+    if(rank < 1)
+        rank = 1;
+    return samples[rank - 1];
+}
+
+static void
+get_category(const char* path, char* category, size_t category_size)
+{
+    const char* name = path;
+    const char* end;
+    const char* p;
+    size_t len;
+
+    for(p = path; *p != '\0'; p++) {
+        if(*p == '/'  ||  *p == '\\')
+            name = p + 1;
+    }
+
+    end = strrchr(name, '-');
+    if(end == NULL)
+        end = strrchr(name, '.');
+    if(end == NULL  ||  end == name)
+        end = name + strlen(name);
+
+    len = end - name;
+    if(len >= category_size)
+        len = category_size - 1;
+    memcpy(category, name, len);
+    category[len] = '\0';
+}
+
+static char*
+load_file(const char* path, size_t* p_size)
+{
+    FILE* f;
+    char* data = NULL;
+    size_t size = 0;
+    size_t alloc = 0;
+    size_t n;
+
+    f = fopen(path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return NULL;
+    }
+
+    while(1) {
+        if(size >= alloc) {
+            char* new_data;
+
+            alloc = (alloc > 0 ? 2 * alloc : 64 * 1024);
+            new_data = realloc(data, alloc);
+            if(new_data == NULL) {
+                fprintf(stderr, "load_file: realloc() failed.\n");
+                free(data);
+                fclose(f);
+                return NULL;
+            }
+            data = new_data;
+        }
+
+        n = fread(data + size, 1, alloc - size, f);
+        if(n == 0)
+            break;
+        size += n;
+    }
+
+    fclose(f);
+    *p_size = size;
+    return data;
+}
+
+static int
+bench_file(MD_PARSER* parser, const char* path, BENCH_RESULT* result)
+{
+    char* data;
+    size_t size;
+    double* samples = NULL;
+    double t;
+    unsigned n_runs;
+    unsigned i;
+    int ret = -1;
+
+    data = load_file(path, &size);
+    if(data == NULL)
+        return -1;
+
+    /* Warmup: Also lets the parser grow its buffers, and estimates how many
+     * runs we need to spend at least min_time on the file. */
+    t = 0.0;
+    for(i = 0; i < n_warmup || i == 0; i++) {
+        if(run_once(parser, data, size, &t) != 0) {
+            fprintf(stderr, "Parsing of %s failed.\n", path);
+            goto out;
+        }
+    }
+
+    n_runs = n_repeat;
+    if(t > 0.0  &&  n_runs * t < min_time) {
+        double n = min_time / t;
+        n_runs = (n < 100000.0 ? (unsigned) n + 1 : 100000);
+    }
+
+    samples = malloc(n_runs * sizeof(double));
+    if(samples == NULL) {
+        fprintf(stderr, "bench_file: malloc() failed.\n");
+        goto out;
+    }
+
+    result->path = path;
+    get_category(path, result->category, sizeof(result->category));
+    result->size = size;
+    result->n_runs = n_runs;
+    result->total_time = 0.0;
+
+    for(i = 0; i < n_runs; i++) {
+        if(run_once(parser, data, size, &samples[i]) != 0) {
+            fprintf(stderr, "Parsing of %s failed.\n", path);
+            goto out;
+        }
+        result->total_time += samples[i];
+    }
+
+    qsort(samples, n_runs, sizeof(double), cmp_double);
+    result->p50 = percentile(samples, n_runs, 50);
+    result->p99 = percentile(samples, n_runs, 99);
+    ret = 0;
+
+out:
+    free(samples);
+    free(data);
+    return ret;
+}
+
+static void
+format_size(size_t size, char* buffer, size_t buffer_size)
+{
+    if(size >= 1024 * 1024)
+        snprintf(buffer, buffer_size, "%.1f MB", (double) size / (1024.0 * 1024.0));
+    else if(size >= 1024)
+        snprintf(buffer, buffer_size, "%.1f KB", (double) size / 1024.0);
+    else
+        snprintf(buffer, buffer_size, "%u B", (unsigned) size);
+}
+
+static void
+write_row(const char* category, const char* size_str, unsigned n_runs,
+          double bytes, double time, double p50, double p99)
+{
+    printf("%-12s %10s %8u %10.1f %9.2f %11.3f %11.3f\n",
+           category, size_str, n_runs,
+           bytes / time / (1024.0 * 1024.0), time * 1e9 / bytes,
+           p50 * 1e3, p99 * 1e3);
+}
+
+static int
+cmp_result(const void* a, const void* b)
+{
+    const BENCH_RESULT* ra = (const BENCH_RESULT*) a;
+    const BENCH_RESULT* rb = (const BENCH_RESULT*) b;
+
+    if(ra->category_index != rb->category_index)
+        return (ra->category_index < rb->category_index) ? -1 : 1;
+    if(ra->size != rb->size)
+        return (ra->size < rb->size) ? -1 : 1;
+    return 0;
+}
+
+static void
+write_report(BENCH_RESULT* results, unsigned n_results)
+{
+    unsigned i, j;
+
+    /* Rows of the same category together (in the order of their first
+     * appearance) and ordered by the size, each category followed by its
+     * total. */
+    for(i = 0; i < n_results; i++) {
+        results[i].category_index = i;
+        for(j = 0; j < i; j++) {
+            if(strcmp(results[j].category, results[i].category) == 0) {
+                results[i].category_index = results[j].category_index;
+                break;
+            }
+        }
+    }
+    qsort(results, n_results, sizeof(BENCH_RESULT), cmp_result);
+
+    printf("%-12s %10s %8s %10s %9s %11s %11s\n",
+           "Category", "Size", "Runs", "MB/s", "ns/byte", "p50 [ms]", "p99 [ms]");
+
+    for(i = 0; i < n_results; i = j) {
+        double bytes = 0.0;
+        double time = 0.0;
+        unsigned n_runs = 0;
+
+        for(j = i; j < n_results  &&  results[j].category_index == results[i].category_index; j++) {
+            char size_str[32];
+
+            format_size(results[j].size, size_str, sizeof(size_str));
+            write_row(results[j].category, size_str, results[j].n_runs,
+                      (double) results[j].size * results[j].n_runs,
+                      results[j].total_time, results[j].p50, results[j].p99);
+
+            bytes += (double) results[j].size * results[j].n_runs;
+            time += results[j].total_time;
+            n_runs += results[j].n_runs;
+        }
+
+        /* Throughput over all the files of the category. (The latency
+         * percentiles make no sense for documents of different sizes.) */
+        if(j - i > 1) {
+            printf("%-12s %10s %8u %10.1f %9.2f\n", results[i].category, "(total)",
+                   n_runs, bytes / time / (1024.0 * 1024.0), time * 1e9 / bytes);
+        }
+    }
+}
+
+
+/**********************
+ ***  Main program  ***
+ **********************/
+
+#define OPTION_ARG_NONE         0
+#define OPTION_ARG_REQUIRED     1
+#define OPTION_ARG_OPTIONAL     2
+
+static const option cmdline_options[] = {
+    { "warmup",                     'w', 'w', OPTION_ARG_REQUIRED },
+    { "repeat",                     'r', 'r', OPTION_ARG_REQUIRED },
+    { "min-time",                   't', 't', OPTION_ARG_REQUIRED },
+    { "threads",                    'j', 'j', OPTION_ARG_REQUIRED },
+    { "html",                        0,  'X', OPTION_ARG_NONE },
+    { "help",                       'h', 'h', OPTION_ARG_NONE },
+    { "version",                    'v', 'v', OPTION_ARG_NONE },
+    { "fpermissive-atx-headers",     0,  'A', OPTION_ARG_NONE },
+    { "fpermissive-url-autolinks",   0,  'U', OPTION_ARG_NONE },
+    { "fpermissive-email-autolinks", 0,  '@', OPTION_ARG_NONE },
+    { "fpermissive-autolinks",       0,  'V', OPTION_ARG_NONE },
+    { "fno-indented-code",           0,  'I', OPTION_ARG_NONE },
+    { "fno-html-blocks",             0,  'F', OPTION_ARG_NONE },
+    { "fno-html-spans",              0,  'G', OPTION_ARG_NONE },
+    { "fno-html",                    0,  'H', OPTION_ARG_NONE },
+    { "fcollapse-whitespace",        0,  'W', OPTION_ARG_NONE },
+    { "ftables",                     0,  'T', OPTION_ARG_NONE },
+    { "fvalidate-utf8",              0,  '8', OPTION_ARG_NONE },
+    { "fcoalesce-text",              0,  'C', OPTION_ARG_NONE },
+    { "fsoftbr-as-text",             0,  'B', OPTION_ARG_NONE },
+    { "fcontiguous-code",            0,  'K', OPTION_ARG_NONE },
+    { 0 }
+};
+
+static void
+usage(void)
+{
+    printf(
+        "Usage: md4c-bench [OPTION]... FILE...\n"
+        "Measure the throughput of MD4C parsing the input FILEs.\n"
+        "\n"
+        "The files are grouped into categories by the part of their name before\n"
+        "the last '-'. (See scripts/bench_corpus.py to generate such files.)\n"
+        "\n"
+        "General options:\n"
+        "  -w, --warmup=N       Parse each file N times before measuring (default 2)\n"
+        "  -r, --repeat=N       Measure at least N runs of each file (default 10)\n"
+        "  -t, --min-time=SEC   Repeat small files to measure at least SEC seconds\n"
+        "                       on each of them (default 0.5)\n"
+        "  -j, --threads=N      Use up to N threads for parsing a large input\n"
+        "      --html           Measure also rendering of the HTML\n"
+        "  -h, --help           Display this help and exit\n"
+        "  -v, --version        Display version and exit\n"
+        "\n"
+        "Markdown extension options:\n"
+        "      --fcollapse-whitespace, --fpermissive-atx-headers,\n"
+        "      --fpermissive-url-autolinks, --fpermissive-email-autolinks,\n"
+        "      --fpermissive-autolinks, --fno-indented-code, --fno-html-blocks,\n"
+        "      --fno-html-spans, --fno-html, --ftables, --fvalidate-utf8,\n"
+        "      --fcoalesce-text, --fsoftbr-as-text, --fcontiguous-code\n"
+        "                       Same as for md2html\n"
+    );
+}
+
+static void
+version(void)
+{
+    printf("%d.%d.%d\n", MD_VERSION_MAJOR, MD_VERSION_MINOR, MD_VERSION_RELEASE);
+}
+
+static const char** input_paths = NULL;
+static unsigned n_input_paths = 0;
+
+static int
+cmdline_callback(int opt, char const* value, void* data)
+{
+    switch(opt) {
+        case 0:
+        {
+            const char** new_paths = realloc((void*) input_paths,
+                        (n_input_paths + 1) * sizeof(const char*));
+            if(new_paths == NULL) {
+                fprintf(stderr, "cmdline_callback: realloc() failed.\n");
+                exit(1);
+            }
+            input_paths = new_paths;
+            input_paths[n_input_paths++] = value;
+            break;
+        }
+
+        case 'w':   n_warmup = (unsigned) atoi(value); break;
+        case 'r':   n_repeat = (unsigned) atoi(value); break;
+        case 't':   min_time = atof(value); break;
+        case 'j':   n_threads = (unsigned) atoi(value); break;
+        case 'X':   want_html = 1; break;
+        case 'h':   usage(); exit(0); break;
+        case 'v':   version(); exit(0); break;
+
+        case 'A':   parser_flags |= MD_FLAG_PERMISSIVEATXHEADERS; break;
+        case 'I':   parser_flags |= MD_FLAG_NOINDENTEDCODEBLOCKS; break;
+        case 'F':   parser_flags |= MD_FLAG_NOHTMLBLOCKS; break;
+        case 'G':   parser_flags |= MD_FLAG_NOHTMLSPANS; break;
+        case 'H':   parser_flags |= MD_FLAG_NOHTML; break;
+        case 'W':   parser_flags |= MD_FLAG_COLLAPSEWHITESPACE; break;
+        case 'U':   parser_flags |= MD_FLAG_PERMISSIVEURLAUTOLINKS; break;
+        case '@':   parser_flags |= MD_FLAG_PERMISSIVEEMAILAUTOLINKS; break;
+        case 'V':   parser_flags |= MD_FLAG_PERMISSIVEAUTOLINKS; break;
+        case 'T':   parser_flags |= MD_FLAG_TABLES; break;
+        case '8':   parser_flags |= MD_FLAG_VALIDATEUTF8; break;
+        case 'C':   parser_flags |= MD_FLAG_COALESCETEXT; break;
+        case 'B':   parser_flags |= MD_FLAG_SOFTBRASTEXT; break;
+        case 'K':   parser_flags |= MD_FLAG_CONTIGUOUSCODE; break;
+
+        default:
+            fprintf(stderr, "Illegal option: %s\n", value);
+            fprintf(stderr, "Use --help for more info.\n");
+            exit(1);
+            break;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    MD_PARSER* parser;
+    BENCH_RESULT* results;
+    unsigned n_results = 0;
+    unsigned i;
+    int ret = 0;
+
+    if(readoptions(cmdline_options, argc, argv, cmdline_callback, NULL) < 0) {
+        usage();
+        exit(1);
+    }
+
+    if(n_input_paths == 0) {
+        fprintf(stderr, "No input file specified.\n");
+        fprintf(stderr, "Use --help for more info.\n");
+        exit(1);
+    }
+    if(n_repeat == 0)
+        n_repeat = 1;
+
+    parser = md_parser_new(parser_flags);
+    results = malloc(n_input_paths * sizeof(BENCH_RESULT));
+    if(parser == NULL  ||  results == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
+    }
+    md_parser_set_threads(parser, n_threads);
+
+    for(i = 0; i < n_input_paths; i++) {
+        if(bench_file(parser, input_paths[i], &results[n_results]) == 0)
+            n_results++;
+        else
+            ret = 1;
+    }
+
+    write_report(results, n_results);
+
+    free(results);
+    free(html_data);
+    free((void*) input_paths);
+    md_parser_free(parser);
+    return ret;
+}
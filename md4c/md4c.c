@@ -29,6 +29,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* On x86-64, we use SSE2/SSSE3/AVX2 (as far as the CPU supports it) for
+ * scanning of the inline text, for validation of UTF-8 (MD_FLAG_VALIDATEUTF8)
+ * and for searching for the end of raw HTML blocks. Define MD4C_NO_SIMD to
+ * disable all of it. */
+#if !defined MD4C_NO_SIMD  &&  !defined MD4C_USE_UTF16  &&  \
+    defined __GNUC__  &&  defined __x86_64__
+    #define MD4C_SIMD_X86       1
+    #include <immintrin.h>
+#endif
+
+/* A large document may be parsed by multiple threads (see
+ * md_parser_set_threads()). Define MD4C_NO_THREADS to build without any
+ * dependency on the threading API. (The documents are then parsed in the
+ * calling thread only.) */
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+    #ifndef MD4C_NO_THREADS
+        #include <pthread.h>
+    #endif
+#endif
+
 
 /*****************************
  ***  Miscellaneous Stuff  ***
@@ -42,6 +65,16 @@
     #endif
 #endif
 
+/* Ask the compiler to always inline the function. This is how a function
+ * is instantiated for compile-time constant arguments. */
+#if defined __GNUC__
+    #define MD_FORCEINLINE      static inline __attribute__((always_inline))
+#elif defined _MSC_VER
+    #define MD_FORCEINLINE      static __forceinline
+#else
+    #define MD_FORCEINLINE      static inline
+#endif
+
 #ifdef _T
     #undef _T
 #endif
@@ -76,6 +109,8 @@ typedef struct MD_MARK_tag MD_MARK;
 typedef struct MD_BLOCK_tag MD_BLOCK;
 typedef struct MD_CONTAINER_tag MD_CONTAINER;
 typedef struct MD_LINK_REF_DEF_tag MD_LINK_REF_DEF;
+typedef struct MD_LINE_ANALYSIS_tag MD_LINE_ANALYSIS;
+typedef struct MD_LINE_tag MD_LINE;
 
 
 /* During analyzes of inline marks, we need to manage some "mark chains",
@@ -88,6 +123,9 @@ struct MD_MARKCHAIN_tag {
     int tail;   /* Index of last mark in the chain, or -1 if empty. */
 };
 
+/* Code span marks are limited to runs of less backticks then this. */
+#define CODESPAN_MARK_MAXLEN    256
+
 /* Context propagated through all the parsing. */
 typedef struct MD_CTX_tag MD_CTX;
 struct MD_CTX_tag {
@@ -97,15 +135,47 @@ struct MD_CTX_tag {
     MD_RENDERER r;
     void* userdata;
 
+    /* Memory allocator used for all the buffers below. */
+    MD_ALLOCATOR allocator;
+
+    /* Statistics to update, or NULL (see md_parser_set_stats()). */
+    MD_STATS* stats;
+
     /* Helper temporary growing buffer. */
     CHAR* buffer;
-    unsigned alloc_buffer;
+    SZ alloc_buffer;
+
+    /* Text not yet sent to the text callback (with MD_FLAG_COALESCETEXT, see
+     * md_text_coalesced()). It points either into the document or into
+     * text_buffer, where pieces not contiguous in the document are staged. */
+    MD_TEXTTYPE text_type;
+    const CHAR* text_ptr;
+    SZ text_size;
+    CHAR* text_buffer;
+    SZ alloc_text_buffer;
 
     /* Link reference definitions. */
     MD_LINK_REF_DEF* link_ref_defs;
     int n_link_ref_defs;
     int alloc_link_ref_defs;
 
+    /* Open-addressing hash table of link reference definitions, keyed by
+     * their normalized labels. It holds indexes into link_ref_defs (or -1
+     * for empty slots) and its size is always a power of 2. */
+    int* ref_def_hashtable;
+    int alloc_ref_def_hashtable;
+
+    /* Pool of the normalized labels (sequences of case-folded codepoints)
+     * of the link reference definitions. */
+    int* ref_def_labels;
+    int n_ref_def_labels;
+    int alloc_ref_def_labels;
+
+    /* Set when the document text may move or change while the link
+     * reference definitions are still needed (see md_parser_feed() and
+     * md_parser_edit()), so they must own copies of their titles. */
+    int text_is_volatile;
+
     /* Stack of inline/span markers.
      * This is only used for parsing a single block contents but by storing it
      * here we may reuse the stack for subsequent blocks; i.e. we have fewer
@@ -116,19 +186,53 @@ struct MD_CTX_tag {
 
     char mark_char_map[128];
 
+    /* Function finding the next char which is in mark_char_map. Depending
+     * on the CPU, it may be a vectorized one. (See md_scan_marks_xxxx().)
+     * For the vectorized one, the map is also encoded as two nibble tables:
+     * A char 'ch' is a mark char iff the bit (ch >> 4) is set in
+     * mark_nibble_map[ch & 0xf]. */
+    OFF (*scan_marks)(MD_CTX* /*ctx*/, OFF /*off*/, OFF /*end*/);
+    unsigned char mark_nibble_map[16];
+
+    /* Function finding the next pair of given chars (for the ends of raw
+     * HTML blocks). It may be a vectorized one too. (See md_find_pair_xxxx().) */
+    OFF (*find_pair)(MD_CTX* /*ctx*/, OFF /*off*/, OFF /*end*/, CHAR /*c1*/, CHAR /*c2*/);
+
+    /* Instantiations of the hottest functions for the flags in ctx->r.flags.
+     * (See md_setup_specialized().) */
+    int (*analyze_line)(MD_CTX* /*ctx*/, OFF /*beg*/, OFF* /*p_end*/,
+                        const MD_LINE_ANALYSIS* /*pivot_line*/, MD_LINE_ANALYSIS* /*line*/);
+    int (*collect_marks)(MD_CTX* /*ctx*/, const MD_LINE* /*lines*/, SZ /*n_lines*/);
+
     /* For resolving of inline spans. */
-    MD_MARKCHAIN mark_chains[6];
+    MD_MARKCHAIN mark_chains[16];
 #define PTR_CHAIN               ctx->mark_chains[0]
 #define BACKTICK_OPENERS        ctx->mark_chains[1]
 #define LOWERTHEN_OPENERS       ctx->mark_chains[2]
-#define ASTERISK_OPENERS        ctx->mark_chains[3]
-#define UNDERSCORE_OPENERS      ctx->mark_chains[4]
-#define BRACKET_OPENERS         ctx->mark_chains[5]
+#define BRACKET_OPENERS         ctx->mark_chains[3]
+    /* Openers of emphasis are kept in separate chains ("buckets") for each
+     * char ('*', '_'), intra-word status and length modulo 3, so the nearest
+     * opener satisfying the rule of 3 is always a tail of some of them.
+     * (See md_emph_chain_index().) */
+#define EMPH_OPENERS_FIRST      4
+#define EMPH_OPENERS_COUNT      12
+
+    /* Unresolved openers in BACKTICK_OPENERS, indexed by their length (or -1).
+     * (The chain normally never holds two openers of the same length: such a
+     * later one would resolve the former as its closer. For the exception,
+     * see md_backtick_opener_forget().) */
+    int backtick_openers[CODESPAN_MARK_MAXLEN];
 
     /* For resolving links. */
     int unresolved_link_head;
     int unresolved_link_tail;
 
+    /* If looking for the end of a link title (of an inline link) has failed,
+     * no title with the same closer char starting later in the same block
+     * can succeed either. So we remember the lowest offset where it failed,
+     * for each of '"', '\'' and ')' (in this order), or (OFF)(-1). */
+    OFF link_title_fail[3];
+
     /* For block analysis.
      * Notes:
      *   -- It holds MD_BLOCK as well as MD_LINE structures. After each
@@ -138,8 +242,13 @@ struct MD_CTX_tag {
      */
     void* block_bytes;
     MD_BLOCK* current_block;
-    int n_block_bytes;
-    int alloc_block_bytes;
+    SZ n_block_bytes;
+    SZ alloc_block_bytes;
+
+    /* Value of n_block_bytes after the last container block was pushed.
+     * If it still equals n_block_bytes, the top of block_bytes is that
+     * container block (and not a line of some leaf block). */
+    SZ container_block_bytes_end;
 
     /* For container block analysis. */
     MD_CONTAINER* containers;
@@ -149,12 +258,17 @@ struct MD_CTX_tag {
     int last_line_has_list_loosening_effect;
     int last_list_item_starts_with_two_blank_lines;
 
-    /* Minimal indentation to call the block "indented code block". */
-    unsigned code_indent_offset;
-
     /* Contextual info for line analysis. */
     SZ code_fence_length;   /* For checking closing fence length. */
     int html_block_type;    /* For checking closing raw HTML condition. */
+
+    /* Line index: For each line of the document, the offset of its end (i.e.
+     * of its line break, or ctx->size for the last line if the document does
+     * not end with a line break). Built before the block analysis. */
+    OFF* line_ends;
+    SZ n_lines;
+    SZ alloc_lines;
+    SZ current_line;        /* Index of the line being analyzed. */
 };
 
 typedef enum MD_LINETYPE_tag MD_LINETYPE;
@@ -172,7 +286,6 @@ enum MD_LINETYPE_tag {
     MD_LINE_TABLEUNDERLINE
 };
 
-typedef struct MD_LINE_ANALYSIS_tag MD_LINE_ANALYSIS;
 struct MD_LINE_ANALYSIS_tag {
     MD_LINETYPE type    : 16;
     unsigned data       : 16;
@@ -181,7 +294,6 @@ struct MD_LINE_ANALYSIS_tag {
     unsigned indent;        /* Indentation level. */
 };
 
-typedef struct MD_LINE_tag MD_LINE;
 struct MD_LINE_tag {
     OFF beg;
     OFF end;
@@ -307,21 +419,25 @@ md_ascii_eq(const CHAR* s1, const CHAR* s2, SZ n)
 static int
 md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ size)
 {
-    OFF off = 0;
+    OFF off;
     int ret = 0;
 
     while(1) {
+#if defined MD4C_USE_UTF16
+        off = 0;
         while(off < size  &&  str[off] != _T('\0'))
             off++;
+#else
+        /* The text may be large (e.g. whole contents of a code block with
+         * MD_FLAG_CONTIGUOUSCODE), so use memchr(). */
+        const CHAR* null_ptr = (const CHAR*) memchr(str, '\0', size);
+        off = (null_ptr != NULL ? (OFF)(null_ptr - str) : size);
+#endif
 
         if(off > 0) {
             ret = ctx->r.text(type, str, off, ctx->userdata);
             if(ret != 0)
                 return ret;
-
-            str += off;
-            size -= off;
-            off = 0;
         }
 
         if(off >= size)
@@ -330,11 +446,68 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
         ret = ctx->r.text(MD_TEXT_NULLCHAR, _T(""), 1, ctx->userdata);
         if(ret != 0)
             return ret;
-        off++;
+
+        /* Skip the text and the '\0' itself. */
+        str += off + 1;
+        size -= off + 1;
     }
 }
 
 
+/* Memory management. All allocations go through the MD_ALLOCATOR hooks. */
+static inline void*
+md_malloc(MD_CTX* ctx, SZ size)
+{
+    return ctx->allocator.alloc(size, ctx->allocator.userdata);
+}
+
+static inline void*
+md_realloc(MD_CTX* ctx, void* ptr, SZ old_size, SZ new_size)
+{
+    return ctx->allocator.resize(ptr, old_size, new_size, ctx->allocator.userdata);
+}
+
+static inline void
+md_free(MD_CTX* ctx, void* ptr)
+{
+    if(ptr != NULL)
+        ctx->allocator.release(ptr, ctx->allocator.userdata);
+}
+
+
+/* Statistics (see md_parser_set_stats()). */
+#define MD_STAT_ADD(member, n)                                          \
+    do {                                                                \
+        if(ctx->stats != NULL)                                          \
+            ctx->stats->member += (n);                                  \
+    } while(0)
+
+#define MD_STAT_PEAK(member, bytes)                                     \
+    do {                                                                \
+        if(ctx->stats != NULL  &&  (bytes) > ctx->stats->member.peak_bytes) \
+            ctx->stats->member.peak_bytes = (bytes);                    \
+    } while(0)
+
+/* Wall clock time in seconds. */
+static double
+md_stats_clock(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+#endif
+}
+
+
 #define MD_CHECK(func)                                                  \
     do {                                                                \
         ret = (func);                                                   \
@@ -349,7 +522,8 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
             CHAR* new_buffer;                                           \
             SZ new_size = ((sz) + (sz) / 2 + 128) & ~127;               \
                                                                         \
-            new_buffer = realloc(ctx->buffer, new_size);                \
+            new_buffer = md_realloc(ctx, ctx->buffer,                   \
+                                    ctx->alloc_buffer, new_size);       \
             if(new_buffer == NULL) {                                    \
                 MD_LOG("realloc() failed.");                            \
                 ret = -1;                                               \
@@ -358,7 +532,9 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
                                                                         \
             ctx->buffer = new_buffer;                                   \
             ctx->alloc_buffer = new_size;                               \
+            MD_STAT_ADD(buffer.n_reallocs, 1);                          \
         }                                                               \
+        MD_STAT_PEAK(buffer, (SZ)(sz));                                 \
     } while(0)
 
 
@@ -409,6 +585,34 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
         }                                                               \
     } while(0)
 
+/* Same as MD_TEXT() but with MD_FLAG_COALESCETEXT, the text may be kept
+ * pending to be merged with the following one. MD_TEXT_FLUSH() has to be used
+ * before any other callback then. */
+#define MD_TEXT_COALESCED(type, str, size)                              \
+    do {                                                                \
+        if(size > 0) {                                                  \
+            if(ctx->r.flags & MD_FLAG_COALESCETEXT)                     \
+                ret = md_text_coalesced(ctx, (type), (str), (size));    \
+            else                                                        \
+                ret = ctx->r.text((type), (str), (size), ctx->userdata);\
+            if(ret != 0) {                                              \
+                MD_LOG("Aborted from text() callback.");                \
+                goto abort;                                             \
+            }                                                           \
+        }                                                               \
+    } while(0)
+
+#define MD_TEXT_FLUSH()                                                 \
+    do {                                                                \
+        if(ctx->text_size > 0) {                                        \
+            ret = md_text_flush(ctx);                                   \
+            if(ret != 0) {                                              \
+                MD_LOG("Aborted from text() callback.");                \
+                goto abort;                                             \
+            }                                                           \
+        }                                                               \
+    } while(0)
+
 #define MD_TEXT_INSECURE(type, str, size)                               \
     do {                                                                \
         if(size > 0) {                                                  \
@@ -452,189 +656,592 @@ struct MD_UNICODE_FOLD_INFO_tag {
         return FALSE;
     }
 
-    static int
-    md_unicode_cmp__(const void* p_codepoint_a, const void* p_codepoint_b)
-    {
-        return (*(const int*)p_codepoint_a - *(const int*)p_codepoint_b);
-    }
+    /* The Unicode punctuation (classes Pc, Pd, Pe, Pf, Pi, Po, Ps) and case
+     * folding data is stored in two-stage tables: The high bits of the
+     * codepoint select a block in the stage 1 table, the low bits then the
+     * entry in the block. Most blocks are empty (and shared), so the tables
+     * are small and the lookup needs just two memory accesses.
+     *
+     * To update the data, edit and run scripts/build_unicode_tables.py. */
+    /* BEGIN GENERATED by scripts/build_unicode_tables.py. Do not edit. */
+    #define MD_UNICODE_TABLE_LIMIT      0x20000
+    #define MD_UNICODE_PUNCT_SHIFT      8
+    #define MD_UNICODE_FOLD_SHIFT       6
+    #define MD_UNICODE_FOLD_MULTI       (-16384)
+
+    static const unsigned char md_unicode_punct_stage1[512] = {
+        1, 0, 0, 2, 0, 3, 4, 5, 6, 7, 8, 0, 0, 9, 10, 11, 12, 0, 0, 13, 14, 0, 15, 16, 17, 18, 19, 20, 21, 0, 0, 0,
+        22, 0, 0, 23, 0, 0, 0, 24, 0, 25, 0, 0, 26, 27, 28, 0, 29, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 30, 0, 31, 0, 32, 33, 34, 35, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 36, 37, 38,
+        0, 39, 0, 40, 0, 41, 0, 0, 42, 43, 44, 45, 0, 0, 0, 0, 46, 47, 48, 0, 49, 50, 51, 52, 0, 0, 0, 0, 53, 0, 0, 0,
+        0, 0, 0, 0, 54, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 55, 56, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 57, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 58, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 59, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    static const unsigned char md_unicode_punct_stage2[60][32] = {
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x82, 0x08, 0xc0, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+            0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfc, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x49, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00
+        },
+        {
+            0x00, 0x36, 0x00, 0xc8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0xff, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x03
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x7f, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x01, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0xf0, 0xff, 0x17, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x06, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfc, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x01, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x38, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70, 0x07, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0xff, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x7f, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfc, 0x01, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0xff, 0xff, 0xff, 0x00, 0xff, 0xff, 0xef, 0xff, 0xfb, 0x7f, 0x00, 0x00, 0x00, 0x60,
+            0x00, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x0f, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x3f, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x00, 0xc0, 0xff, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0xf8, 0xff, 0xff, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x30
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xde
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x0e, 0xff, 0xf3, 0xff, 0x00, 0x00, 0x01, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0
+        },
+        {
+            0x00, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x40,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfc, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x17
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe, 0x3f, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x03, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0xff, 0x03, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0xf7, 0xff, 0x0b, 0x0d, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0xee, 0xf7, 0x00, 0x8c, 0x01, 0x00, 0x00, 0xb8, 0x00, 0x00, 0x00, 0xa8, 0x3f, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x01, 0x00, 0x00, 0x00, 0x80,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7f, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x1e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xd8, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe0, 0x23, 0x00, 0xe8, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x00, 0xff, 0x1f, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x0f, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x80, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        },
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        }
+    };
+
+    static const unsigned char md_unicode_fold_stage1[2048] = {
+        0, 0, 1, 2, 3, 4, 5, 6, 7, 0, 0, 0, 0, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 18, 18, 19, 20, 21, 22, 23, 24,
+        0, 0, 0, 0, 25, 26, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 27, 28, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 29, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 30, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 31, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    static const short md_unicode_fold_stage2[32][64] = {
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 775, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
+            32, 32, 32, 32, 32, 32, 32, 0, 32, 32, 32, 32, 32, 32, 32, -16384,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            -16385, 0, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 0, 1, 0, 1
+        },
+        {
+            0, 1, 0, 1, 0, 1, 0, 1, 0, -16386, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, -121, 1, 0, 1, 0, 1, 0, -268
+        },
+        {
+            0, 210, 1, 0, 1, 0, 206, 1, 0, 205, 205, 1, 0, 0, 79, 202,
+            203, 1, 0, 205, 207, 0, 211, 209, 1, 0, 0, 0, 211, 213, 0, 214,
+            1, 0, 1, 0, 1, 0, 218, 1, 0, 218, 0, 0, 1, 0, 218, 1,
+            0, 217, 217, 1, 0, 1, 0, 219, 1, 0, 0, 0, 1, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 2, 1, 0, 2, 1, 0, 2, 1, 0, 1, 0, 1,
+            0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            -16387, 2, 1, 0, 1, 0, -97, -56, 1, 0, 1, 0, 1, 0, 1, 0
+        },
+        {
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            -130, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 116, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 38, 0, 37, 37, 37, 0, 64, 0, 63, 63,
+            -16471, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
+            32, 32, 0, 32, 32, 32, 32, 32, 32, 32, 32, 32, 0, 0, 0, 0,
+            -16472, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            -30, -25, 0, 0, 0, -15, -22, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            -54, -48, -47, 0, -60, -64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            80, 80, 80, 80, 80, 80, 80, 80, 80, 80, 80, 80, 80, 80, 80, 80,
+            32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
+            32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0
+        },
+        {
+            1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0
+        },
+        {
+            0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48
+        },
+        {
+            48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48,
+            48, 48, 48, 48, 48, 48, 48, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, -16388, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0
+        },
+        {
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, -16389, -16390, -16391, -16392, -16393, -58, 0, 0, 0, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0
+        },
+        {
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+            1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, -8, -8, -8, -8, -8, -8, -8, -8,
+            0, 0, 0, 0, 0, 0, 0, 0, -8, -8, -8, -8, -8, -8, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, -8, -8, -8, -8, -8, -8, -8, -8,
+            0, 0, 0, 0, 0, 0, 0, 0, -8, -8, -8, -8, -8, -8, -8, -8
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, -8, -8, -8, -8, -8, -8, 0, 0,
+            -16394, 0, -16473, 0, -16474, 0, -16475, 0, 0, -8, 0, -8, 0, -8, 0, -8,
+            0, 0, 0, 0, 0, 0, 0, 0, -8, -8, -8, -8, -8, -8, -8, -8,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            -16395, -16396, -16397, -16398, -16399, -16400, -16401, -16402, -16403, -16404, -16405, -16406, -16407, -16408, -16409, -16410,
+            -16411, -16412, -16413, -16414, -16415, -16416, -16417, -16418, -16419, -16420, -16421, -16422, -16423, -16424, -16425, -16426,
+            -16427, -16428, -16429, -16430, -16431, -16432, -16433, -16434, -16435, -16436, -16437, -16438, -16439, -16440, -16441, -16442,
+            0, 0, -16443, -16444, -16445, 0, -16446, -16476, -8, -8, -74, -74, -16447, 0, -7173, 0
+        },
+        {
+            0, 0, -16448, -16449, -16450, 0, -16451, -16477, -86, -86, -86, -86, -16452, 0, 0, 0,
+            0, 0, -16478, -16479, 0, 0, -16453, -16480, -8, -8, -100, -100, 0, 0, 0, 0,
+            0, 0, -16481, -16482, -16454, 0, -16455, -16483, -8, -8, -112, -112, -7, 0, 0, 0,
+            0, 0, -16456, -16457, -16458, 0, -16459, -16484, -128, -128, -126, -126, -16460, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, -7517, 0, 0, 0, -8383, -8262, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26
+        },
+        {
+            26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            -16461, -16462, -16463, -16485, -16486, -16464, -16465, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, -16466, -16467, -16468, -16469, -16470, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        },
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
+            32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 0, 0, 0, 0, 0
+        },
+        {
+            40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+            40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+            40, 40, 40, 40, 40, 40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        }
+    };
+
+    static const int md_unicode_fold_multi[103][3] = {
+        { 0x0073, 0x0073, 0x0000 }, { 0x0069, 0x0307, 0x0000 }, { 0x02bc, 0x006e, 0x0000 }, { 0x006a, 0x030c, 0x0000 },
+        { 0x0565, 0x0582, 0x0000 }, { 0x0068, 0x0331, 0x0000 }, { 0x0074, 0x0308, 0x0000 }, { 0x0077, 0x030a, 0x0000 },
+        { 0x0079, 0x030a, 0x0000 }, { 0x0061, 0x02be, 0x0000 }, { 0x03c5, 0x0313, 0x0000 }, { 0x1f00, 0x03b9, 0x0000 },
+        { 0x1f01, 0x03b9, 0x0000 }, { 0x1f02, 0x03b9, 0x0000 }, { 0x1f03, 0x03b9, 0x0000 }, { 0x1f04, 0x03b9, 0x0000 },
+        { 0x1f05, 0x03b9, 0x0000 }, { 0x1f06, 0x03b9, 0x0000 }, { 0x1f07, 0x03b9, 0x0000 }, { 0x1f00, 0x03b9, 0x0000 },
+        { 0x1f01, 0x03b9, 0x0000 }, { 0x1f02, 0x03b9, 0x0000 }, { 0x1f03, 0x03b9, 0x0000 }, { 0x1f04, 0x03b9, 0x0000 },
+        { 0x1f05, 0x03b9, 0x0000 }, { 0x1f06, 0x03b9, 0x0000 }, { 0x1f07, 0x03b9, 0x0000 }, { 0x1f20, 0x03b9, 0x0000 },
+        { 0x1f21, 0x03b9, 0x0000 }, { 0x1f22, 0x03b9, 0x0000 }, { 0x1f23, 0x03b9, 0x0000 }, { 0x1f24, 0x03b9, 0x0000 },
+        { 0x1f25, 0x03b9, 0x0000 }, { 0x1f26, 0x03b9, 0x0000 }, { 0x1f27, 0x03b9, 0x0000 }, { 0x1f20, 0x03b9, 0x0000 },
+        { 0x1f21, 0x03b9, 0x0000 }, { 0x1f22, 0x03b9, 0x0000 }, { 0x1f23, 0x03b9, 0x0000 }, { 0x1f24, 0x03b9, 0x0000 },
+        { 0x1f25, 0x03b9, 0x0000 }, { 0x1f26, 0x03b9, 0x0000 }, { 0x1f27, 0x03b9, 0x0000 }, { 0x1f60, 0x03b9, 0x0000 },
+        { 0x1f61, 0x03b9, 0x0000 }, { 0x1f62, 0x03b9, 0x0000 }, { 0x1f63, 0x03b9, 0x0000 }, { 0x1f64, 0x03b9, 0x0000 },
+        { 0x1f65, 0x03b9, 0x0000 }, { 0x1f66, 0x03b9, 0x0000 }, { 0x1f67, 0x03b9, 0x0000 }, { 0x1f60, 0x03b9, 0x0000 },
+        { 0x1f61, 0x03b9, 0x0000 }, { 0x1f62, 0x03b9, 0x0000 }, { 0x1f63, 0x03b9, 0x0000 }, { 0x1f64, 0x03b9, 0x0000 },
+        { 0x1f65, 0x03b9, 0x0000 }, { 0x1f66, 0x03b9, 0x0000 }, { 0x1f67, 0x03b9, 0x0000 }, { 0x1f70, 0x03b9, 0x0000 },
+        { 0x03b1, 0x03b9, 0x0000 }, { 0x03ac, 0x03b9, 0x0000 }, { 0x03b1, 0x0342, 0x0000 }, { 0x03b1, 0x03b9, 0x0000 },
+        { 0x1f74, 0x03b9, 0x0000 }, { 0x03b7, 0x03b9, 0x0000 }, { 0x03ae, 0x03b9, 0x0000 }, { 0x03b7, 0x0342, 0x0000 },
+        { 0x03b7, 0x03b9, 0x0000 }, { 0x03b9, 0x0342, 0x0000 }, { 0x03c1, 0x0313, 0x0000 }, { 0x03c5, 0x0342, 0x0000 },
+        { 0x1f7c, 0x03b9, 0x0000 }, { 0x03c9, 0x03b9, 0x0000 }, { 0x03ce, 0x03b9, 0x0000 }, { 0x03c9, 0x0342, 0x0000 },
+        { 0x03c9, 0x03b9, 0x0000 }, { 0x0066, 0x0066, 0x0000 }, { 0x0066, 0x0069, 0x0000 }, { 0x0066, 0x006c, 0x0000 },
+        { 0x0073, 0x0074, 0x0000 }, { 0x0073, 0x0074, 0x0000 }, { 0x0574, 0x0576, 0x0000 }, { 0x0574, 0x0565, 0x0000 },
+        { 0x0574, 0x056b, 0x0000 }, { 0x057e, 0x0576, 0x0000 }, { 0x0574, 0x056d, 0x0000 }, { 0x03b9, 0x0308, 0x0301 },
+        { 0x03c5, 0x0308, 0x0301 }, { 0x03c5, 0x0313, 0x0300 }, { 0x03c5, 0x0313, 0x0301 }, { 0x03c5, 0x0313, 0x0342 },
+        { 0x03b1, 0x0342, 0x03b9 }, { 0x03b7, 0x0342, 0x03b9 }, { 0x03b9, 0x0308, 0x0300 }, { 0x03b9, 0x0308, 0x0301 },
+        { 0x03b9, 0x0308, 0x0342 }, { 0x03c5, 0x0308, 0x0300 }, { 0x03c5, 0x0308, 0x0301 }, { 0x03c5, 0x0308, 0x0342 },
+        { 0x03c9, 0x0342, 0x03b9 }, { 0x0066, 0x0066, 0x0069 }, { 0x0066, 0x0066, 0x006c }
+    };
+    /* END GENERATED */
 
     static int
     md_is_unicode_punct__(int codepoint)
     {
-        /* non-ASCII (above 127) Unicode punctuation codepoints (classes
-         * Pc, Pd, Pe, Pf, Pi, Po, Ps).
-         *
-         * Warning: Keep the array sorted.
-         */
-        static const int punct_list[] = {
-            0x00a1, 0x00a7, 0x00ab, 0x00b6, 0x00b7, 0x00bb, 0x00bf, 0x037e, 0x0387, 0x055a, 0x055b, 0x055c, 0x055d, 0x055e, 0x055f, 0x0589,
-            0x058a, 0x05be, 0x05c0, 0x05c3, 0x05c6, 0x05f3, 0x05f4, 0x0609, 0x060a, 0x060c, 0x060d, 0x061b, 0x061e, 0x061f, 0x066a, 0x066b,
-            0x066c, 0x066d, 0x06d4, 0x0700, 0x0701, 0x0702, 0x0703, 0x0704, 0x0705, 0x0706, 0x0707, 0x0708, 0x0709, 0x070a, 0x070b, 0x070c,
-            0x070d, 0x07f7, 0x07f8, 0x07f9, 0x0830, 0x0831, 0x0832, 0x0833, 0x0834, 0x0835, 0x0836, 0x0837, 0x0838, 0x0839, 0x083a, 0x083b,
-            0x083c, 0x083d, 0x083e, 0x085e, 0x0964, 0x0965, 0x0970, 0x0af0, 0x0df4, 0x0e4f, 0x0e5a, 0x0e5b, 0x0f04, 0x0f05, 0x0f06, 0x0f07,
-            0x0f08, 0x0f09, 0x0f0a, 0x0f0b, 0x0f0c, 0x0f0d, 0x0f0e, 0x0f0f, 0x0f10, 0x0f11, 0x0f12, 0x0f14, 0x0f3a, 0x0f3b, 0x0f3c, 0x0f3d,
-            0x0f85, 0x0fd0, 0x0fd1, 0x0fd2, 0x0fd3, 0x0fd4, 0x0fd9, 0x0fda, 0x104a, 0x104b, 0x104c, 0x104d, 0x104e, 0x104f, 0x10fb, 0x1360,
-            0x1361, 0x1362, 0x1363, 0x1364, 0x1365, 0x1366, 0x1367, 0x1368, 0x1400, 0x166d, 0x166e, 0x169b, 0x169c, 0x16eb, 0x16ec, 0x16ed,
-            0x1735, 0x1736, 0x17d4, 0x17d5, 0x17d6, 0x17d8, 0x17d9, 0x17da, 0x1800, 0x1801, 0x1802, 0x1803, 0x1804, 0x1805, 0x1806, 0x1807,
-            0x1808, 0x1809, 0x180a, 0x1944, 0x1945, 0x1a1e, 0x1a1f, 0x1aa0, 0x1aa1, 0x1aa2, 0x1aa3, 0x1aa4, 0x1aa5, 0x1aa6, 0x1aa8, 0x1aa9,
-            0x1aaa, 0x1aab, 0x1aac, 0x1aad, 0x1b5a, 0x1b5b, 0x1b5c, 0x1b5d, 0x1b5e, 0x1b5f, 0x1b60, 0x1bfc, 0x1bfd, 0x1bfe, 0x1bff, 0x1c3b,
-            0x1c3c, 0x1c3d, 0x1c3e, 0x1c3f, 0x1c7e, 0x1c7f, 0x1cc0, 0x1cc1, 0x1cc2, 0x1cc3, 0x1cc4, 0x1cc5, 0x1cc6, 0x1cc7, 0x1cd3, 0x2010,
-            0x2011, 0x2012, 0x2013, 0x2014, 0x2015, 0x2016, 0x2017, 0x2018, 0x2019, 0x201a, 0x201b, 0x201c, 0x201d, 0x201e, 0x201f, 0x2020,
-            0x2021, 0x2022, 0x2023, 0x2024, 0x2025, 0x2026, 0x2027, 0x2030, 0x2031, 0x2032, 0x2033, 0x2034, 0x2035, 0x2036, 0x2037, 0x2038,
-            0x2039, 0x203a, 0x203b, 0x203c, 0x203d, 0x203e, 0x203f, 0x2040, 0x2041, 0x2042, 0x2043, 0x2045, 0x2046, 0x2047, 0x2048, 0x2049,
-            0x204a, 0x204b, 0x204c, 0x204d, 0x204e, 0x204f, 0x2050, 0x2051, 0x2053, 0x2054, 0x2055, 0x2056, 0x2057, 0x2058, 0x2059, 0x205a,
-            0x205b, 0x205c, 0x205d, 0x205e, 0x207d, 0x207e, 0x208d, 0x208e, 0x2308, 0x2309, 0x230a, 0x230b, 0x2329, 0x232a, 0x2768, 0x2769,
-            0x276a, 0x276b, 0x276c, 0x276d, 0x276e, 0x276f, 0x2770, 0x2771, 0x2772, 0x2773, 0x2774, 0x2775, 0x27c5, 0x27c6, 0x27e6, 0x27e7,
-            0x27e8, 0x27e9, 0x27ea, 0x27eb, 0x27ec, 0x27ed, 0x27ee, 0x27ef, 0x2983, 0x2984, 0x2985, 0x2986, 0x2987, 0x2988, 0x2989, 0x298a,
-            0x298b, 0x298c, 0x298d, 0x298e, 0x298f, 0x2990, 0x2991, 0x2992, 0x2993, 0x2994, 0x2995, 0x2996, 0x2997, 0x2998, 0x29d8, 0x29d9,
-            0x29da, 0x29db, 0x29fc, 0x29fd, 0x2cf9, 0x2cfa, 0x2cfb, 0x2cfc, 0x2cfe, 0x2cff, 0x2d70, 0x2e00, 0x2e01, 0x2e02, 0x2e03, 0x2e04,
-            0x2e05, 0x2e06, 0x2e07, 0x2e08, 0x2e09, 0x2e0a, 0x2e0b, 0x2e0c, 0x2e0d, 0x2e0e, 0x2e0f, 0x2e10, 0x2e11, 0x2e12, 0x2e13, 0x2e14,
-            0x2e15, 0x2e16, 0x2e17, 0x2e18, 0x2e19, 0x2e1a, 0x2e1b, 0x2e1c, 0x2e1d, 0x2e1e, 0x2e1f, 0x2e20, 0x2e21, 0x2e22, 0x2e23, 0x2e24,
-            0x2e25, 0x2e26, 0x2e27, 0x2e28, 0x2e29, 0x2e2a, 0x2e2b, 0x2e2c, 0x2e2d, 0x2e2e, 0x2e30, 0x2e31, 0x2e32, 0x2e33, 0x2e34, 0x2e35,
-            0x2e36, 0x2e37, 0x2e38, 0x2e39, 0x2e3a, 0x2e3b, 0x2e3c, 0x2e3d, 0x2e3e, 0x2e3f, 0x2e40, 0x2e41, 0x2e42, 0x2e43, 0x2e44, 0x3001,
-            0x3002, 0x3003, 0x3008, 0x3009, 0x300a, 0x300b, 0x300c, 0x300d, 0x300e, 0x300f, 0x3010, 0x3011, 0x3014, 0x3015, 0x3016, 0x3017,
-            0x3018, 0x3019, 0x301a, 0x301b, 0x301c, 0x301d, 0x301e, 0x301f, 0x3030, 0x303d, 0x30a0, 0x30fb, 0xa4fe, 0xa4ff, 0xa60d, 0xa60e,
-            0xa60f, 0xa673, 0xa67e, 0xa6f2, 0xa6f3, 0xa6f4, 0xa6f5, 0xa6f6, 0xa6f7, 0xa874, 0xa875, 0xa876, 0xa877, 0xa8ce, 0xa8cf, 0xa8f8,
-            0xa8f9, 0xa8fa, 0xa8fc, 0xa92e, 0xa92f, 0xa95f, 0xa9c1, 0xa9c2, 0xa9c3, 0xa9c4, 0xa9c5, 0xa9c6, 0xa9c7, 0xa9c8, 0xa9c9, 0xa9ca,
-            0xa9cb, 0xa9cc, 0xa9cd, 0xa9de, 0xa9df, 0xaa5c, 0xaa5d, 0xaa5e, 0xaa5f, 0xaade, 0xaadf, 0xaaf0, 0xaaf1, 0xabeb, 0xfd3e, 0xfd3f,
-            0xfe10, 0xfe11, 0xfe12, 0xfe13, 0xfe14, 0xfe15, 0xfe16, 0xfe17, 0xfe18, 0xfe19, 0xfe30, 0xfe31, 0xfe32, 0xfe33, 0xfe34, 0xfe35,
-            0xfe36, 0xfe37, 0xfe38, 0xfe39, 0xfe3a, 0xfe3b, 0xfe3c, 0xfe3d, 0xfe3e, 0xfe3f, 0xfe40, 0xfe41, 0xfe42, 0xfe43, 0xfe44, 0xfe45,
-            0xfe46, 0xfe47, 0xfe48, 0xfe49, 0xfe4a, 0xfe4b, 0xfe4c, 0xfe4d, 0xfe4e, 0xfe4f, 0xfe50, 0xfe51, 0xfe52, 0xfe54, 0xfe55, 0xfe56,
-            0xfe57, 0xfe58, 0xfe59, 0xfe5a, 0xfe5b, 0xfe5c, 0xfe5d, 0xfe5e, 0xfe5f, 0xfe60, 0xfe61, 0xfe63, 0xfe68, 0xfe6a, 0xfe6b, 0xff01,
-            0xff02, 0xff03, 0xff05, 0xff06, 0xff07, 0xff08, 0xff09, 0xff0a, 0xff0c, 0xff0d, 0xff0e, 0xff0f, 0xff1a, 0xff1b, 0xff1f, 0xff20,
-            0xff3b, 0xff3c, 0xff3d, 0xff3f, 0xff5b, 0xff5d, 0xff5f, 0xff60, 0xff61, 0xff62, 0xff63, 0xff64, 0xff65, 0x10100, 0x10101, 0x10102,
-            0x1039f, 0x103d0, 0x1056f, 0x10857, 0x1091f, 0x1093f, 0x10a50, 0x10a51, 0x10a52, 0x10a53, 0x10a54, 0x10a55, 0x10a56, 0x10a57, 0x10a58, 0x10a7f,
-            0x10af0, 0x10af1, 0x10af2, 0x10af3, 0x10af4, 0x10af5, 0x10af6, 0x10b39, 0x10b3a, 0x10b3b, 0x10b3c, 0x10b3d, 0x10b3e, 0x10b3f, 0x10b99, 0x10b9a,
-            0x10b9b, 0x10b9c, 0x11047, 0x11048, 0x11049, 0x1104a, 0x1104b, 0x1104c, 0x1104d, 0x110bb, 0x110bc, 0x110be, 0x110bf, 0x110c0, 0x110c1, 0x11140,
-            0x11141, 0x11142, 0x11143, 0x11174, 0x11175, 0x111c5, 0x111c6, 0x111c7, 0x111c8, 0x111c9, 0x111cd, 0x111db, 0x111dd, 0x111de, 0x111df, 0x11238,
-            0x11239, 0x1123a, 0x1123b, 0x1123c, 0x1123d, 0x112a9, 0x1144b, 0x1144c, 0x1144d, 0x1144e, 0x1144f, 0x1145b, 0x1145d, 0x114c6, 0x115c1, 0x115c2,
-            0x115c3, 0x115c4, 0x115c5, 0x115c6, 0x115c7, 0x115c8, 0x115c9, 0x115ca, 0x115cb, 0x115cc, 0x115cd, 0x115ce, 0x115cf, 0x115d0, 0x115d1, 0x115d2,
-            0x115d3, 0x115d4, 0x115d5, 0x115d6, 0x115d7, 0x11641, 0x11642, 0x11643, 0x11660, 0x11661, 0x11662, 0x11663, 0x11664, 0x11665, 0x11666, 0x11667,
-            0x11668, 0x11669, 0x1166a, 0x1166b, 0x1166c, 0x1173c, 0x1173d, 0x1173e, 0x11c41, 0x11c42, 0x11c43, 0x11c44, 0x11c45, 0x11c70, 0x11c71, 0x12470,
-            0x12471, 0x12472, 0x12473, 0x12474, 0x16a6e, 0x16a6f, 0x16af5, 0x16b37, 0x16b38, 0x16b39, 0x16b3a, 0x16b3b, 0x16b44, 0x1bc9f, 0x1da87, 0x1da88,
-            0x1da89, 0x1da8a, 0x1da8b, 0x1e95e, 0x1e95f
-        };
+        unsigned block;
 
         /* The ASCII ones are the most frequently used ones, so lets check them first. */
         if(codepoint <= 0x7f)
             return ISPUNCT_(codepoint);
 
-        return (bsearch(&codepoint, punct_list, SIZEOF_ARRAY(punct_list), sizeof(int), md_unicode_cmp__) != NULL);
+        if(codepoint >= MD_UNICODE_TABLE_LIMIT)
+            return FALSE;
+
+        block = md_unicode_punct_stage1[codepoint >> MD_UNICODE_PUNCT_SHIFT];
+        codepoint &= (1 << MD_UNICODE_PUNCT_SHIFT) - 1;
+        return (md_unicode_punct_stage2[block][codepoint >> 3] >> (codepoint & 7)) & 1;
     }
 
     static void
     md_get_unicode_fold_info(int codepoint, MD_UNICODE_FOLD_INFO* info)
     {
-        /* This maps single codepoint within a range to a single codepoint
-         * within an offseted range. */
-        static const struct {
-            int min_codepoint;
-            int max_codepoint;
-            int offset;
-        } range_map[] = {
-            { 0x00c0, 0x00d6, 32 }, { 0x00d8, 0x00de, 32 }, { 0x0388, 0x038a, 37 }, { 0x0391, 0x03a1, 32 }, { 0x03a3, 0x03ab, 32 }, { 0x0400, 0x040f, 80 },
-            { 0x0410, 0x042f, 32 }, { 0x0531, 0x0556, 48 }, { 0x1f08, 0x1f0f, -8 }, { 0x1f18, 0x1f1d, -8 }, { 0x1f28, 0x1f2f, -8 }, { 0x1f38, 0x1f3f, -8 },
-            { 0x1f48, 0x1f4d, -8 }, { 0x1f68, 0x1f6f, -8 }, { 0x1fc8, 0x1fcb, -86 }, { 0x2160, 0x216f, 16 }, { 0x24b6, 0x24cf, 26 }, { 0xff21, 0xff3a, 32 },
-            { 0x10400, 0x10425, 40 }
-        };
-
-        /* This maps single codepoint to another single codepoint. */
-        static const struct {
-            int src_codepoint;
-            int dest_codepoint;
-        } single_map[] = {
-            { 0x00b5, 0x03bc }, { 0x0100, 0x0101 }, { 0x0102, 0x0103 }, { 0x0104, 0x0105 }, { 0x0106, 0x0107 }, { 0x0108, 0x0109 }, { 0x010a, 0x010b }, { 0x010c, 0x010d },
-            { 0x010e, 0x010f }, { 0x0110, 0x0111 }, { 0x0112, 0x0113 }, { 0x0114, 0x0115 }, { 0x0116, 0x0117 }, { 0x0118, 0x0119 }, { 0x011a, 0x011b }, { 0x011c, 0x011d },
-            { 0x011e, 0x011f }, { 0x0120, 0x0121 }, { 0x0122, 0x0123 }, { 0x0124, 0x0125 }, { 0x0126, 0x0127 }, { 0x0128, 0x0129 }, { 0x012a, 0x012b }, { 0x012c, 0x012d },
-            { 0x012e, 0x012f }, { 0x0132, 0x0133 }, { 0x0134, 0x0135 }, { 0x0136, 0x0137 }, { 0x0139, 0x013a }, { 0x013b, 0x013c }, { 0x013d, 0x013e }, { 0x013f, 0x0140 },
-            { 0x0141, 0x0142 }, { 0x0143, 0x0144 }, { 0x0145, 0x0146 }, { 0x0147, 0x0148 }, { 0x014a, 0x014b }, { 0x014c, 0x014d }, { 0x014e, 0x014f }, { 0x0150, 0x0151 },
-            { 0x0152, 0x0153 }, { 0x0154, 0x0155 }, { 0x0156, 0x0157 }, { 0x0158, 0x0159 }, { 0x015a, 0x015b }, { 0x015c, 0x015d }, { 0x015e, 0x015f }, { 0x0160, 0x0161 },
-            { 0x0162, 0x0163 }, { 0x0164, 0x0165 }, { 0x0166, 0x0167 }, { 0x0168, 0x0169 }, { 0x016a, 0x016b }, { 0x016c, 0x016d }, { 0x016e, 0x016f }, { 0x0170, 0x0171 },
-            { 0x0172, 0x0173 }, { 0x0174, 0x0175 }, { 0x0176, 0x0177 }, { 0x0178, 0x00ff }, { 0x0179, 0x017a }, { 0x017b, 0x017c }, { 0x017d, 0x017e }, { 0x017f, 0x0073 },
-            { 0x0181, 0x0253 }, { 0x0182, 0x0183 }, { 0x0184, 0x0185 }, { 0x0186, 0x0254 }, { 0x0187, 0x0188 }, { 0x0189, 0x0256 }, { 0x018a, 0x0257 }, { 0x018b, 0x018c },
-            { 0x018e, 0x01dd }, { 0x018f, 0x0259 }, { 0x0190, 0x025b }, { 0x0191, 0x0192 }, { 0x0193, 0x0260 }, { 0x0194, 0x0263 }, { 0x0196, 0x0269 }, { 0x0197, 0x0268 },
-            { 0x0198, 0x0199 }, { 0x019c, 0x026f }, { 0x019d, 0x0272 }, { 0x019f, 0x0275 }, { 0x01a0, 0x01a1 }, { 0x01a2, 0x01a3 }, { 0x01a4, 0x01a5 }, { 0x01a6, 0x0280 },
-            { 0x01a7, 0x01a8 }, { 0x01a9, 0x0283 }, { 0x01ac, 0x01ad }, { 0x01ae, 0x0288 }, { 0x01af, 0x01b0 }, { 0x01b1, 0x028a }, { 0x01b2, 0x028b }, { 0x01b3, 0x01b4 },
-            { 0x01b5, 0x01b6 }, { 0x01b7, 0x0292 }, { 0x01b8, 0x01b9 }, { 0x01bc, 0x01bd }, { 0x01c4, 0x01c6 }, { 0x01c5, 0x01c6 }, { 0x01c7, 0x01c9 }, { 0x01c8, 0x01c9 },
-            { 0x01ca, 0x01cc }, { 0x01cb, 0x01cc }, { 0x01cd, 0x01ce }, { 0x01cf, 0x01d0 }, { 0x01d1, 0x01d2 }, { 0x01d3, 0x01d4 }, { 0x01d5, 0x01d6 }, { 0x01d7, 0x01d8 },
-            { 0x01d9, 0x01da }, { 0x01db, 0x01dc }, { 0x01de, 0x01df }, { 0x01e0, 0x01e1 }, { 0x01e2, 0x01e3 }, { 0x01e4, 0x01e5 }, { 0x01e6, 0x01e7 }, { 0x01e8, 0x01e9 },
-            { 0x01ea, 0x01eb }, { 0x01ec, 0x01ed }, { 0x01ee, 0x01ef }, { 0x01f1, 0x01f3 }, { 0x01f2, 0x01f3 }, { 0x01f4, 0x01f5 }, { 0x01f6, 0x0195 }, { 0x01f7, 0x01bf },
-            { 0x01f8, 0x01f9 }, { 0x01fa, 0x01fb }, { 0x01fc, 0x01fd }, { 0x01fe, 0x01ff }, { 0x0200, 0x0201 }, { 0x0202, 0x0203 }, { 0x0204, 0x0205 }, { 0x0206, 0x0207 },
-            { 0x0208, 0x0209 }, { 0x020a, 0x020b }, { 0x020c, 0x020d }, { 0x020e, 0x020f }, { 0x0210, 0x0211 }, { 0x0212, 0x0213 }, { 0x0214, 0x0215 }, { 0x0216, 0x0217 },
-            { 0x0218, 0x0219 }, { 0x021a, 0x021b }, { 0x021c, 0x021d }, { 0x021e, 0x021f }, { 0x0220, 0x019e }, { 0x0222, 0x0223 }, { 0x0224, 0x0225 }, { 0x0226, 0x0227 },
-            { 0x0228, 0x0229 }, { 0x022a, 0x022b }, { 0x022c, 0x022d }, { 0x022e, 0x022f }, { 0x0230, 0x0231 }, { 0x0232, 0x0233 }, { 0x0345, 0x03b9 }, { 0x0386, 0x03ac },
-            { 0x038c, 0x03cc }, { 0x038e, 0x03cd }, { 0x038f, 0x03ce }, { 0x03c2, 0x03c3 }, { 0x03d0, 0x03b2 }, { 0x03d1, 0x03b8 }, { 0x03d5, 0x03c6 }, { 0x03d6, 0x03c0 },
-            { 0x03d8, 0x03d9 }, { 0x03da, 0x03db }, { 0x03dc, 0x03dd }, { 0x03de, 0x03df }, { 0x03e0, 0x03e1 }, { 0x03e2, 0x03e3 }, { 0x03e4, 0x03e5 }, { 0x03e6, 0x03e7 },
-            { 0x03e8, 0x03e9 }, { 0x03ea, 0x03eb }, { 0x03ec, 0x03ed }, { 0x03ee, 0x03ef }, { 0x03f0, 0x03ba }, { 0x03f1, 0x03c1 }, { 0x03f2, 0x03c3 }, { 0x03f4, 0x03b8 },
-            { 0x03f5, 0x03b5 }, { 0x0460, 0x0461 }, { 0x0462, 0x0463 }, { 0x0464, 0x0465 }, { 0x0466, 0x0467 }, { 0x0468, 0x0469 }, { 0x046a, 0x046b }, { 0x046c, 0x046d },
-            { 0x046e, 0x046f }, { 0x0470, 0x0471 }, { 0x0472, 0x0473 }, { 0x0474, 0x0475 }, { 0x0476, 0x0477 }, { 0x0478, 0x0479 }, { 0x047a, 0x047b }, { 0x047c, 0x047d },
-            { 0x047e, 0x047f }, { 0x0480, 0x0481 }, { 0x048a, 0x048b }, { 0x048c, 0x048d }, { 0x048e, 0x048f }, { 0x0490, 0x0491 }, { 0x0492, 0x0493 }, { 0x0494, 0x0495 },
-            { 0x0496, 0x0497 }, { 0x0498, 0x0499 }, { 0x049a, 0x049b }, { 0x049c, 0x049d }, { 0x049e, 0x049f }, { 0x04a0, 0x04a1 }, { 0x04a2, 0x04a3 }, { 0x04a4, 0x04a5 },
-            { 0x04a6, 0x04a7 }, { 0x04a8, 0x04a9 }, { 0x04aa, 0x04ab }, { 0x04ac, 0x04ad }, { 0x04ae, 0x04af }, { 0x04b0, 0x04b1 }, { 0x04b2, 0x04b3 }, { 0x04b4, 0x04b5 },
-            { 0x04b6, 0x04b7 }, { 0x04b8, 0x04b9 }, { 0x04ba, 0x04bb }, { 0x04bc, 0x04bd }, { 0x04be, 0x04bf }, { 0x04c1, 0x04c2 }, { 0x04c3, 0x04c4 }, { 0x04c5, 0x04c6 },
-            { 0x04c7, 0x04c8 }, { 0x04c9, 0x04ca }, { 0x04cb, 0x04cc }, { 0x04cd, 0x04ce }, { 0x04d0, 0x04d1 }, { 0x04d2, 0x04d3 }, { 0x04d4, 0x04d5 }, { 0x04d6, 0x04d7 },
-            { 0x04d8, 0x04d9 }, { 0x04da, 0x04db }, { 0x04dc, 0x04dd }, { 0x04de, 0x04df }, { 0x04e0, 0x04e1 }, { 0x04e2, 0x04e3 }, { 0x04e4, 0x04e5 }, { 0x04e6, 0x04e7 },
-            { 0x04e8, 0x04e9 }, { 0x04ea, 0x04eb }, { 0x04ec, 0x04ed }, { 0x04ee, 0x04ef }, { 0x04f0, 0x04f1 }, { 0x04f2, 0x04f3 }, { 0x04f4, 0x04f5 }, { 0x04f8, 0x04f9 },
-            { 0x0500, 0x0501 }, { 0x0502, 0x0503 }, { 0x0504, 0x0505 }, { 0x0506, 0x0507 }, { 0x0508, 0x0509 }, { 0x050a, 0x050b }, { 0x050c, 0x050d }, { 0x050e, 0x050f },
-            { 0x1e00, 0x1e01 }, { 0x1e02, 0x1e03 }, { 0x1e04, 0x1e05 }, { 0x1e06, 0x1e07 }, { 0x1e08, 0x1e09 }, { 0x1e0a, 0x1e0b }, { 0x1e0c, 0x1e0d }, { 0x1e0e, 0x1e0f },
-            { 0x1e10, 0x1e11 }, { 0x1e12, 0x1e13 }, { 0x1e14, 0x1e15 }, { 0x1e16, 0x1e17 }, { 0x1e18, 0x1e19 }, { 0x1e1a, 0x1e1b }, { 0x1e1c, 0x1e1d }, { 0x1e1e, 0x1e1f },
-            { 0x1e20, 0x1e21 }, { 0x1e22, 0x1e23 }, { 0x1e24, 0x1e25 }, { 0x1e26, 0x1e27 }, { 0x1e28, 0x1e29 }, { 0x1e2a, 0x1e2b }, { 0x1e2c, 0x1e2d }, { 0x1e2e, 0x1e2f },
-            { 0x1e30, 0x1e31 }, { 0x1e32, 0x1e33 }, { 0x1e34, 0x1e35 }, { 0x1e36, 0x1e37 }, { 0x1e38, 0x1e39 }, { 0x1e3a, 0x1e3b }, { 0x1e3c, 0x1e3d }, { 0x1e3e, 0x1e3f },
-            { 0x1e40, 0x1e41 }, { 0x1e42, 0x1e43 }, { 0x1e44, 0x1e45 }, { 0x1e46, 0x1e47 }, { 0x1e48, 0x1e49 }, { 0x1e4a, 0x1e4b }, { 0x1e4c, 0x1e4d }, { 0x1e4e, 0x1e4f },
-            { 0x1e50, 0x1e51 }, { 0x1e52, 0x1e53 }, { 0x1e54, 0x1e55 }, { 0x1e56, 0x1e57 }, { 0x1e58, 0x1e59 }, { 0x1e5a, 0x1e5b }, { 0x1e5c, 0x1e5d }, { 0x1e5e, 0x1e5f },
-            { 0x1e60, 0x1e61 }, { 0x1e62, 0x1e63 }, { 0x1e64, 0x1e65 }, { 0x1e66, 0x1e67 }, { 0x1e68, 0x1e69 }, { 0x1e6a, 0x1e6b }, { 0x1e6c, 0x1e6d }, { 0x1e6e, 0x1e6f },
-            { 0x1e70, 0x1e71 }, { 0x1e72, 0x1e73 }, { 0x1e74, 0x1e75 }, { 0x1e76, 0x1e77 }, { 0x1e78, 0x1e79 }, { 0x1e7a, 0x1e7b }, { 0x1e7c, 0x1e7d }, { 0x1e7e, 0x1e7f },
-            { 0x1e80, 0x1e81 }, { 0x1e82, 0x1e83 }, { 0x1e84, 0x1e85 }, { 0x1e86, 0x1e87 }, { 0x1e88, 0x1e89 }, { 0x1e8a, 0x1e8b }, { 0x1e8c, 0x1e8d }, { 0x1e8e, 0x1e8f },
-            { 0x1e90, 0x1e91 }, { 0x1e92, 0x1e93 }, { 0x1e94, 0x1e95 }, { 0x1e9b, 0x1e61 }, { 0x1ea0, 0x1ea1 }, { 0x1ea2, 0x1ea3 }, { 0x1ea4, 0x1ea5 }, { 0x1ea6, 0x1ea7 },
-            { 0x1ea8, 0x1ea9 }, { 0x1eaa, 0x1eab }, { 0x1eac, 0x1ead }, { 0x1eae, 0x1eaf }, { 0x1eb0, 0x1eb1 }, { 0x1eb2, 0x1eb3 }, { 0x1eb4, 0x1eb5 }, { 0x1eb6, 0x1eb7 },
-            { 0x1eb8, 0x1eb9 }, { 0x1eba, 0x1ebb }, { 0x1ebc, 0x1ebd }, { 0x1ebe, 0x1ebf }, { 0x1ec0, 0x1ec1 }, { 0x1ec2, 0x1ec3 }, { 0x1ec4, 0x1ec5 }, { 0x1ec6, 0x1ec7 },
-            { 0x1ec8, 0x1ec9 }, { 0x1eca, 0x1ecb }, { 0x1ecc, 0x1ecd }, { 0x1ece, 0x1ecf }, { 0x1ed0, 0x1ed1 }, { 0x1ed2, 0x1ed3 }, { 0x1ed4, 0x1ed5 }, { 0x1ed6, 0x1ed7 },
-            { 0x1ed8, 0x1ed9 }, { 0x1eda, 0x1edb }, { 0x1edc, 0x1edd }, { 0x1ede, 0x1edf }, { 0x1ee0, 0x1ee1 }, { 0x1ee2, 0x1ee3 }, { 0x1ee4, 0x1ee5 }, { 0x1ee6, 0x1ee7 },
-            { 0x1ee8, 0x1ee9 }, { 0x1eea, 0x1eeb }, { 0x1eec, 0x1eed }, { 0x1eee, 0x1eef }, { 0x1ef0, 0x1ef1 }, { 0x1ef2, 0x1ef3 }, { 0x1ef4, 0x1ef5 }, { 0x1ef6, 0x1ef7 },
-            { 0x1ef8, 0x1ef9 }, { 0x1f59, 0x1f51 }, { 0x1f5b, 0x1f53 }, { 0x1f5d, 0x1f55 }, { 0x1f5f, 0x1f57 }, { 0x1fb8, 0x1fb0 }, { 0x1fb9, 0x1fb1 }, { 0x1fba, 0x1f70 },
-            { 0x1fbb, 0x1f71 }, { 0x1fbe, 0x03b9 }, { 0x1fd8, 0x1fd0 }, { 0x1fd9, 0x1fd1 }, { 0x1fda, 0x1f76 }, { 0x1fdb, 0x1f77 }, { 0x1fe8, 0x1fe0 }, { 0x1fe9, 0x1fe1 },
-            { 0x1fea, 0x1f7a }, { 0x1feb, 0x1f7b }, { 0x1fec, 0x1fe5 }, { 0x1ff8, 0x1f78 }, { 0x1ff9, 0x1f79 }, { 0x1ffa, 0x1f7c }, { 0x1ffb, 0x1f7d }, { 0x2126, 0x03c9 },
-            { 0x212a, 0x006b }, { 0x212b, 0x00e5 },
-        };
-
-        /* This maps single codepoint to two codepoints. */
-        static const struct {
-            int src_codepoint;
-            int dest_codepoint0;
-            int dest_codepoint1;
-            int dest_codepoint2;
-        } double_map[] = {
-            { 0x00df, 0x0073, 0x0073 }, { 0x0130, 0x0069, 0x0307 }, { 0x0149, 0x02bc, 0x006e }, { 0x01f0, 0x006a, 0x030c }, { 0x0587, 0x0565, 0x0582 }, { 0x1e96, 0x0068, 0x0331 },
-            { 0x1e97, 0x0074, 0x0308 }, { 0x1e98, 0x0077, 0x030a }, { 0x1e99, 0x0079, 0x030a }, { 0x1e9a, 0x0061, 0x02be }, { 0x1f50, 0x03c5, 0x0313 }, { 0x1f80, 0x1f00, 0x03b9 },
-            { 0x1f81, 0x1f01, 0x03b9 }, { 0x1f82, 0x1f02, 0x03b9 }, { 0x1f83, 0x1f03, 0x03b9 }, { 0x1f84, 0x1f04, 0x03b9 }, { 0x1f85, 0x1f05, 0x03b9 }, { 0x1f86, 0x1f06, 0x03b9 },
-            { 0x1f87, 0x1f07, 0x03b9 }, { 0x1f88, 0x1f00, 0x03b9 }, { 0x1f89, 0x1f01, 0x03b9 }, { 0x1f8a, 0x1f02, 0x03b9 }, { 0x1f8b, 0x1f03, 0x03b9 }, { 0x1f8c, 0x1f04, 0x03b9 },
-            { 0x1f8d, 0x1f05, 0x03b9 }, { 0x1f8e, 0x1f06, 0x03b9 }, { 0x1f8f, 0x1f07, 0x03b9 }, { 0x1f90, 0x1f20, 0x03b9 }, { 0x1f91, 0x1f21, 0x03b9 }, { 0x1f92, 0x1f22, 0x03b9 },
-            { 0x1f93, 0x1f23, 0x03b9 }, { 0x1f94, 0x1f24, 0x03b9 }, { 0x1f95, 0x1f25, 0x03b9 }, { 0x1f96, 0x1f26, 0x03b9 }, { 0x1f97, 0x1f27, 0x03b9 }, { 0x1f98, 0x1f20, 0x03b9 },
-            { 0x1f99, 0x1f21, 0x03b9 }, { 0x1f9a, 0x1f22, 0x03b9 }, { 0x1f9b, 0x1f23, 0x03b9 }, { 0x1f9c, 0x1f24, 0x03b9 }, { 0x1f9d, 0x1f25, 0x03b9 }, { 0x1f9e, 0x1f26, 0x03b9 },
-            { 0x1f9f, 0x1f27, 0x03b9 }, { 0x1fa0, 0x1f60, 0x03b9 }, { 0x1fa1, 0x1f61, 0x03b9 }, { 0x1fa2, 0x1f62, 0x03b9 }, { 0x1fa3, 0x1f63, 0x03b9 }, { 0x1fa4, 0x1f64, 0x03b9 },
-            { 0x1fa5, 0x1f65, 0x03b9 }, { 0x1fa6, 0x1f66, 0x03b9 }, { 0x1fa7, 0x1f67, 0x03b9 }, { 0x1fa8, 0x1f60, 0x03b9 }, { 0x1fa9, 0x1f61, 0x03b9 }, { 0x1faa, 0x1f62, 0x03b9 },
-            { 0x1fab, 0x1f63, 0x03b9 }, { 0x1fac, 0x1f64, 0x03b9 }, { 0x1fad, 0x1f65, 0x03b9 }, { 0x1fae, 0x1f66, 0x03b9 }, { 0x1faf, 0x1f67, 0x03b9 }, { 0x1fb2, 0x1f70, 0x03b9 },
-            { 0x1fb3, 0x03b1, 0x03b9 }, { 0x1fb4, 0x03ac, 0x03b9 }, { 0x1fb6, 0x03b1, 0x0342 }, { 0x1fbc, 0x03b1, 0x03b9 }, { 0x1fc2, 0x1f74, 0x03b9 }, { 0x1fc3, 0x03b7, 0x03b9 },
-            { 0x1fc4, 0x03ae, 0x03b9 }, { 0x1fc6, 0x03b7, 0x0342 }, { 0x1fcc, 0x03b7, 0x03b9 }, { 0x1fd6, 0x03b9, 0x0342 }, { 0x1fe4, 0x03c1, 0x0313 }, { 0x1fe6, 0x03c5, 0x0342 },
-            { 0x1ff2, 0x1f7c, 0x03b9 }, { 0x1ff3, 0x03c9, 0x03b9 }, { 0x1ff4, 0x03ce, 0x03b9 }, { 0x1ff6, 0x03c9, 0x0342 }, { 0x1ffc, 0x03c9, 0x03b9 }, { 0xfb00, 0x0066, 0x0066 },
-            { 0xfb01, 0x0066, 0x0069 }, { 0xfb02, 0x0066, 0x006c }, { 0xfb05, 0x0073, 0x0074 }, { 0xfb06, 0x0073, 0x0074 }, { 0xfb13, 0x0574, 0x0576 }, { 0xfb14, 0x0574, 0x0565 },
-            { 0xfb15, 0x0574, 0x056b }, { 0xfb16, 0x057e, 0x0576 }, { 0xfb17, 0x0574, 0x056d }
-        };
-
-        /* This maps single codepoint to three codepoints. */
-        static const struct {
-            int src_codepoint;
-            int dest_codepoint0;
-            int dest_codepoint1;
-            int dest_codepoint2;
-        } triple_map[] = {
-            { 0x0390, 0x03b9, 0x0308, 0x0301 }, { 0x03b0, 0x03c5, 0x0308, 0x0301 }, { 0x1f52, 0x03c5, 0x0313, 0x0300 }, { 0x1f54, 0x03c5, 0x0313, 0x0301 },
-            { 0x1f56, 0x03c5, 0x0313, 0x0342 }, { 0x1fb7, 0x03b1, 0x0342, 0x03b9 }, { 0x1fc7, 0x03b7, 0x0342, 0x03b9 }, { 0x1fd2, 0x03b9, 0x0308, 0x0300 },
-            { 0x1fd3, 0x03b9, 0x0308, 0x0301 }, { 0x1fd7, 0x03b9, 0x0308, 0x0342 }, { 0x1fe2, 0x03c5, 0x0308, 0x0300 }, { 0x1fe3, 0x03c5, 0x0308, 0x0301 },
-            { 0x1fe7, 0x03c5, 0x0308, 0x0342 }, { 0x1ff7, 0x03c9, 0x0342, 0x03b9 }, { 0xfb03, 0x0066, 0x0066, 0x0069 }, { 0xfb04, 0x0066, 0x0066, 0x006c }
-        };
-
-        int i;
+        int value;
 
         /* Fast path for ASCII characters. */
         if(codepoint <= 0x7f) {
@@ -645,43 +1252,28 @@ struct MD_UNICODE_FOLD_INFO_tag {
             return;
         }
 
-        for(i = 0; i < SIZEOF_ARRAY(range_map); i++) {
-            if(range_map[i].min_codepoint <= codepoint && codepoint <= range_map[i].max_codepoint) {
-                info->codepoints[0] = codepoint + range_map[i].offset;
-                info->n_codepoints = 1;
-                return;
-            }
-        }
-
-        for(i = 0; i < SIZEOF_ARRAY(single_map); i++) {
-            if(codepoint == single_map[i].src_codepoint) {
-                info->codepoints[0] = single_map[i].dest_codepoint;
-                info->n_codepoints = 1;
-                return;
-            }
+        if(codepoint >= MD_UNICODE_TABLE_LIMIT) {
+            info->codepoints[0] = codepoint;
+            info->n_codepoints = 1;
+            return;
         }
 
-        for(i = 0; i < SIZEOF_ARRAY(double_map); i++) {
-            if(codepoint == double_map[i].src_codepoint) {
-                info->codepoints[0] = double_map[i].dest_codepoint0;
-                info->codepoints[1] = double_map[i].dest_codepoint1;
-                info->n_codepoints = 2;
-                return;
-            }
-        }
+        /* The value is either a delta to the (single) folded codepoint (zero
+         * if the codepoint folds to itself), or it refers to the table of
+         * foldings into two or three codepoints. */
+        value = md_unicode_fold_stage2[md_unicode_fold_stage1[codepoint >> MD_UNICODE_FOLD_SHIFT]]
+                                      [codepoint & ((1 << MD_UNICODE_FOLD_SHIFT) - 1)];
+        if(value > MD_UNICODE_FOLD_MULTI) {
+            info->codepoints[0] = codepoint + value;
+            info->n_codepoints = 1;
+        } else {
+            const int* multi = md_unicode_fold_multi[MD_UNICODE_FOLD_MULTI - value];
 
-        for(i = 0; i < SIZEOF_ARRAY(triple_map); i++) {
-            if(codepoint == triple_map[i].src_codepoint) {
-                info->codepoints[0] = triple_map[i].dest_codepoint0;
-                info->codepoints[1] = triple_map[i].dest_codepoint1;
-                info->codepoints[2] = triple_map[i].dest_codepoint2;
-                info->n_codepoints = 3;
-                return;
-            }
+            info->codepoints[0] = multi[0];
+            info->codepoints[1] = multi[1];
+            info->codepoints[2] = multi[2];
+            info->n_codepoints = (multi[2] != 0 ? 3 : 2);
         }
-
-        info->codepoints[0] = codepoint;
-        info->n_codepoints = 1;
     }
 #endif
 
@@ -840,6 +1432,27 @@ struct MD_UNICODE_FOLD_INFO_tag {
  ***  Helper string manipulations  ***
  *************************************/
 
+/* Find the index of the line containing the offset 'off' (or, if it lies
+ * between lines, of the following one). It is a binary search as paragraphs
+ * may have very many lines. */
+static SZ
+md_lookup_line(OFF off, const MD_LINE* lines, SZ n_lines)
+{
+    SZ lo = 0;
+    SZ hi = n_lines;
+
+    while(lo < hi) {
+        SZ pivot = lo + (hi - lo) / 2;
+
+        if(off < lines[pivot].end)
+            hi = pivot;
+        else
+            lo = pivot + 1;
+    }
+
+    return lo;
+}
+
 /* Fill buffer with copy of the string between 'beg' and 'end' but replace any
  * line breaks with given replacement character.
  *
@@ -888,7 +1501,7 @@ md_merge_lines_alloc(MD_CTX* ctx, OFF beg, OFF end, const MD_LINE* lines, int n_
 {
     CHAR* buffer;
 
-    buffer = (CHAR*) malloc(sizeof(CHAR) * (end - beg));
+    buffer = (CHAR*) md_malloc(ctx, sizeof(CHAR) * (end - beg));
     if(buffer == NULL) {
         MD_LOG("malloc() failed.");
         return -1;
@@ -1332,10 +1945,12 @@ md_is_entity(MD_CTX* ctx, OFF beg, OFF max_end, OFF* p_end)
 
 typedef struct MD_ATTRIBUTE_BUILD_tag MD_ATTRIBUTE_BUILD;
 struct MD_ATTRIBUTE_BUILD_tag {
+    CHAR* text;
     MD_TEXTTYPE* substr_types;
     OFF* substr_offsets;
     int substr_count;
     int substr_alloc;
+    OFF trivial_offsets[2];
 };
 
 
@@ -1348,25 +1963,29 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
     if(build->substr_count >= build->substr_alloc) {
         MD_TEXTTYPE* new_substr_types;
         OFF* new_substr_offsets;
+        int new_substr_alloc = (build->substr_alloc == 0 ? 8 : build->substr_alloc * 2);
 
-        build->substr_alloc = (build->substr_alloc == 0 ? 8 : build->substr_alloc * 2);
-
-        new_substr_types = (MD_TEXTTYPE*) realloc(build->substr_types,
-                                    (build->substr_alloc+1) * sizeof(MD_TEXTTYPE));
+        /* Note the offsets array needs one extra slot for the terminating
+         * offset (see MD_ATTRIBUTE::substr_offsets). */
+        new_substr_types = (MD_TEXTTYPE*) md_realloc(ctx, build->substr_types,
+                                    build->substr_alloc * sizeof(MD_TEXTTYPE),
+                                    new_substr_alloc * sizeof(MD_TEXTTYPE));
         if(new_substr_types == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
         }
-        new_substr_offsets = (OFF*) realloc(build->substr_offsets,
-                                    build->substr_alloc * sizeof(OFF));
+        build->substr_types = new_substr_types;
+
+        new_substr_offsets = (OFF*) md_realloc(ctx, build->substr_offsets,
+                                    (build->substr_alloc > 0 ? build->substr_alloc+1 : 0) * sizeof(OFF),
+                                    (new_substr_alloc+1) * sizeof(OFF));
         if(new_substr_offsets == NULL) {
             MD_LOG("realloc() failed.");
-            free(new_substr_types);
             return -1;
         }
-
-        build->substr_types = new_substr_types;
         build->substr_offsets = new_substr_offsets;
+
+        build->substr_alloc = new_substr_alloc;
     }
 
     build->substr_types[build->substr_count] = type;
@@ -1375,39 +1994,91 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
     return 0;
 }
 
+/* Check whether the raw text of an attribute has no backslash escape and no
+ * entity, i.e. whether it is the attribute text as it is, made of a single
+ * MD_TEXT_NORMAL substring. */
+static int
+md_is_trivial_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size, unsigned flags)
+{
+    OFF off;
+
+    for(off = 0; off < raw_size; off++) {
+        if(raw_text[off] == _T('&')) {
+            OFF ent_end;
+
+            if(md_is_entity_str(ctx, raw_text, off, raw_size, &ent_end))
+                return FALSE;
+        } else if(raw_text[off] == _T('\\')  &&  !(flags & MD_BUILD_ATTR_NO_ESCAPES)  &&
+                  off+1 < raw_size  &&
+                  (ISPUNCT_(raw_text[off+1]) || ISNEWLINE_(raw_text[off+1]))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+md_free_attribute(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build)
+{
+    md_free(ctx, build->text);
+    md_free(ctx, build->substr_types);
+    md_free(ctx, build->substr_offsets);
+}
+
+/* Build the attribute from its raw text. In the common case of no escapes
+ * and no entities (see md_is_trivial_attribute()), the attribute refers
+ * directly to the raw text and nothing is allocated. Otherwise the text (with
+ * the escapes resolved) and the substring arrays are allocated.
+ *
+ * Either way, 'build' has to live as long as the attribute, and it has to be
+ * passed to md_free_attribute() afterwards (even if this function fails). */
 static int
 md_build_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size,
-                   unsigned flags, MD_ATTRIBUTE* attr)
+                   unsigned flags, MD_ATTRIBUTE* attr, MD_ATTRIBUTE_BUILD* build)
 {
-    MD_ATTRIBUTE_BUILD build = {0};
+    static const MD_TEXTTYPE trivial_types[] = { MD_TEXT_NORMAL };
     CHAR* text;
     OFF raw_off = 0;
     OFF off = 0;
     int ret = 0;
 
+    memset(build, 0, sizeof(MD_ATTRIBUTE_BUILD));
+
     if(raw_size == 0) {
-        static const MD_TEXTTYPE empty_types[] = { MD_TEXT_NORMAL };
         static const OFF empty_offsets[] = { 0, 0 };
 
         attr->text = NULL;
         attr->size = 0;
-        attr->substr_types = empty_types;
+        attr->substr_types = trivial_types;
         attr->substr_offsets = empty_offsets;
         return 0;
     }
 
-    text = (CHAR*) malloc(raw_size * sizeof(CHAR));
+    if(md_is_trivial_attribute(ctx, raw_text, raw_size, flags)) {
+        build->trivial_offsets[0] = 0;
+        build->trivial_offsets[1] = raw_size;
+
+        attr->text = raw_text;
+        attr->size = raw_size;
+        attr->substr_types = trivial_types;
+        attr->substr_offsets = build->trivial_offsets;
+        return 0;
+    }
+
+    text = (CHAR*) md_malloc(ctx, raw_size * sizeof(CHAR));
     if(text == NULL) {
         MD_LOG("malloc() failed.");
         goto abort;
     }
+    build->text = text;
 
     while(raw_off < raw_size) {
         if(raw_text[raw_off] == _T('&')) {
             OFF ent_end;
 
             if(md_is_entity_str(ctx, raw_text, raw_off, raw_size, &ent_end)) {
-                MD_CHECK(md_build_attr_append_substr(ctx, &build, MD_TEXT_ENTITY, off));
+                MD_CHECK(md_build_attr_append_substr(ctx, build, MD_TEXT_ENTITY, off));
                 memcpy(text + off, raw_text + raw_off, ent_end - raw_off);
                 off += ent_end - raw_off;
                 raw_off = ent_end;
@@ -1415,8 +2086,8 @@ md_build_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size,
             }
         }
 
-        if(build.substr_count == 0  ||  build.substr_types[build.substr_count-1] != MD_TEXT_NORMAL)
-            MD_CHECK(md_build_attr_append_substr(ctx, &build, MD_TEXT_NORMAL, off));
+        if(build->substr_count == 0  ||  build->substr_types[build->substr_count-1] != MD_TEXT_NORMAL)
+            MD_CHECK(md_build_attr_append_substr(ctx, build, MD_TEXT_NORMAL, off));
 
         if(!(flags & MD_BUILD_ATTR_NO_ESCAPES)  &&
            raw_text[raw_off] == _T('\\')  &&  raw_off+1 < raw_size  &&
@@ -1425,31 +2096,20 @@ md_build_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size,
 
         text[off++] = raw_text[raw_off++];
     }
-    build.substr_offsets[build.substr_count] = off;
+    build->substr_offsets[build->substr_count] = off;
 
     attr->text = text;
     attr->size = off;
-    attr->substr_offsets = build.substr_offsets;
-    attr->substr_types = build.substr_types;
+    attr->substr_offsets = build->substr_offsets;
+    attr->substr_types = build->substr_types;
     return 0;
 
 abort:
-    free(text);
-    free(build.substr_offsets);
-    free(build.substr_types);
+    md_free_attribute(ctx, build);
+    memset(build, 0, sizeof(MD_ATTRIBUTE_BUILD));
     return -1;
 }
 
-static void
-md_free_attribute(MD_CTX* ctx, MD_ATTRIBUTE* attr)
-{
-    if(attr->size > 0) {
-        free((void*) attr->text);
-        free((void*) attr->substr_types);
-        free((void*) attr->substr_offsets);
-    }
-}
-
 
 /***************************
  ***  Recognizing Links  ***
@@ -1460,12 +2120,12 @@ md_free_attribute(MD_CTX* ctx, MD_ATTRIBUTE* attr)
  */
 
 struct MD_LINK_REF_DEF_tag {
-    CHAR* label;
+    OFF label_off;          /* Normalized label, in MD_CTX::ref_def_labels. */
+    SZ label_len;
+    unsigned label_hash;
     CHAR* title;
-    SZ label_size                   : 24;
-    unsigned label_needs_free       :  1;
-    unsigned title_needs_free       :  1;
     SZ title_size;
+    int title_needs_free;
     OFF dest_beg;
     OFF dest_end;
 };
@@ -1542,7 +2202,8 @@ md_is_link_label(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg,
 
         line_index++;
         len++;
-        off = lines[line_index].beg;
+        if(line_index < n_lines)
+            off = lines[line_index].beg;
     }
 
     return FALSE;
@@ -1632,13 +2293,16 @@ md_is_link_destination(MD_CTX* ctx, OFF beg, OFF max_end, OFF* p_end,
             md_is_link_destination_B(ctx, beg, max_end, p_end, p_contents_beg, p_contents_end));
 }
 
+/* If 'fail_cache' is not NULL, it is ctx->link_title_fail. (The titles then
+ * have to be looked for always up to the end of the same block.) */
 static int
 md_is_link_title(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg,
                  OFF* p_end, int* p_beg_line_index, int* p_end_line_index,
-                 OFF* p_contents_beg, OFF* p_contents_end)
+                 OFF* p_contents_beg, OFF* p_contents_end, OFF* fail_cache)
 {
     OFF off = beg;
     CHAR closer_char;
+    int closer_kind;
     SZ line_index = 0;
 
     /* Optional white space with up to one line break. */
@@ -1655,13 +2319,18 @@ md_is_link_title(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg,
 
     /* First char determines how to detect end of it. */
     switch(CH(off)) {
-        case _T('"'):   closer_char = _T('"'); break;
-        case _T('\''):  closer_char = _T('\''); break;
-        case _T('('):   closer_char = _T(')'); break;
+        case _T('"'):   closer_char = _T('"'); closer_kind = 0; break;
+        case _T('\''):  closer_char = _T('\''); closer_kind = 1; break;
+        case _T('('):   closer_char = _T(')'); closer_kind = 2; break;
         default:        return FALSE;
     }
     off++;
 
+    /* The title cannot start with the second char of a backslash escape, so
+     * the scan below would see the same (no) closers as the failed one. */
+    if(fail_cache != NULL  &&  off >= fail_cache[closer_kind])
+        return FALSE;
+
     *p_contents_beg = off;
 
     while(line_index < n_lines) {
@@ -1684,9 +2353,210 @@ md_is_link_title(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg,
         line_index++;
     }
 
+    if(fail_cache != NULL)
+        fail_cache[closer_kind] = *p_contents_beg;
     return FALSE;
 }
 
+/* Link labels are matched case-insensitively (using Unicode case folding)
+ * and with any whitespace collapsed. To make the matching cheap, we normalize
+ * each label just once into a sequence of case-folded codepoints, with any
+ * leading and trailing whitespace stripped and any inner whitespace sequence
+ * replaced with a single space.
+ *
+ * Link labels are limited to 999 characters, and each character may fold
+ * into at most 3 codepoints. Anything longer cannot match any definition.
+ */
+#define MD_LINK_LABEL_NORMALIZED_MAX    (3 * 999)
+
+static int
+md_link_label_normalize(const CHAR* label, SZ size, int* buffer)
+{
+    OFF off = 0;
+    int n = 0;
+    int pending_space = FALSE;
+
+    while(off < size) {
+        int codepoint;
+        SZ char_size;
+        MD_UNICODE_FOLD_INFO fold_info;
+        int i;
+
+        /* Fast path for ASCII. */
+        if(ISASCII_(label[off])) {
+            codepoint = label[off];
+            char_size = 1;
+        } else {
+            codepoint = md_decode_unicode(label, off, size, &char_size);
+        }
+        off += char_size;
+
+        if(ISUNICODEWHITESPACE_(codepoint)  ||  ISNEWLINE_(codepoint)) {
+            pending_space = (n > 0);
+            continue;
+        }
+
+        if(ISASCII_(codepoint)) {
+            fold_info.codepoints[0] = (ISUPPER_(codepoint) ? codepoint + ('a' - 'A') : codepoint);
+            fold_info.n_codepoints = 1;
+        } else {
+            md_get_unicode_fold_info(codepoint, &fold_info);
+        }
+
+        if(n + pending_space + (int) fold_info.n_codepoints > MD_LINK_LABEL_NORMALIZED_MAX)
+            return -1;
+
+        if(pending_space) {
+            buffer[n++] = _T(' ');
+            pending_space = FALSE;
+        }
+
+        for(i = 0; i < (int) fold_info.n_codepoints; i++)
+            buffer[n++] = fold_info.codepoints[i];
+    }
+
+    return n;
+}
+
+/* FNV-1a hash of the normalized label. */
+static unsigned
+md_link_label_hash(const int* label, int len)
+{
+    unsigned hash = 2166136261U;
+    int i;
+
+    for(i = 0; i < len; i++) {
+        hash ^= (unsigned) label[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/* Finds the definition with the given normalized label, or returns -1. */
+static int
+md_find_link_ref_def(MD_CTX* ctx, const int* label, int len, unsigned hash)
+{
+    unsigned mask = ctx->alloc_ref_def_hashtable - 1;
+    unsigned slot;
+
+    if(ctx->alloc_ref_def_hashtable == 0)
+        return -1;
+
+    for(slot = hash & mask; ctx->ref_def_hashtable[slot] >= 0; slot = (slot + 1) & mask) {
+        MD_LINK_REF_DEF* def = &ctx->link_ref_defs[ctx->ref_def_hashtable[slot]];
+
+        if(def->label_hash == hash  &&  def->label_len == len  &&
+           memcmp(ctx->ref_def_labels + def->label_off, label, len * sizeof(int)) == 0)
+            return ctx->ref_def_hashtable[slot];
+    }
+
+    return -1;
+}
+
+static void
+md_insert_link_ref_def(MD_CTX* ctx, int def_index)
+{
+    unsigned mask = ctx->alloc_ref_def_hashtable - 1;
+    unsigned slot = ctx->link_ref_defs[def_index].label_hash & mask;
+
+    while(ctx->ref_def_hashtable[slot] >= 0)
+        slot = (slot + 1) & mask;
+    ctx->ref_def_hashtable[slot] = def_index;
+}
+
+/* Appends a new (zeroed) definition. */
+static MD_LINK_REF_DEF*
+md_push_link_ref_def(MD_CTX* ctx)
+{
+    MD_LINK_REF_DEF* def;
+
+    if(ctx->n_link_ref_defs >= ctx->alloc_link_ref_defs) {
+        MD_LINK_REF_DEF* new_defs;
+        int new_alloc = (ctx->alloc_link_ref_defs > 0 ? ctx->alloc_link_ref_defs * 2 : 16);
+
+        new_defs = (MD_LINK_REF_DEF*) md_realloc(ctx, ctx->link_ref_defs,
+                    ctx->alloc_link_ref_defs * sizeof(MD_LINK_REF_DEF),
+                    new_alloc * sizeof(MD_LINK_REF_DEF));
+        if(new_defs == NULL) {
+            MD_LOG("realloc() failed.");
+            return NULL;
+        }
+
+        ctx->link_ref_defs = new_defs;
+        ctx->alloc_link_ref_defs = new_alloc;
+    }
+
+    def = &ctx->link_ref_defs[ctx->n_link_ref_defs];
+    ctx->n_link_ref_defs++;
+    memset(def, 0, sizeof(MD_LINK_REF_DEF));
+    return def;
+}
+
+/* Stores the normalized label of the (just added) last definition and
+ * registers it in the hash table. If there already is a definition with the
+ * same label, the new one is not registered as the first one takes
+ * precedence. */
+static int
+md_register_link_ref_def(MD_CTX* ctx, const int* label, int len)
+{
+    int def_index = ctx->n_link_ref_defs - 1;
+    MD_LINK_REF_DEF* def = &ctx->link_ref_defs[def_index];
+    unsigned hash = md_link_label_hash(label, len);
+
+    if(md_find_link_ref_def(ctx, label, len, hash) >= 0)
+        return 0;
+
+    /* Store the label. */
+    if(ctx->n_ref_def_labels + len > ctx->alloc_ref_def_labels) {
+        int* new_labels;
+        int new_alloc = (ctx->alloc_ref_def_labels > 0 ? ctx->alloc_ref_def_labels * 2 : 1024);
+
+        while(new_alloc < ctx->n_ref_def_labels + len)
+            new_alloc *= 2;
+        new_labels = (int*) md_realloc(ctx, ctx->ref_def_labels,
+                    ctx->alloc_ref_def_labels * sizeof(int), new_alloc * sizeof(int));
+        if(new_labels == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        ctx->ref_def_labels = new_labels;
+        ctx->alloc_ref_def_labels = new_alloc;
+    }
+    memcpy(ctx->ref_def_labels + ctx->n_ref_def_labels, label, len * sizeof(int));
+    def->label_off = ctx->n_ref_def_labels;
+    def->label_len = len;
+    def->label_hash = hash;
+    ctx->n_ref_def_labels += len;
+
+    /* Keep the hash table at most half full. */
+    if(2 * (def_index + 1) > ctx->alloc_ref_def_hashtable) {
+        int* new_hashtable;
+        int new_alloc = (ctx->alloc_ref_def_hashtable > 0 ? ctx->alloc_ref_def_hashtable * 2 : 64);
+        int i;
+
+        new_hashtable = (int*) md_malloc(ctx, new_alloc * sizeof(int));
+        if(new_hashtable == NULL) {
+            MD_LOG("malloc() failed.");
+            return -1;
+        }
+        md_free(ctx, ctx->ref_def_hashtable);
+        ctx->ref_def_hashtable = new_hashtable;
+        ctx->alloc_ref_def_hashtable = new_alloc;
+
+        /* Rehash all the (registered) definitions. */
+        memset(ctx->ref_def_hashtable, 0xff, new_alloc * sizeof(int));
+        for(i = 0; i < def_index; i++) {
+            if(ctx->link_ref_defs[i].label_len > 0)
+                md_insert_link_ref_def(ctx, i);
+        }
+    }
+
+    md_insert_link_ref_def(ctx, def_index);
+    return 0;
+}
+
 /* Returns 0 if it is not a link reference definition.
  *
  * Returns N > 0 if it is not a link reference definition (then N corresponds
@@ -1709,9 +2579,13 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
     int title_contents_line_index;
     int title_is_multiline;
     OFF off;
-    SZ line_index = 0;
-    SZ tmp_line_index;
+    int line_index = 0;
+    int tmp_line_index;
     MD_LINK_REF_DEF* def;
+    CHAR* label;
+    SZ label_size;
+    int label_buffer[MD_LINK_LABEL_NORMALIZED_MAX];
+    int label_len;
     int ret = 0;
 
     /* Link label. */
@@ -1745,7 +2619,7 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
      * more follows on its last line. */
     if(md_is_link_title(ctx, lines + line_index, n_lines - line_index, off,
                 &off, &title_contents_line_index, &tmp_line_index,
-                &title_contents_beg, &title_contents_end)
+                &title_contents_beg, &title_contents_end, NULL)
         &&  off >= lines[line_index + tmp_line_index].end)
     {
         title_is_multiline = (tmp_line_index != title_contents_line_index);
@@ -1763,45 +2637,37 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
     if(off < lines[line_index].end)
         return FALSE;
 
-    /* Store the link reference definition. */
-    if(ctx->n_link_ref_defs >= ctx->alloc_link_ref_defs) {
-        MD_LINK_REF_DEF* new_defs;
-
-        ctx->alloc_link_ref_defs = (ctx->alloc_link_ref_defs > 0 ? ctx->alloc_link_ref_defs * 2 : 16);
-        new_defs = (MD_LINK_REF_DEF*) realloc(ctx->link_ref_defs, ctx->alloc_link_ref_defs * sizeof(MD_LINK_REF_DEF));
-        if(new_defs == NULL) {
-            MD_LOG("realloc() failed.");
-            ret = -1;
-            goto abort;
-        }
-
-        ctx->link_ref_defs = new_defs;
-    }
-
-    def = &ctx->link_ref_defs[ctx->n_link_ref_defs];
-    ctx->n_link_ref_defs++;
-    memset(def, 0, sizeof(MD_LINK_REF_DEF));
-
     if(!label_is_multiline) {
-        def->label = (CHAR*) STR(label_contents_beg);
-        def->label_size = label_contents_end - label_contents_beg;
+        label = (CHAR*) STR(label_contents_beg);
+        label_size = label_contents_end - label_contents_beg;
     } else {
-        SZ label_size;
-
         MD_CHECK(md_merge_lines_alloc(ctx, label_contents_beg, label_contents_end,
                     lines + label_contents_line_index, n_lines - label_contents_line_index,
-                    _T(' '), &def->label, &label_size));
-        def->label_size = label_size;
-        def->label_needs_free = TRUE;
+                    _T(' '), &label, &label_size));
+    }
+
+    label_len = md_link_label_normalize(label, label_size, label_buffer);
+    if(label_is_multiline)
+        md_free(ctx, label);
+    if(label_len <= 0)
+        return FALSE;
+
+    /* Store the link reference definition. */
+    def = md_push_link_ref_def(ctx);
+    if(def == NULL) {
+        ret = -1;
+        goto abort;
     }
 
+    MD_CHECK(md_register_link_ref_def(ctx, label_buffer, label_len));
+
     def->dest_beg = dest_contents_beg;
     def->dest_end = dest_contents_end;
 
     if(title_contents_beg >= title_contents_end) {
         def->title = NULL;
         def->title_size = 0;
-    } else if(!title_is_multiline) {
+    } else if(!title_is_multiline  &&  !ctx->text_is_volatile) {
         def->title = (CHAR*) STR(title_contents_beg);
         def->title_size = title_contents_end - title_contents_beg;
     } else {
@@ -1811,107 +2677,38 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
         def->title_needs_free = TRUE;
     }
 
+    MD_STAT_ADD(n_link_ref_defs, 1);
     ret = line_index + 1;
 
 abort:
     return ret;
 }
 
-static OFF
-md_skip_unicode_whitespace(const CHAR* label, OFF off, SZ size)
-{
-    SZ char_size;
-    int codepoint;
-
-    while(off < size) {
-        codepoint = md_decode_unicode(label, off, size, &char_size);
-        if(!ISUNICODEWHITESPACE_(codepoint)  &&  !ISNEWLINE_(label[off]))
-            break;
-        off += char_size;
-    }
-
-    return off;
-}
-
 static int
-md_link_label_eq(const CHAR* a_label, SZ a_size, const CHAR* b_label, SZ b_size)
+md_lookup_link_ref_def(MD_CTX* ctx, const CHAR* label, SZ label_size, MD_LINK_REF_DEF** p_def)
 {
-    OFF a_off;
-    OFF b_off;
-
-    /* Fast path: Most real-life reference labels are using exact match. */
-    if(a_size == b_size  &&  memcmp(a_label, b_label, a_size * sizeof(CHAR)) == 0)
-        return TRUE;
-
-    /* The slow path, with Unicode case folding and Unicode whitespace collapsing. */
-    a_off = md_skip_unicode_whitespace(a_label, 0, a_size);
-    b_off = md_skip_unicode_whitespace(b_label, 0, b_size);
-    while(a_off < a_size  ||  b_off < b_size) {
-        int a_codepoint, b_codepoint;
-        SZ a_char_size, b_char_size;
-        int a_is_whitespace, b_is_whitespace;
-
-        if(a_off < a_size) {
-            a_codepoint = md_decode_unicode(a_label, a_off, a_size, &a_char_size);
-            a_is_whitespace = ISUNICODEWHITESPACE_(a_codepoint) || ISNEWLINE_(a_label[a_off]);
-        } else {
-            /* Treat end of label as a whitespace. */
-            a_codepoint = -1;
-            a_is_whitespace = TRUE;
-        }
-
-        if(b_off < b_size) {
-            b_codepoint = md_decode_unicode(b_label, b_off, b_size, &b_char_size);
-            b_is_whitespace = ISUNICODEWHITESPACE_(b_codepoint) || ISNEWLINE_(b_label[b_off]);
-        } else {
-            /* Treat end of label as a whitespace. */
-            b_codepoint = -1;
-            b_is_whitespace = TRUE;
-        }
-
-        if(a_is_whitespace || b_is_whitespace) {
-            if(!a_is_whitespace || !b_is_whitespace)
-                return FALSE;
+    int label_buffer[MD_LINK_LABEL_NORMALIZED_MAX];
+    int label_len;
+    int def_index;
 
-            a_off = md_skip_unicode_whitespace(a_label, a_off, a_size);
-            b_off = md_skip_unicode_whitespace(b_label, b_off, b_size);
-        } else {
-            MD_UNICODE_FOLD_INFO a_fold_info, b_fold_info;
+    *p_def = NULL;
 
-            md_get_unicode_fold_info(a_codepoint, &a_fold_info);
-            md_get_unicode_fold_info(b_codepoint, &b_fold_info);
+    if(ctx->n_link_ref_defs == 0)
+        return FALSE;
 
-            if(a_fold_info.n_codepoints != b_fold_info.n_codepoints)
-                return FALSE;
-            if(memcmp(a_fold_info.codepoints, b_fold_info.codepoints, a_fold_info.n_codepoints * sizeof(int)) != 0)
-                return FALSE;
+    label_len = md_link_label_normalize(label, label_size, label_buffer);
+    if(label_len <= 0)
+        return FALSE;
 
-            a_off += a_char_size;
-            b_off += b_char_size;
-        }
-    }
+    def_index = md_find_link_ref_def(ctx, label_buffer, label_len,
+                    md_link_label_hash(label_buffer, label_len));
+    if(def_index < 0)
+        return FALSE;
 
+    *p_def = &ctx->link_ref_defs[def_index];
     return TRUE;
 }
 
-static int
-md_lookup_link_ref_def(MD_CTX* ctx, const CHAR* label, SZ label_size, MD_LINK_REF_DEF** p_def)
-{
-    int i;
-
-    for(i = 0; i < ctx->n_link_ref_defs; i++) {
-        MD_LINK_REF_DEF* def = &ctx->link_ref_defs[i];
-
-        if(md_link_label_eq(def->label, def->label_size, label, label_size)) {
-            *p_def = def;
-            return TRUE;
-        }
-    }
-
-    *p_def = NULL;
-    return FALSE;
-}
-
 static int
 md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
                      OFF beg, OFF end, MD_LINK_ATTR* attr)
@@ -1931,9 +2728,7 @@ md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
 
     /* Find lines corresponding to the beg and end positions. */
     MD_ASSERT(lines[0].beg <= beg);
-    beg_line = lines;
-    while(beg >= beg_line->end)
-        beg_line++;
+    beg_line = lines + md_lookup_line(beg, lines, n_lines);
 
     MD_ASSERT(end <= lines[n_lines-1].end);
     end_line = beg_line;
@@ -1958,7 +2753,7 @@ md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
     }
 
     if(beg_line != end_line)
-        free(label);
+        md_free(ctx, label);
 
 abort:
     return ret;
@@ -1968,8 +2763,8 @@ static int
 md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
                        OFF beg, OFF* p_end, MD_LINK_ATTR* attr)
 {
-    SZ line_index = 0;
-    SZ tmp_line_index;
+    SZ line_index;
+    int tmp_line_index;
     OFF title_contents_beg;
     OFF title_contents_end;
     int title_contents_line_index;
@@ -1977,8 +2772,7 @@ md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
     OFF off = beg;
     int ret = FALSE;
 
-    while(off >= lines[line_index].end)
-        line_index++;
+    line_index = md_lookup_line(off, lines, n_lines);
 
     MD_ASSERT(CH(off) == _T('('));
     off++;
@@ -1986,7 +2780,7 @@ md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
     /* Optional white space with up to one line break. */
     while(off < lines[line_index].end  &&  ISWHITESPACE(off))
         off++;
-    if(off >= lines[line_index].end  &&  ISNEWLINE(off)) {
+    if(off >= lines[line_index].end) {
         line_index++;
         if(line_index >= n_lines)
             return FALSE;
@@ -2003,7 +2797,7 @@ md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
     /* (Optional) title. */
     if(md_is_link_title(ctx, lines + line_index, n_lines - line_index, off,
                 &off, &title_contents_line_index, &tmp_line_index,
-                &title_contents_beg, &title_contents_end))
+                &title_contents_beg, &title_contents_end, ctx->link_title_fail))
     {
         title_is_multiline = (tmp_line_index != title_contents_line_index);
         title_contents_line_index += line_index;
@@ -2019,13 +2813,13 @@ md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
     /* Optional whitespace followed with final ')'. */
     while(off < lines[line_index].end  &&  ISWHITESPACE(off))
         off++;
-    if(off >= lines[line_index].end  &&  ISNEWLINE(off)) {
+    if(off >= lines[line_index].end) {
         line_index++;
         if(line_index >= n_lines)
             return FALSE;
         off = lines[line_index].beg;
     }
-    if(CH(off) != _T(')'))
+    if(off >= lines[line_index].end  ||  CH(off) != _T(')'))
         goto abort;
     off++;
 
@@ -2059,13 +2853,16 @@ md_free_link_ref_defs(MD_CTX* ctx)
     for(i = 0; i < ctx->n_link_ref_defs; i++) {
         MD_LINK_REF_DEF* def = &ctx->link_ref_defs[i];
 
-        if(def->label_needs_free)
-            free(def->label);
         if(def->title_needs_free)
-            free(def->title);
+            md_free(ctx, def->title);
     }
 
-    free(ctx->link_ref_defs);
+    /* Note we keep the arrays themselves so they can be reused by a
+     * subsequent parsing (see MD_PARSER). */
+    if(ctx->n_link_ref_defs > 0  &&  ctx->ref_def_hashtable != NULL)
+        memset(ctx->ref_def_hashtable, 0xff, ctx->alloc_ref_def_hashtable * sizeof(int));
+    ctx->n_link_ref_defs = 0;
+    ctx->n_ref_def_labels = 0;
 }
 
 
@@ -2142,10 +2939,19 @@ struct MD_MARK_tag {
      * During resolving, we disconnect from the chain and point to the
      * corresponding counterpart so opener points to its closer and vice versa.
      */
+#ifdef MD4C_USE_64BIT_OFFSETS
+    /* The block may be large enough to hold more marks then 24 bits can
+     * index. The struct is padded to 32 bytes anyway. */
+    int prev;
+    int next;
+    int ch      : 8;    /* Only ASCII chars can form a mark. */
+    int flags   : 8;
+#else
     int prev    : 24;
     int ch      : 8;    /* Only ASCII chars can form a mark. */
     int next    : 24;
     int flags   : 8;
+#endif
 };
 
 /* Mark flags (these apply to ALL mark types). */
@@ -2166,15 +2972,18 @@ md_push_mark(MD_CTX* ctx)
 {
     if(ctx->n_marks >= ctx->alloc_marks) {
         MD_MARK* new_marks;
+        int new_alloc = (ctx->alloc_marks > 0 ? ctx->alloc_marks * 2 : 64);
 
-        ctx->alloc_marks = (ctx->alloc_marks > 0 ? ctx->alloc_marks * 2 : 64);
-        new_marks = realloc(ctx->marks, ctx->alloc_marks * sizeof(MD_MARK));
+        new_marks = md_realloc(ctx, ctx->marks, ctx->alloc_marks * sizeof(MD_MARK),
+                               new_alloc * sizeof(MD_MARK));
         if(new_marks == NULL) {
             MD_LOG("realloc() failed.");
             return NULL;
         }
 
         ctx->marks = new_marks;
+        ctx->alloc_marks = new_alloc;
+        MD_STAT_ADD(marks.n_reallocs, 1);
     }
 
     return &ctx->marks[ctx->n_marks++];
@@ -2198,6 +3007,8 @@ md_push_mark(MD_CTX* ctx)
             mark->next = -1;                                            \
             mark->ch = (char)(ch_);                                     \
             mark->flags = (flags_);                                     \
+            if(((flags_) & MD_MARK_RESOLVED)  &&  (ch_) != 127)         \
+                MD_STAT_ADD(n_resolved_marks, 1);                       \
         } while(0)
 
 
@@ -2213,6 +3024,77 @@ md_mark_chain_append(MD_CTX* ctx, MD_MARKCHAIN* chain, int mark_index)
     chain->tail = mark_index;
 }
 
+/* Index of the chain of emphasis openers the opener belongs to. */
+static inline int
+md_emph_chain_index(const MD_MARK* mark)
+{
+    int index = EMPH_OPENERS_FIRST;
+
+    if(mark->ch == _T('_'))
+        index += 6;
+    if(mark->flags & MD_MARK_INTRAWORD)
+        index += 3;
+    return index + (int)((mark->end - mark->beg) % 3);
+}
+
+static inline MD_MARKCHAIN*
+md_emph_chain(MD_CTX* ctx, int mark_index)
+{
+    return &ctx->mark_chains[md_emph_chain_index(&ctx->marks[mark_index])];
+}
+
+static void
+md_reset_emph_chains(MD_CTX* ctx)
+{
+    int i;
+
+    for(i = EMPH_OPENERS_FIRST; i < EMPH_OPENERS_FIRST + EMPH_OPENERS_COUNT; i++) {
+        ctx->mark_chains[i].head = -1;
+        ctx->mark_chains[i].tail = -1;
+    }
+}
+
+static void
+md_backtick_opener_append(MD_CTX* ctx, int mark_index)
+{
+    MD_MARK* mark = &ctx->marks[mark_index];
+
+    md_mark_chain_append(ctx, &BACKTICK_OPENERS, mark_index);
+    ctx->backtick_openers[mark->end - mark->beg] = mark_index;
+}
+
+/* Forget the opener in ctx->backtick_openers (but not in the chain).
+ *
+ * If the opener has lost its first backtick to a backslash escape, it may
+ * have shadowed an older opener of the same length. md_analyze_backtick()
+ * then remembers the older one in the backslash mark, so we can restore it.
+ */
+static inline void
+md_backtick_opener_forget(MD_CTX* ctx, int mark_index)
+{
+    MD_MARK* mark = &ctx->marks[mark_index];
+    int shadowed_index = -1;
+
+    if(ctx->backtick_openers[mark->end - mark->beg] != mark_index)
+        return;
+
+    if(mark_index > 0  &&  (mark-1)->ch == '\\'  &&  (mark-1)->beg == mark->beg - 2)
+        shadowed_index = (mark-1)->next;
+    ctx->backtick_openers[mark->end - mark->beg] = shadowed_index;
+}
+
+static void
+md_reset_backtick_openers(MD_CTX* ctx)
+{
+    int mark_index;
+
+    for(mark_index = BACKTICK_OPENERS.tail; mark_index >= 0; mark_index = ctx->marks[mark_index].prev)
+        md_backtick_opener_forget(ctx, mark_index);
+
+    BACKTICK_OPENERS.head = -1;
+    BACKTICK_OPENERS.tail = -1;
+}
+
 /* Sometimes, we need to store a pointer into the mark. It is quite rare
  * so we do not bother to make MD_MARK use union, and it can only happen
  * for dummy marks. */
@@ -2256,6 +3138,8 @@ md_resolve_range(MD_CTX* ctx, MD_MARKCHAIN* chain, int opener_index, int closer_
             chain->tail = opener->prev;
     }
 
+    MD_STAT_ADD(n_resolved_marks, 2);
+
     /* Interconnect opener and closer and mark both as resolved. */
     opener->next = closer_index;
     opener->flags |= MD_MARK_OPENER | MD_MARK_RESOLVED;
@@ -2288,13 +3172,18 @@ md_rollback(MD_CTX* ctx, int opener_index, int closer_index, int how)
     int i;
     int mark_index;
 
+    MD_STAT_ADD(n_rollbacks, 1);
+
     /* Cut all unresolved openers at the mark index. 
      * (start at 1 to not touch PTR_CHAIN.) */
     for(i = 1; i < SIZEOF_ARRAY(ctx->mark_chains); i++) {
         MD_MARKCHAIN* chain = &ctx->mark_chains[i];
 
-        while(chain->tail >= opener_index)
+        while(chain->tail >= opener_index) {
+            if(chain == &BACKTICK_OPENERS)
+                md_backtick_opener_forget(ctx, chain->tail);
             chain->tail = ctx->marks[chain->tail].prev;
+        }
 
         if(chain->tail >= 0)
             ctx->marks[chain->tail].next = -1;
@@ -2321,13 +3210,16 @@ md_rollback(MD_CTX* ctx, int opener_index, int closer_index, int how)
                 mark_opener->flags &= ~(MD_MARK_OPENER | MD_MARK_CLOSER | MD_MARK_RESOLVED | MD_MARK_LEAF);
 
                 switch(mark_opener->ch) {
-                    case '*':   chain = &ASTERISK_OPENERS; break;
-                    case '_':   chain = &UNDERSCORE_OPENERS; break;
+                    case '*':   /* Pass through. */
+                    case '_':   chain = md_emph_chain(ctx, mark_opener_index); break;
                     case '`':   chain = &BACKTICK_OPENERS; break;
                     case '<':   chain = &LOWERTHEN_OPENERS; break;
                     default:    MD_UNREACHABLE(); break;
                 }
-                md_mark_chain_append(ctx, chain, mark_opener_index);
+                if(chain == &BACKTICK_OPENERS)
+                    md_backtick_opener_append(ctx, mark_opener_index);
+                else
+                    md_mark_chain_append(ctx, chain, mark_opener_index);
 
                 discard_flag = 1;
             }
@@ -2367,14 +3259,20 @@ md_rollback(MD_CTX* ctx, int opener_index, int closer_index, int how)
     }
 }
 
-/* Split a longer mark into two. The new mark takes the given count of characters.
- * May only be called if a dummy 'D' mark follows.
+/* Split a longer mark into two. The new mark takes the given count of trailing
+ * characters and it is stored in place of the dummy 'D' mark dummy_index.
+ *
+ * Each char of the mark run but the first one has its own dummy mark following
+ * the mark. Closers are split from the start (the rest is analyzed as a mark of
+ * its own later), so the new mark takes the dummy right after the closer and
+ * the following dummies remain for it. Openers are split from the end, so the
+ * split-off part takes the last dummy of the opener.
  */
 static int
-md_split_mark(MD_CTX* ctx, int mark_index, SZ n)
+md_split_mark(MD_CTX* ctx, int mark_index, int dummy_index, SZ n)
 {
     MD_MARK* mark = &ctx->marks[mark_index];
-    MD_MARK* dummy = &ctx->marks[mark_index + 1];
+    MD_MARK* dummy = &ctx->marks[dummy_index];
 
     MD_ASSERT(mark->end - mark->beg > n);
     MD_ASSERT(dummy->ch == 'D');
@@ -2383,7 +3281,7 @@ md_split_mark(MD_CTX* ctx, int mark_index, SZ n)
     mark->end -= n;
     dummy->beg = mark->end;
 
-    return mark_index + 1;
+    return dummy_index;
 }
 
 static void
@@ -2418,28 +3316,153 @@ md_build_mark_char_map(MD_CTX* ctx)
                 ctx->mark_char_map[i] = 1;
         }
     }
+
+#ifdef MD4C_SIMD_X86
+    {
+        int i;
+
+        memset(ctx->mark_nibble_map, 0, sizeof(ctx->mark_nibble_map));
+        for(i = 0; i < sizeof(ctx->mark_char_map); i++) {
+            if(ctx->mark_char_map[i])
+                ctx->mark_nibble_map[i & 0xf] |= (1 << (i >> 4));
+        }
+    }
+#endif
 }
 
-static int
-md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
+/* Find the first mark char in the range <off, end). Returns end if there is
+ * none. */
+static OFF
+md_scan_marks_scalar(MD_CTX* ctx, OFF off, OFF end)
 {
-    SZ i;
-    int ret = 0;
-    MD_MARK* mark;
+    while(off < end) {
+        CHAR ch = CH(off);
+        if(ch < sizeof(ctx->mark_char_map)  &&  ctx->mark_char_map[(int) ch])
+            break;
+        off++;
+    }
+    return off;
+}
 
-    for(i = 0; i < n_lines; i++) {
-        const MD_LINE* line = &lines[i];
-        OFF off = line->beg;
-        OFF line_end = line->end;
+#ifdef MD4C_SIMD_X86
+/* The vectorized variants classify 16 (or 32) chars at once: Each char is
+ * split to its low and high nibble, each used as an index into a 16-byte
+ * lookup table (PSHUFB). The low nibble picks the set of high nibbles (as a
+ * bitmask) forming a mark char; the high nibble picks its own bit. Note that
+ * non-ASCII bytes (high nibble >= 8) map to an empty bitmask, so they are
+ * skipped just like in md_scan_marks_scalar(). */
+static const unsigned char md_nibble_bit[16] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+    0, 0, 0, 0, 0, 0, 0, 0
+};
 
-        while(off < line_end) {
-            CHAR ch = CH(off);
+__attribute__((target("ssse3")))
+static OFF
+md_scan_marks_ssse3(MD_CTX* ctx, OFF off, OFF end)
+{
+    const __m128i lo_map = _mm_loadu_si128((const __m128i*) ctx->mark_nibble_map);
+    const __m128i hi_map = _mm_loadu_si128((const __m128i*) md_nibble_bit);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
 
-            /* Optimization: Fast path. */
-            if(ch >= sizeof(ctx->mark_char_map)  ||  !ctx->mark_char_map[(int) ch]) {
-                off++;
-                continue;
-            }
+    while(off + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) STR(off));
+        __m128i lo = _mm_and_si128(v, nibble_mask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask);
+        __m128i hits = _mm_and_si128(_mm_shuffle_epi8(lo_map, lo), _mm_shuffle_epi8(hi_map, hi));
+        unsigned bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(hits, zero)) & 0xffff;
+
+        if(bits != 0)
+            return off + __builtin_ctz(bits);
+        off += 16;
+    }
+
+    return md_scan_marks_scalar(ctx, off, end);
+}
+
+__attribute__((target("avx2")))
+static OFF
+md_scan_marks_avx2(MD_CTX* ctx, OFF off, OFF end)
+{
+    const __m256i lo_map = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) ctx->mark_nibble_map));
+    const __m256i hi_map = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) md_nibble_bit));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    while(off + 32 <= end) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) STR(off));
+        __m256i lo = _mm256_and_si256(v, nibble_mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble_mask);
+        __m256i hits = _mm256_and_si256(_mm256_shuffle_epi8(lo_map, lo), _mm256_shuffle_epi8(hi_map, hi));
+        unsigned bits = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hits, zero));
+
+        if(bits != 0)
+            return off + __builtin_ctz(bits);
+        off += 32;
+    }
+
+    /* Note we do not fall back to md_scan_marks_ssse3() here: Mixing the
+     * AVX and (legacy-encoded) SSE instructions is expensive. */
+    if(off + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) STR(off));
+        __m128i lo = _mm_and_si128(v, _mm256_castsi256_si128(nibble_mask));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm256_castsi256_si128(nibble_mask));
+        __m128i hits = _mm_and_si128(_mm_shuffle_epi8(_mm256_castsi256_si128(lo_map), lo),
+                                     _mm_shuffle_epi8(_mm256_castsi256_si128(hi_map), hi));
+        unsigned bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(hits, _mm_setzero_si128())) & 0xffff;
+
+        if(bits != 0)
+            return off + __builtin_ctz(bits);
+        off += 16;
+    }
+
+    return md_scan_marks_scalar(ctx, off, end);
+}
+#endif  /* MD4C_SIMD_X86 */
+
+static void
+md_setup_mark_scanner(MD_CTX* ctx)
+{
+    ctx->scan_marks = md_scan_marks_scalar;
+
+#ifdef MD4C_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        ctx->scan_marks = md_scan_marks_avx2;
+    else if(__builtin_cpu_supports("ssse3"))
+        ctx->scan_marks = md_scan_marks_ssse3;
+#endif
+}
+
+/* Flags the specialized functions may test. Each of them is instantiated
+ * generic (reading the flags from ctx->r.flags), and for few common flag sets
+ * as compile-time constants. (See md_setup_specialized().) */
+#define MD_SPEC_MASK            (MD_FLAG_COLLAPSEWHITESPACE | MD_FLAG_PERMISSIVEATXHEADERS | \
+                                 MD_FLAG_PERMISSIVEAUTOLINKS | MD_FLAG_NOINDENTEDCODEBLOCKS | \
+                                 MD_FLAG_NOHTML | MD_FLAG_TABLES)
+#define MD_SPEC_COMMONMARK      0
+#define MD_SPEC_GITHUB          (MD_FLAG_TABLES | MD_FLAG_PERMISSIVEAUTOLINKS)
+
+MD_FORCEINLINE int
+md_collect_marks_(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, unsigned flags)
+{
+    SZ i;
+    int ret = 0;
+    MD_MARK* mark;
+
+    for(i = 0; i < n_lines; i++) {
+        const MD_LINE* line = &lines[i];
+        OFF off = line->beg;
+        OFF line_end = line->end;
+
+        while(off < line_end) {
+            CHAR ch;
+
+            /* Optimization: Fast path skipping anything not interesting. */
+            off = ctx->scan_marks(ctx, off, line_end);
+            if(off >= line_end)
+                break;
+            ch = CH(off);
 
             /* A backslash escape.
              * It can go beyond line->end as it may involve escaped new
@@ -2464,7 +3487,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                 OFF tmp = off+1;
                 int left_level;     /* What precedes: 0 = whitespace; 1 = punctuation; 2 = other char. */
                 int right_level;    /* What follows: 0 = whitespace; 1 = punctuation; 2 = other char. */
-                unsigned flags = 0;
+                unsigned mark_flags = 0;
 
                 while(tmp < line_end  &&  CH(tmp) == ch)
                     tmp++;
@@ -2490,14 +3513,14 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                 }
 
                 if(left_level > 0  &&  left_level >= right_level)
-                    flags |= MD_MARK_POTENTIAL_CLOSER;
+                    mark_flags |= MD_MARK_POTENTIAL_CLOSER;
                 if(right_level > 0  &&  right_level >= left_level)
-                    flags |= MD_MARK_POTENTIAL_OPENER;
+                    mark_flags |= MD_MARK_POTENTIAL_OPENER;
                 if(left_level == 2  &&  right_level == 2)
-                    flags |= MD_MARK_INTRAWORD;
+                    mark_flags |= MD_MARK_INTRAWORD;
 
-                if(flags != 0) {
-                    PUSH_MARK(ch, off, tmp, flags);
+                if(mark_flags != 0) {
+                    PUSH_MARK(ch, off, tmp, mark_flags);
 
                     /* During resolving, multiple asterisks may have to be
                      * split into independent span start/ends. Consider e.g.
@@ -2525,7 +3548,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                 /* We limit code span marks to lower then 256 backticks. This
                  * solves a pathologic case of too many openers, each of
                  * different length: Their resolving is then O(n^2). */
-                if(tmp - off < 256)
+                if(tmp - off < CODESPAN_MARK_MAXLEN)
                     PUSH_MARK(ch, off, tmp, MD_MARK_POTENTIAL_OPENER | MD_MARK_POTENTIAL_CLOSER);
 
                 off = tmp;
@@ -2551,7 +3574,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
 
             /* A potential autolink or raw HTML start/end. */
             if(ch == _T('<') || ch == _T('>')) {
-                if(!(ctx->r.flags & MD_FLAG_NOHTMLSPANS))
+                if(!(flags & MD_FLAG_NOHTMLSPANS))
                     PUSH_MARK(ch, off, off+1, (ch == _T('<') ? MD_MARK_POTENTIAL_OPENER : MD_MARK_POTENTIAL_CLOSER));
 
                 off++;
@@ -2576,7 +3599,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
             }
 
             /* A potential permissive URL autolink. */
-            if(ch == _T(':')) {
+            if((flags & MD_FLAG_PERMISSIVEURLAUTOLINKS)  &&  ch == _T(':')) {
                 static struct {
                     const CHAR* scheme;
                     SZ scheme_size;
@@ -2614,7 +3637,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
             }
 
             /* A potential permissive e-mail autolink. */
-            if(ch == _T('@')) {
+            if((flags & MD_FLAG_PERMISSIVEEMAILAUTOLINKS)  &&  ch == _T('@')) {
                 if(line->beg + 1 <= off  &&  ISALNUM(off-1)  &&
                     off + 3 < line->end  &&  ISALNUM(off+1))
                 {
@@ -2628,7 +3651,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
             }
 
             /* Turn non-trivial whitespace into single space. */
-            if(ISWHITESPACE_(ch)) {
+            if((flags & MD_FLAG_COLLAPSEWHITESPACE)  &&  ISWHITESPACE_(ch)) {
                 OFF tmp = off+1;
 
                 while(tmp < line_end  &&  ISWHITESPACE(tmp))
@@ -2652,6 +3675,9 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
         }
     }
 
+    MD_STAT_ADD(n_marks, ctx->n_marks);
+    MD_STAT_PEAK(marks, (ctx->n_marks + 1) * sizeof(MD_MARK));
+
     /* Add a dummy mark after the end of processed block to simplify
      * md_process_inlines(). */
     PUSH_MARK(127, ctx->size+1, ctx->size+1, MD_MARK_RESOLVED);
@@ -2660,43 +3686,86 @@ abort:
     return ret;
 }
 
+#define MD_COLLECT_MARKS_INSTANCE(name, flags)                                  \
+    static int                                                                  \
+    name(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)                         \
+    {                                                                           \
+        return md_collect_marks_(ctx, lines, n_lines, (flags));                 \
+    }
+
+MD_COLLECT_MARKS_INSTANCE(md_collect_marks, ctx->r.flags)
+#ifndef MD4C_NO_SPECIALIZATION
+MD_COLLECT_MARKS_INSTANCE(md_collect_marks_commonmark, MD_SPEC_COMMONMARK)
+MD_COLLECT_MARKS_INSTANCE(md_collect_marks_github, MD_SPEC_GITHUB)
+#endif
+
 
 /* Analyze whether the back-tick is really start/end mark of a code span.
  * If yes, reset all marks inside of it and setup flags of both marks. */
+/* Before the analysis of code spans, drop MD_MARK_POTENTIAL_OPENER of any
+ * backtick mark which cannot be an opener because no later mark of the same
+ * length exists to close it. Those never get to BACKTICK_OPENERS then. */
+static void
+md_reject_unmatched_backticks(MD_CTX* ctx)
+{
+    int i;
+
+    /* Walk backwards and use ctx->backtick_openers to remember the lengths
+     * we have already seen. */
+    for(i = ctx->n_marks - 1; i >= 0; i--) {
+        MD_MARK* mark = &ctx->marks[i];
+        SZ len;
+
+        if(mark->ch != '`')
+            continue;
+
+        /* The escaped backtick does not count as part of the opener. (See
+         * md_analyze_backtick().) */
+        len = mark->end - mark->beg;
+        if(i > 0  &&  (mark-1)->beg == mark->beg - 1  &&  (mark-1)->ch == '\\')
+            len--;
+        if(len == 0  ||  ctx->backtick_openers[len] < 0)
+            mark->flags &= ~MD_MARK_POTENTIAL_OPENER;
+
+        ctx->backtick_openers[mark->end - mark->beg] = i;
+    }
+
+    for(i = 0; i < ctx->n_marks; i++) {
+        if(ctx->marks[i].ch == '`')
+            ctx->backtick_openers[ctx->marks[i].end - ctx->marks[i].beg] = -1;
+    }
+}
+
 static void
 md_analyze_backtick(MD_CTX* ctx, int mark_index)
 {
     MD_MARK* mark = &ctx->marks[mark_index];
-    int opener_index = BACKTICK_OPENERS.tail;
+    int opener_index = ctx->backtick_openers[mark->end - mark->beg];
 
     /* Try to find unresolved opener of the same length. If we find it,
      * we form a code span. */
-    while(opener_index >= 0) {
+    if(opener_index >= 0) {
         MD_MARK* opener = &ctx->marks[opener_index];
 
-        if(opener->end - opener->beg == mark->end - mark->beg) {
-            /* Rollback anything found inside it.
-             * (e.g. the code span contains some back-ticks or other special
-             * chars we misinterpreted.) */
-            md_rollback(ctx, opener_index, mark_index, MD_ROLLBACK_ALL);
-
-            /* Resolve the span. */
-            md_resolve_range(ctx, &BACKTICK_OPENERS, opener_index, mark_index);
-
-            /* Append any space or new line inside the span into the mark
-             * itself to swallow it. */
-            while(CH(opener->end) == _T(' ')  ||  ISNEWLINE(opener->end))
-                opener->end++;
-            if(mark->beg > opener->end) {
-                while(CH(mark->beg-1) == _T(' ')  ||  ISNEWLINE(mark->beg-1))
-                    mark->beg--;
-            }
-
-            /* Done. */
-            return;
+        /* Rollback anything found inside it.
+         * (e.g. the code span contains some back-ticks or other special
+         * chars we misinterpreted.) */
+        md_rollback(ctx, opener_index, mark_index, MD_ROLLBACK_ALL);
+
+        /* Resolve the span. */
+        md_resolve_range(ctx, &BACKTICK_OPENERS, opener_index, mark_index);
+
+        /* Append any space or new line inside the span into the mark
+         * itself to swallow it. */
+        while(CH(opener->end) == _T(' ')  ||  ISNEWLINE(opener->end))
+            opener->end++;
+        if(mark->beg > opener->end) {
+            while(CH(mark->beg-1) == _T(' ')  ||  ISNEWLINE(mark->beg-1))
+                mark->beg--;
         }
 
-        opener_index = ctx->marks[opener_index].prev;
+        /* Done. */
+        return;
     }
 
     /* We didn't find any matching opener, so we ourselves may be the opener
@@ -2710,10 +3779,14 @@ md_analyze_backtick(MD_CTX* ctx, int mark_index)
 
         /* Remove the escaped backtick from the opener. */
         mark->beg++;
+
+        /* Now we may shadow an opener of the same length. */
+        if(mark->flags & MD_MARK_POTENTIAL_OPENER)
+            (mark-1)->next = ctx->backtick_openers[mark->end - mark->beg];
     }
 
     if(mark->flags & MD_MARK_POTENTIAL_OPENER)
-        md_mark_chain_append(ctx, &BACKTICK_OPENERS, mark_index);
+        md_backtick_opener_append(ctx, mark_index);
 }
 
 static int
@@ -2844,12 +3917,7 @@ md_analyze_lt_gt(MD_CTX* ctx, int mark_index, const MD_LINE* lines, SZ n_lines)
                 opener->ch = _T('@');
         } else {
             /* Identify the line where the opening mark lives. */
-            SZ line_index = 0;
-            while(1) {
-                if(opener->beg < lines[line_index].end)
-                    break;
-                line_index++;
-            }
+            SZ line_index = md_lookup_line(opener->beg, lines, n_lines);
 
             is_raw_html = (md_is_html_any(ctx, lines + line_index,
                     n_lines - line_index, opener->beg, mark->end, &detected_end));
@@ -2935,7 +4003,7 @@ md_analyze_bracket(MD_CTX* ctx, int mark_index)
 }
 
 /* Forward declaration. */
-static void md_analyze_link_contents(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg, OFF end);
+static void md_analyze_link_contents(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, int mark_beg, int mark_end);
 
 static int
 md_resolve_links(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
@@ -3018,7 +4086,7 @@ md_resolve_links(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
                             if(ctx->marks[mark->next].beg >= inline_link_end) {
                                 /* Cancel the link status. */
                                 if(attr.title_needs_free)
-                                    free(attr.title);
+                                    md_free(ctx, attr.title);
                                 is_link = FALSE;
                                 break;
                             }
@@ -3069,7 +4137,7 @@ md_resolve_links(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
                 last_img_end = closer->end;
             }
 
-            md_analyze_link_contents(ctx, lines, n_lines, opener->end, closer->beg);
+            md_analyze_link_contents(ctx, lines, n_lines, opener_index+1, closer_index);
         }
 
         opener_index = next_index;
@@ -3108,60 +4176,94 @@ md_analyze_entity(MD_CTX* ctx, int mark_index)
     }
 }
 
+/* Find the nearest opener the emphasis closer can be paired with.
+ *
+ * If the closer or the nearest opener is intra-word, the rule of 3 applies:
+ * the opener is the nearest one such that sum of lengths of the opener and the
+ * closer is not a multiple of 3. As all the openers are bucketed by their
+ * length modulo 3 (and all openers following a resolved opener are discarded
+ * by md_rollback()), this is the nearest of the tails of the eligible chains.
+ * So each closer is handled in a constant time, no matter how many openers
+ * have to be skipped.
+ */
+static int
+md_emph_find_opener(MD_CTX* ctx, const MD_MARK* closer)
+{
+    int base = EMPH_OPENERS_FIRST + (closer->ch == _T('_') ? 6 : 0);
+    int closer_mod3 = (int)((closer->end - closer->beg) % 3);
+    int opener_index = -1;
+    int i;
+
+    /* The nearest opener, no matter its length. */
+    for(i = base; i < base + 6; i++) {
+        if(ctx->mark_chains[i].tail > opener_index)
+            opener_index = ctx->mark_chains[i].tail;
+    }
+
+    if(opener_index >= 0  &&  ((closer->flags & MD_MARK_INTRAWORD) ||
+                               (ctx->marks[opener_index].flags & MD_MARK_INTRAWORD)))
+    {
+        opener_index = -1;
+        for(i = base; i < base + 6; i++) {
+            if((closer_mod3 + i - base) % 3 == 0)
+                continue;
+            if(ctx->mark_chains[i].tail > opener_index)
+                opener_index = ctx->mark_chains[i].tail;
+        }
+    }
+
+    return opener_index;
+}
+
 static void
-md_analyze_simple_pairing_mark(MD_CTX* ctx, MD_MARKCHAIN* chain, int mark_index,
-                               int apply_rule_of_three)
+md_analyze_emph(MD_CTX* ctx, int mark_index)
 {
     MD_MARK* mark = &ctx->marks[mark_index];
 
     /* If we can be a closer, try to resolve with the preceding opener. */
-    if((mark->flags & MD_MARK_POTENTIAL_CLOSER)  &&  chain->tail >= 0) {
-        int opener_index = chain->tail;
-        MD_MARK* opener = &ctx->marks[opener_index];
-        SZ opener_size = opener->end - opener->beg;
-        SZ closer_size = mark->end - mark->beg;
-
-        if(apply_rule_of_three  &&  ((mark->flags & MD_MARK_INTRAWORD) || (opener->flags & MD_MARK_INTRAWORD))) {
-            while((opener_size + closer_size) % 3 == 0) {
-                if(opener->prev < 0)
-                    goto cannot_resolve;
-
-                opener_index = opener->prev;
-                opener = &ctx->marks[opener_index];
-                opener_size = opener->end - opener->beg;
-                closer_size = mark->end - mark->beg;
-            }
-        }
+    if(mark->flags & MD_MARK_POTENTIAL_CLOSER) {
+        int opener_index = md_emph_find_opener(ctx, mark);
+
+        if(opener_index >= 0) {
+            MD_MARK* opener = &ctx->marks[opener_index];
+            MD_MARKCHAIN* opener_chain = md_emph_chain(ctx, opener_index);
+            SZ opener_size = opener->end - opener->beg;
+            SZ closer_size = mark->end - mark->beg;
+
+            if(opener_size > closer_size) {
+                /* Only the trailing part of the opener gets resolved. The rest
+                 * stays an opener, yet as it is shorter now, it has to move to
+                 * another chain. (It is the tail of its chain; the openers
+                 * after it are discarded by md_rollback() below.) */
+                int split_index = md_split_mark(ctx, opener_index,
+                                        opener_index + opener_size - 1, closer_size);
+
+                md_rollback(ctx, split_index, mark_index, MD_ROLLBACK_CROSSING);
+                md_resolve_range(ctx, NULL, split_index, mark_index);
+
+                MD_ASSERT(opener_chain->tail == opener_index);
+                opener_chain->tail = opener->prev;
+                if(opener->prev >= 0)
+                    ctx->marks[opener->prev].next = -1;
+                else
+                    opener_chain->head = -1;
+                md_mark_chain_append(ctx, md_emph_chain(ctx, opener_index), opener_index);
+            } else {
+                if(opener_size < closer_size)
+                    md_split_mark(ctx, mark_index, mark_index + 1, closer_size - opener_size);
 
-        if(opener_size > closer_size) {
-            opener_index = md_split_mark(ctx, opener_index, closer_size);
-            md_mark_chain_append(ctx, chain, opener_index);
-        } else if(opener_size < closer_size) {
-            md_split_mark(ctx, mark_index, closer_size - opener_size);
+                /* This also removes the opener from its chain. */
+                md_rollback(ctx, opener_index, mark_index, MD_ROLLBACK_CROSSING);
+                md_resolve_range(ctx, NULL, opener_index, mark_index);
+            }
+            return;
         }
-
-        md_rollback(ctx, opener_index, mark_index, MD_ROLLBACK_CROSSING);
-        md_resolve_range(ctx, chain, opener_index, mark_index);
-        return;
     }
 
-cannot_resolve:
     /* If not resolved, and we can be an opener, remember the mark for
      * the future. */
     if(mark->flags & MD_MARK_POTENTIAL_OPENER)
-        md_mark_chain_append(ctx, chain, mark_index);
-}
-
-static inline void
-md_analyze_asterisk(MD_CTX* ctx, int mark_index)
-{
-    md_analyze_simple_pairing_mark(ctx, &ASTERISK_OPENERS, mark_index, 1);
-}
-
-static inline void
-md_analyze_underscore(MD_CTX* ctx, int mark_index)
-{
-    md_analyze_simple_pairing_mark(ctx, &UNDERSCORE_OPENERS, mark_index, 1);
+        md_mark_chain_append(ctx, md_emph_chain(ctx, mark_index), mark_index);
 }
 
 static void
@@ -3196,7 +4298,7 @@ md_analyze_permissive_url_autolink(MD_CTX* ctx, int mark_index)
 
     /* Ok. Lets call it auto-link. Adapt opener and create closer to zero
      * length so all the contents becomes the link text. */
-    closer_index = md_split_mark(ctx, mark_index, 0);
+    closer_index = md_split_mark(ctx, mark_index, mark_index + 1, 0);
     closer = &ctx->marks[closer_index];
 
     opener->end = opener->beg;
@@ -3259,7 +4361,7 @@ md_analyze_permissive_email_autolink(MD_CTX* ctx, int mark_index)
 
     /* Ok. Lets call it auto-link. Adapt opener and create closer to zero
      * length so all the contents becomes the link text. */
-    closer_index = md_split_mark(ctx, mark_index, 0);
+    closer_index = md_split_mark(ctx, mark_index, mark_index + 1, 0);
     closer = &ctx->marks[closer_index];
 
     opener->beg = beg;
@@ -3270,21 +4372,14 @@ md_analyze_permissive_email_autolink(MD_CTX* ctx, int mark_index)
 }
 
 static void
-md_analyze_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg, OFF end, const CHAR* mark_chars)
+md_analyze_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
+                 int mark_beg, int mark_end, const CHAR* mark_chars)
 {
-    int i = 0;
+    int i = mark_beg;
 
-    while(i < ctx->n_marks) {
+    while(i < mark_end) {
         MD_MARK* mark = &ctx->marks[i];
 
-        /* Do not care about marks outside the given range. */
-        if(mark->end > end  &&  mark->ch != 'D')
-            break;
-        if(mark->beg < beg  &&  mark->ch != 'D') {
-            i++;
-            continue;
-        }
-
         /* Skip resolved spans. */
         if(mark->flags & MD_MARK_RESOLVED) {
             if(mark->flags & MD_MARK_OPENER) {
@@ -3311,8 +4406,8 @@ md_analyze_marks(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg, OFF end
             case '!':   /* Pass through. */
             case ']':   md_analyze_bracket(ctx, i); break;
             case '&':   md_analyze_entity(ctx, i); break;
-            case '*':   md_analyze_asterisk(ctx, i); break;
-            case '_':   md_analyze_underscore(ctx, i); break;
+            case '*':   /* Pass through. */
+            case '_':   md_analyze_emph(ctx, i); break;
             case ':':   md_analyze_permissive_url_autolink(ctx, i); break;
             case '@':   md_analyze_permissive_email_autolink(ctx, i); break;
         }
@@ -3326,49 +4421,45 @@ static int
 md_analyze_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
 {
     int ret;
-    OFF beg = lines[0].beg;
-    OFF end = lines[n_lines-1].end;
 
     /* Reset the previously collected stack of marks. */
     ctx->n_marks = 0;
+    ctx->link_title_fail[0] = (OFF)(-1);
+    ctx->link_title_fail[1] = (OFF)(-1);
+    ctx->link_title_fail[2] = (OFF)(-1);
 
     /* Collect all marks. */
-    if(md_collect_marks(ctx, lines, n_lines) != 0)
+    if(ctx->collect_marks(ctx, lines, n_lines) != 0)
         return -1;
 
     /* We analyze marks in few groups to handle their precedence. */
     /* (1) Entities; code spans; autolinks; raw HTML. */
-    md_analyze_marks(ctx, lines, n_lines, beg, end, _T("&`<>"));
-    BACKTICK_OPENERS.head = -1;
-    BACKTICK_OPENERS.tail = -1;
+    md_reject_unmatched_backticks(ctx);
+    md_analyze_marks(ctx, lines, n_lines, 0, ctx->n_marks, _T("&`<>"));
+    md_reset_backtick_openers(ctx);
     LOWERTHEN_OPENERS.head = -1;
     LOWERTHEN_OPENERS.tail = -1;
     /* (2) Links. */
-    md_analyze_marks(ctx, lines, n_lines, beg, end, _T("[]!"));
+    md_analyze_marks(ctx, lines, n_lines, 0, ctx->n_marks, _T("[]!"));
     MD_CHECK(md_resolve_links(ctx, lines, n_lines));
     BRACKET_OPENERS.head = -1;
     BRACKET_OPENERS.tail = -1;
     ctx->unresolved_link_head = -1;
     ctx->unresolved_link_tail = -1;
     /* (3) Emphasis and strong emphasis; permissive autolinks. */
-    md_analyze_marks(ctx, lines, n_lines, beg, end, _T("*_@:"));
-    ASTERISK_OPENERS.head = -1;
-    ASTERISK_OPENERS.tail = -1;
-    UNDERSCORE_OPENERS.head = -1;
-    UNDERSCORE_OPENERS.tail = -1;
+    md_analyze_marks(ctx, lines, n_lines, 0, ctx->n_marks, _T("*_@:"));
+    md_reset_emph_chains(ctx);
 
 abort:
     return ret;
 }
 
 static void
-md_analyze_link_contents(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines, OFF beg, OFF end)
+md_analyze_link_contents(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines,
+                         int mark_beg, int mark_end)
 {
-    md_analyze_marks(ctx, lines, n_lines, beg, end, _T("*_@:"));
-    ASTERISK_OPENERS.head = -1;
-    ASTERISK_OPENERS.tail = -1;
-    UNDERSCORE_OPENERS.head = -1;
-    UNDERSCORE_OPENERS.tail = -1;
+    md_analyze_marks(ctx, lines, n_lines, mark_beg, mark_end, _T("*_@:"));
+    md_reset_emph_chains(ctx);
 }
 
 static int
@@ -3377,6 +4468,8 @@ md_enter_leave_span_a(MD_CTX* ctx, int enter, MD_SPANTYPE type,
                       const CHAR* title, SZ title_size)
 {
     MD_SPAN_A_DETAIL det;
+    MD_ATTRIBUTE_BUILD href_build = {0};
+    MD_ATTRIBUTE_BUILD title_build = {0};
     int ret = 0;
 
     /* Note we here rely on fact that MD_SPAN_A_DETAIL and
@@ -3384,8 +4477,8 @@ md_enter_leave_span_a(MD_CTX* ctx, int enter, MD_SPANTYPE type,
     memset(&det, 0, sizeof(MD_SPAN_A_DETAIL));
     MD_CHECK(md_build_attribute(ctx, dest, dest_size,
                     (prohibit_escapes_in_dest ? MD_BUILD_ATTR_NO_ESCAPES : 0),
-                    &det.href));
-    MD_CHECK(md_build_attribute(ctx, title, title_size, 0, &det.title));
+                    &det.href, &href_build));
+    MD_CHECK(md_build_attribute(ctx, title, title_size, 0, &det.title, &title_build));
 
     if(enter)
         MD_ENTER_SPAN(type, &det);
@@ -3393,11 +4486,90 @@ md_enter_leave_span_a(MD_CTX* ctx, int enter, MD_SPANTYPE type,
         MD_LEAVE_SPAN(type, &det);
 
 abort:
-    md_free_attribute(ctx, &det.href);
-    md_free_attribute(ctx, &det.title);
+    md_free_attribute(ctx, &href_build);
+    md_free_attribute(ctx, &title_build);
     return ret;
 }
 
+/* Send the pending text (see md_text_coalesced()). */
+static int
+md_text_flush(MD_CTX* ctx)
+{
+    SZ size = ctx->text_size;
+
+    ctx->text_size = 0;
+    return ctx->r.text(ctx->text_type, ctx->text_ptr, size, ctx->userdata);
+}
+
+/* Append the text to the pending one in ctx->text_buffer. */
+static int
+md_text_stage(MD_CTX* ctx, const CHAR* str, SZ size)
+{
+    int is_staged = (ctx->text_ptr == ctx->text_buffer);
+    SZ n = ctx->text_size + size;
+
+    if(n > ctx->alloc_text_buffer) {
+        CHAR* new_buffer;
+        SZ new_alloc = (n + n / 2 + 128) & ~127;
+
+        new_buffer = (CHAR*) md_realloc(ctx, ctx->text_buffer,
+                    ctx->alloc_text_buffer * sizeof(CHAR), new_alloc * sizeof(CHAR));
+        if(new_buffer == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        ctx->text_buffer = new_buffer;
+        ctx->alloc_text_buffer = new_alloc;
+    }
+
+    if(!is_staged  &&  ctx->text_size > 0)
+        memcpy(ctx->text_buffer, ctx->text_ptr, ctx->text_size * sizeof(CHAR));
+    memcpy(ctx->text_buffer + ctx->text_size, str, size * sizeof(CHAR));
+    ctx->text_ptr = ctx->text_buffer;
+    ctx->text_size = n;
+    return 0;
+}
+
+/* Text callback for MD_FLAG_COALESCETEXT: Text of the same type as the pending
+ * one is merged with it, so a run of text pieces results in a single callback.
+ * As long as the pieces are contiguous in the document, the pending text just
+ * grows; only when a piece is not (e.g. after a backslash escape, or a string
+ * literal), the text is staged in ctx->text_buffer. */
+static int
+md_text_coalesced(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ size)
+{
+    int ret;
+
+    if(ctx->text_size > 0) {
+        if(type == ctx->text_type) {
+            if(ctx->text_ptr != ctx->text_buffer  &&
+               str == ctx->text_ptr + ctx->text_size  &&
+               str + size <= ctx->text + ctx->size)
+            {
+                ctx->text_size += size;
+                return 0;
+            }
+            return md_text_stage(ctx, str, size);
+        }
+
+        ret = md_text_flush(ctx);
+        if(ret != 0)
+            return ret;
+    }
+
+    if(type != MD_TEXT_NORMAL  &&  type != MD_TEXT_CODE  &&  type != MD_TEXT_HTML)
+        return ctx->r.text(type, str, size, ctx->userdata);
+
+    ctx->text_type = type;
+    if(str >= ctx->text  &&  str + size <= ctx->text + ctx->size) {
+        ctx->text_ptr = str;
+        ctx->text_size = size;
+        return 0;
+    }
+    return md_text_stage(ctx, str, size);
+}
+
 /* Render the output, accordingly to the analyzed ctx->marks. */
 static int
 md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
@@ -3425,7 +4597,7 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
         /* Process the text up to the next mark or end-of-line. */
         OFF tmp = (line->end < mark->beg ? line->end : mark->beg);
         if(tmp > off) {
-            MD_TEXT(text_type, STR(off), tmp - off);
+            MD_TEXT_COALESCED(text_type, STR(off), tmp - off);
             off = tmp;
         }
 
@@ -3436,14 +4608,15 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                     if(ISNEWLINE(mark->beg+1))
                         enforce_hardbreak = 1;
                     else
-                        MD_TEXT(text_type, STR(mark->beg+1), 1);
+                        MD_TEXT_COALESCED(text_type, STR(mark->beg+1), 1);
                     break;
 
                 case ' ':       /* Non-trivial space. */
-                    MD_TEXT(text_type, _T(" "), 1);
+                    MD_TEXT_COALESCED(text_type, _T(" "), 1);
                     break;
 
                 case '`':       /* Code span. */
+                    MD_TEXT_FLUSH();
                     if(mark->flags & MD_MARK_OPENER) {
                         MD_ENTER_SPAN(MD_SPAN_CODE, NULL);
                         text_type = MD_TEXT_CODE;
@@ -3455,6 +4628,7 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
 
                 case '_':
                 case '*':       /* Emphasis, strong emphasis. */
+                    MD_TEXT_FLUSH();
                     if(mark->flags & MD_MARK_OPENER) {
                         while(off + 1 < mark->end) {
                             MD_ENTER_SPAN(MD_SPAN_STRONG, NULL);
@@ -3485,6 +4659,7 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                     MD_ASSERT(dest_mark->ch == 'D');
                     MD_ASSERT(title_mark->ch == 'D');
 
+                    MD_TEXT_FLUSH();
                     MD_CHECK(md_enter_leave_span_a(ctx, (mark->ch != ']'),
                                 (opener->ch == '!' ? MD_SPAN_IMG : MD_SPAN_A),
                                 STR(dest_mark->beg), dest_mark->end - dest_mark->beg, FALSE,
@@ -3512,6 +4687,7 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                     const CHAR* dest = STR(opener->end);
                     SZ dest_size = closer->beg - opener->end;
 
+                    MD_TEXT_FLUSH();
                     if(opener->ch == '@') {
                         dest_size += 7;
                         MD_TEMP_BUFFER(dest_size * sizeof(CHAR));
@@ -3526,11 +4702,11 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                 }
 
                 case '&':       /* Entity. */
-                    MD_TEXT(MD_TEXT_ENTITY, STR(mark->beg), mark->end - mark->beg);
+                    MD_TEXT_COALESCED(MD_TEXT_ENTITY, STR(mark->beg), mark->end - mark->beg);
                     break;
 
                 case '\0':
-                    MD_TEXT(MD_TEXT_NULLCHAR, _T(""), 1);
+                    MD_TEXT_COALESCED(MD_TEXT_NULLCHAR, _T(""), 1);
                     break;
             }
 
@@ -3557,7 +4733,7 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                 MD_ASSERT(mark->ch == '`'  &&  (mark->flags & MD_MARK_CLOSER));
 
                 if(prev_mark->end < off  &&  off < mark->beg)
-                    MD_TEXT(MD_TEXT_CODE, _T(" "), 1);
+                    MD_TEXT_COALESCED(MD_TEXT_CODE, _T(" "), 1);
             } else if(text_type == MD_TEXT_HTML) {
                 /* Inside raw HTML, we output the new line verbatim, including
                  * any trailing spaces. */
@@ -3566,8 +4742,8 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                 while(tmp < end  &&  ISBLANK(tmp))
                     tmp++;
                 if(tmp > off)
-                    MD_TEXT(MD_TEXT_HTML, STR(off), tmp - off);
-                MD_TEXT(MD_TEXT_HTML, _T("\n"), 1);
+                    MD_TEXT_COALESCED(MD_TEXT_HTML, STR(off), tmp - off);
+                MD_TEXT_COALESCED(MD_TEXT_HTML, _T("\n"), 1);
             } else {
                 /* Output soft or hard line break. */
                 MD_TEXTTYPE break_type = MD_TEXT_SOFTBR;
@@ -3579,7 +4755,12 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
                         break_type = MD_TEXT_BR;
                 }
 
-                MD_TEXT(break_type, _T("\n"), 1);
+                /* (If the '\n' is there in the document, send it so it may be
+                 * merged with the surrounding text.) */
+                if(break_type == MD_TEXT_SOFTBR  &&  (ctx->r.flags & MD_FLAG_SOFTBRASTEXT))
+                    break_type = MD_TEXT_NORMAL;
+                MD_TEXT_COALESCED(break_type,
+                        (CH(line->end) == _T('\n') ? STR(line->end) : _T("\n")), 1);
             }
 
             /* Switch to the following line. */
@@ -3590,7 +4771,10 @@ md_process_inlines(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
         }
     }
 
+    MD_TEXT_FLUSH();
+
 abort:
+    ctx->text_size = 0;
     return ret;
 }
 
@@ -3688,7 +4872,7 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
      * be present. */
     MD_ASSERT(n_lines >= 2);
 
-    align = malloc(col_count * sizeof(MD_ALIGN));
+    align = md_malloc(ctx, col_count * sizeof(MD_ALIGN));
     if(align == NULL) {
         MD_LOG("malloc() failed.");
         ret = -1;
@@ -3710,7 +4894,7 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
     MD_LEAVE_BLOCK(MD_BLOCK_TBODY, NULL);
 
 abort:
-    free(align);
+    md_free(ctx, align);
     return ret;
 }
 
@@ -3737,7 +4921,7 @@ struct MD_BLOCK_tag {
     /* Leaf blocks:     Count of lines (MD_LINE or MD_VERBATIMLINE) on the block.
      * MD_BLOCK_OL:     Start item number.
      */
-    unsigned n_lines;
+    SZ n_lines;
 };
 
 struct MD_CONTAINER_tag {
@@ -3762,7 +4946,7 @@ md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, SZ n_lines)
 abort:
     /* Free any temporary memory blocks stored within some dummy marks. */
     for(i = PTR_CHAIN.head; i >= 0; i = ctx->marks[i].next)
-        free(md_mark_get_ptr(ctx, i));
+        md_free(ctx, md_mark_get_ptr(ctx, i));
     PTR_CHAIN.head = -1;
     PTR_CHAIN.tail = -1;
 
@@ -3802,9 +4986,49 @@ abort:
     return ret;
 }
 
+/* Check whether the output of the verbatim lines (i.e. each line with its
+ * indentation and the '\n') is the same as the range <*p_beg, *p_end) of the
+ * document. */
+static int
+md_is_contiguous_verbatim(MD_CTX* ctx, const MD_VERBATIMLINE* lines, SZ n_lines,
+                          OFF* p_beg, OFF* p_end)
+{
+    OFF off;
+    SZ i;
+
+    if(lines[0].indent > lines[0].beg)
+        return FALSE;
+    off = lines[0].beg - lines[0].indent;
+    *p_beg = off;
+
+    for(i = 0; i < n_lines; i++) {
+        const MD_VERBATIMLINE* line = &lines[i];
+
+        /* The indentation has to be just the spaces before the line. */
+        if(line->beg < off  ||  line->beg - off != line->indent)
+            return FALSE;
+        while(off < line->beg) {
+            if(CH(off) != _T(' '))
+                return FALSE;
+            off++;
+        }
+
+        off = line->end;
+        if(off >= ctx->size  ||  CH(off) != _T('\n'))
+            return FALSE;
+        off++;
+    }
+
+    *p_end = off;
+    return TRUE;
+}
+
 static int
 md_process_code_block_contents(MD_CTX* ctx, int is_fenced, const MD_VERBATIMLINE* lines, SZ n_lines)
 {
+    OFF beg, end;
+    int ret = 0;
+
     if(is_fenced) {
         /* Skip the first line in case of fenced code: It is the fence.
          * (Only the starting fence is present due to logic in md_analyze_line().) */
@@ -3824,11 +5048,22 @@ md_process_code_block_contents(MD_CTX* ctx, int is_fenced, const MD_VERBATIMLINE
     if(n_lines == 0)
         return 0;
 
+    if((ctx->r.flags & MD_FLAG_CONTIGUOUSCODE)  &&
+       md_is_contiguous_verbatim(ctx, lines, n_lines, &beg, &end))
+    {
+        MD_TEXT_INSECURE(MD_TEXT_CODE, STR(beg), end - beg);
+        return 0;
+    }
+
     return md_process_verbatim_block_contents(ctx, MD_TEXT_CODE, lines, n_lines);
+
+abort:
+    return ret;
 }
 
 static int
-md_setup_fenced_code_detail(MD_CTX* ctx, const MD_BLOCK* block, MD_BLOCK_CODE_DETAIL* det)
+md_setup_fenced_code_detail(MD_CTX* ctx, const MD_BLOCK* block, MD_BLOCK_CODE_DETAIL* det,
+                            MD_ATTRIBUTE_BUILD* info_build, MD_ATTRIBUTE_BUILD* lang_build)
 {
     const MD_VERBATIMLINE* fence_line = (const MD_VERBATIMLINE*)(block + 1);
     OFF beg = fence_line->beg;
@@ -3849,23 +5084,23 @@ md_setup_fenced_code_detail(MD_CTX* ctx, const MD_BLOCK* block, MD_BLOCK_CODE_DE
         end--;
 
     /* Build info string attribute. */
-    MD_CHECK(md_build_attribute(ctx, STR(beg), end - beg, 0, &det->info));
+    MD_CHECK(md_build_attribute(ctx, STR(beg), end - beg, 0, &det->info, info_build));
 
     /* Build info string attribute. */
     lang_end = beg;
     while(lang_end < end  &&  !ISWHITESPACE(lang_end))
         lang_end++;
-    MD_CHECK(md_build_attribute(ctx, STR(beg), lang_end - beg, 0, &det->lang));
+    MD_CHECK(md_build_attribute(ctx, STR(beg), lang_end - beg, 0, &det->lang, lang_build));
 
 abort:
     return ret;
 }
 
 static inline void
-md_clean_fenced_code_detail(MD_CTX* ctx, MD_BLOCK_CODE_DETAIL* det)
+md_clean_fenced_code_detail(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* info_build, MD_ATTRIBUTE_BUILD* lang_build)
 {
-    md_free_attribute(ctx, &det->info);
-    md_free_attribute(ctx, &det->lang);
+    md_free_attribute(ctx, info_build);
+    md_free_attribute(ctx, lang_build);
 }
 
 static int
@@ -3875,6 +5110,7 @@ md_process_leaf_block(MD_CTX* ctx, const MD_BLOCK* block)
         MD_BLOCK_H_DETAIL header;
         MD_BLOCK_CODE_DETAIL code;
     } det;
+    MD_ATTRIBUTE_BUILD info_build, lang_build;
     int is_in_tight_list;
     int clean_fence_code_detail = FALSE;
     int ret = 0;
@@ -3895,8 +5131,10 @@ md_process_leaf_block(MD_CTX* ctx, const MD_BLOCK* block)
             /* For fenced code block, we may need to set the info string. */
             if(block->data != 0) {
                 memset(&det.code, 0, sizeof(MD_BLOCK_CODE_DETAIL));
+                memset(&info_build, 0, sizeof(MD_ATTRIBUTE_BUILD));
+                memset(&lang_build, 0, sizeof(MD_ATTRIBUTE_BUILD));
                 clean_fence_code_detail = TRUE;
-                MD_CHECK(md_setup_fenced_code_detail(ctx, block, &det.code));
+                MD_CHECK(md_setup_fenced_code_detail(ctx, block, &det.code, &info_build, &lang_build));
             }
             break;
 
@@ -3940,14 +5178,14 @@ md_process_leaf_block(MD_CTX* ctx, const MD_BLOCK* block)
 
 abort:
     if(clean_fence_code_detail)
-        md_clean_fenced_code_detail(ctx, &det.code);
+        md_clean_fenced_code_detail(ctx, &info_build, &lang_build);
     return ret;
 }
 
 static int
 md_process_all_blocks(MD_CTX* ctx)
 {
-    int byte_off = 0;
+    SZ byte_off = 0;
     int ret = 0;
 
     /* ctx->containers now is not needed for detection of lists and list items
@@ -4015,6 +5253,7 @@ md_process_all_blocks(MD_CTX* ctx)
     }
 
     ctx->n_block_bytes = 0;
+    ctx->container_block_bytes_end = 0;
 
 abort:
     return ret;
@@ -4026,15 +5265,18 @@ abort:
  ************************************/
 
 static void*
-md_push_block_bytes(MD_CTX* ctx, int n_bytes)
+md_push_block_bytes(MD_CTX* ctx, SZ n_bytes)
 {
     void* ptr;
 
     if(ctx->n_block_bytes + n_bytes > ctx->alloc_block_bytes) {
         void* new_block_bytes;
+        SZ new_alloc = (ctx->alloc_block_bytes > 0 ? ctx->alloc_block_bytes * 2 : 512);
 
-        ctx->alloc_block_bytes = (ctx->alloc_block_bytes > 0 ? ctx->alloc_block_bytes * 2 : 512);
-        new_block_bytes = realloc(ctx->block_bytes, ctx->alloc_block_bytes);
+        while(new_alloc < ctx->n_block_bytes + n_bytes)
+            new_alloc *= 2;
+
+        new_block_bytes = md_realloc(ctx, ctx->block_bytes, ctx->alloc_block_bytes, new_alloc);
         if(new_block_bytes == NULL) {
             MD_LOG("realloc() failed.");
             return NULL;
@@ -4047,6 +5289,8 @@ md_push_block_bytes(MD_CTX* ctx, int n_bytes)
         }
 
         ctx->block_bytes = new_block_bytes;
+        ctx->alloc_block_bytes = new_alloc;
+        MD_STAT_ADD(block_bytes.n_reallocs, 1);
     }
 
     ptr = (char*)ctx->block_bytes + ctx->n_block_bytes;
@@ -4064,6 +5308,7 @@ md_start_new_block(MD_CTX* ctx, const MD_LINE_ANALYSIS* line)
     block = (MD_BLOCK*) md_push_block_bytes(ctx, sizeof(MD_BLOCK));
     if(block == NULL)
         return -1;
+    MD_STAT_ADD(n_blocks, 1);
 
     switch(line->type) {
         case MD_LINE_HR:
@@ -4114,7 +5359,7 @@ static int
 md_consume_link_reference_definitions(MD_CTX* ctx)
 {
     MD_LINE* lines = (MD_LINE*) (ctx->current_block + 1);
-    unsigned n_lines = ctx->current_block->n_lines;
+    SZ n_lines = ctx->current_block->n_lines;
     unsigned n = 0;
 
     /* Compute how many lines at the start of the block form one or more
@@ -4220,11 +5465,13 @@ md_push_container_bytes(MD_CTX* ctx, MD_BLOCKTYPE type, unsigned start,
     block = (MD_BLOCK*) md_push_block_bytes(ctx, sizeof(MD_BLOCK));
     if(block == NULL)
         return -1;
+    MD_STAT_ADD(n_blocks, 1);
 
     block->type = type;
     block->flags = flags;
     block->data = data;
     block->n_lines = start;
+    ctx->container_block_bytes_end = ctx->n_block_bytes;
 
 abort:
     return ret;
@@ -4232,6 +5479,93 @@ abort:
 
 
 
+/********************
+ ***  Line Index  ***
+ ********************/
+
+/* Find the first occurrence of 'ch' in <off, ctx->size), or ctx->size. */
+static inline OFF
+md_find_char(MD_CTX* ctx, OFF off, CHAR ch)
+{
+#if defined MD4C_USE_UTF16
+    while(off < ctx->size  &&  CH(off) != ch)
+        off++;
+    return off;
+#else
+    const CHAR* ptr = (const CHAR*) memchr(STR(off), ch, ctx->size - off);
+    return (ptr != NULL ? (OFF)(ptr - ctx->text) : ctx->size);
+#endif
+}
+
+static int
+md_push_line_end(MD_CTX* ctx, OFF line_end)
+{
+    if(ctx->n_lines >= ctx->alloc_lines) {
+        OFF* new_line_ends;
+        SZ new_alloc = (ctx->alloc_lines > 0 ? ctx->alloc_lines * 2 : 256);
+
+        new_line_ends = (OFF*) md_realloc(ctx, ctx->line_ends,
+                    ctx->alloc_lines * sizeof(OFF), new_alloc * sizeof(OFF));
+        if(new_line_ends == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        ctx->line_ends = new_line_ends;
+        ctx->alloc_lines = new_alloc;
+    }
+
+    ctx->line_ends[ctx->n_lines++] = line_end;
+    return 0;
+}
+
+/* Split the document (from the offset beg) into lines. We do it in one pass
+ * before the line analysis, as searching for the line breaks with memchr() is
+ * much faster than testing char by char whether we have reached the end of a
+ * line.
+ *
+ * A line break may be "\n", "\r\n" or a sole "\r". As documents with '\r'
+ * are rare, we search for '\n' first and check only whether there is some
+ * '\r' before it. To keep this linear, we remember position of the next '\r'
+ * and search for a new one only after we get past it.
+ */
+static int
+md_build_line_index(MD_CTX* ctx, OFF beg)
+{
+    OFF off = beg;
+    OFF next_cr;
+    int ret = 0;
+
+    ctx->n_lines = 0;
+    ctx->current_line = 0;
+
+    if(beg >= ctx->size)
+        return 0;
+
+    next_cr = md_find_char(ctx, beg, _T('\r'));
+
+    while(off < ctx->size) {
+        OFF line_end = md_find_char(ctx, off, _T('\n'));
+
+        if(next_cr < off)
+            next_cr = md_find_char(ctx, off, _T('\r'));
+        if(next_cr < line_end)
+            line_end = next_cr;
+
+        MD_CHECK(md_push_line_end(ctx, line_end));
+
+        off = line_end;
+        if(off < ctx->size  &&  CH(off) == _T('\r'))
+            off++;
+        if(off < ctx->size  &&  CH(off) == _T('\n'))
+            off++;
+    }
+
+abort:
+    return ret;
+}
+
+
 /***********************
  ***  Line Analysis  ***
  ***********************/
@@ -4260,7 +5594,7 @@ md_is_hr_line(MD_CTX* ctx, OFF beg, OFF* p_end)
 }
 
 static int
-md_is_atxheader_line(MD_CTX* ctx, OFF beg, OFF* p_beg, OFF* p_end, unsigned* p_level)
+md_is_atxheader_line(MD_CTX* ctx, OFF beg, OFF* p_beg, OFF* p_end, unsigned* p_level, unsigned flags)
 {
     int n;
     OFF off = beg + 1;
@@ -4273,7 +5607,7 @@ md_is_atxheader_line(MD_CTX* ctx, OFF beg, OFF* p_beg, OFF* p_end, unsigned* p_l
         return FALSE;
     *p_level = n;
 
-    if(!(ctx->r.flags & MD_FLAG_PERMISSIVEATXHEADERS)  &&  off < ctx->size  &&
+    if(!(flags & MD_FLAG_PERMISSIVEATXHEADERS)  &&  off < ctx->size  &&
        CH(off) != _T(' ')  &&  CH(off) != _T('\t')  &&  !ISNEWLINE(off))
         return FALSE;
 
@@ -4423,60 +5757,112 @@ out:
     return ret;
 }
 
+/* Tag names starting the raw HTML blocks of type 1 and 6 are stored in a
+ * minimal perfect hash table, so a tag name can be recognized in a single pass
+ * over it: The hash is computed (case-insensitively) while the name is being
+ * scanned, and only the single name in the slot then has to be compared.
+ *
+ * To update the table, edit and run scripts/build_html_tags.py. */
+typedef struct MD_HTML_TAG_tag MD_HTML_TAG;
+struct MD_HTML_TAG_tag {
+    const CHAR* name;
+    unsigned char len;
+    unsigned char type;     /* Type of the raw HTML block (1 or 6). */
+};
+
+/* BEGIN GENERATED by scripts/build_html_tags.py. Do not edit. */
+#define MD_HTML_TAG_MAXLEN          10
+#define MD_HTML_TAG_HASH_SEED       0x00000002U
+#define MD_HTML_TAG_HASH_STEP(h, ch)    ((((h) ^ ((unsigned)(ch) | 0x20)) * 0x01000193U) & 0xffffffffU)
+#define MD_HTML_TAG_DISP_SHIFT      27
+
+static const unsigned char md_html_tag_disp[32] = {
+    18, 0, 1, 8, 5, 6, 2, 3, 20, 11, 3, 3, 20, 0, 6, 0,
+    0, 5, 1, 3, 0, 29, 0, 47, 28, 0, 0, 4, 0, 11, 13, 6
+};
+
+static const MD_HTML_TAG md_html_tags[66] = {
+    { _T("iframe"), 6, 6 }, { _T("body"), 4, 6 }, { _T("source"), 6, 6 }, { _T("nav"), 3, 6 },
+    { _T("main"), 4, 6 }, { _T("footer"), 6, 6 }, { _T("fieldset"), 8, 6 }, { _T("dl"), 2, 6 },
+    { _T("col"), 3, 6 }, { _T("menuitem"), 8, 6 }, { _T("h2"), 2, 6 }, { _T("figure"), 6, 6 },
+    { _T("h6"), 2, 6 }, { _T("h1"), 2, 6 }, { _T("caption"), 7, 6 }, { _T("track"), 5, 6 },
+    { _T("th"), 2, 6 }, { _T("tfoot"), 5, 6 }, { _T("section"), 7, 6 }, { _T("dir"), 3, 6 },
+    { _T("frameset"), 8, 6 }, { _T("colgroup"), 8, 6 }, { _T("aside"), 5, 6 }, { _T("legend"), 6, 6 },
+    { _T("basefont"), 8, 6 }, { _T("dd"), 2, 6 }, { _T("param"), 5, 6 }, { _T("article"), 7, 6 },
+    { _T("tr"), 2, 6 }, { _T("head"), 4, 6 }, { _T("h4"), 2, 6 }, { _T("table"), 5, 6 },
+    { _T("tbody"), 5, 6 }, { _T("h3"), 2, 6 }, { _T("thead"), 5, 6 }, { _T("center"), 6, 6 },
+    { _T("address"), 7, 6 }, { _T("figcaption"), 10, 6 }, { _T("pre"), 3, 1 }, { _T("dialog"), 6, 6 },
+    { _T("meta"), 4, 6 }, { _T("frame"), 5, 6 }, { _T("menu"), 4, 6 }, { _T("script"), 6, 1 },
+    { _T("details"), 7, 6 }, { _T("div"), 3, 6 }, { _T("link"), 4, 6 }, { _T("form"), 4, 6 },
+    { _T("dt"), 2, 6 }, { _T("li"), 2, 6 }, { _T("noframes"), 8, 6 }, { _T("html"), 4, 6 },
+    { _T("base"), 4, 6 }, { _T("h5"), 2, 6 }, { _T("p"), 1, 6 }, { _T("header"), 6, 6 },
+    { _T("td"), 2, 6 }, { _T("title"), 5, 6 }, { _T("ul"), 2, 6 }, { _T("summary"), 7, 6 },
+    { _T("optgroup"), 8, 6 }, { _T("hr"), 2, 6 }, { _T("ol"), 2, 6 }, { _T("style"), 5, 1 },
+    { _T("option"), 6, 6 }, { _T("blockquote"), 10, 6 }
+};
+/* END GENERATED */
+
+/* Look up the tag name (of the given hash) in md_html_tags[]. */
+static inline const MD_HTML_TAG*
+md_lookup_html_tag(MD_CTX* ctx, OFF beg, OFF end, unsigned h)
+{
+    const MD_HTML_TAG* tag;
+    OFF i;
+
+    if(end - beg > MD_HTML_TAG_MAXLEN)
+        return NULL;
+
+    tag = &md_html_tags[((h + md_html_tag_disp[h >> MD_HTML_TAG_DISP_SHIFT]) & 0xffffffffU)
+                        % SIZEOF_ARRAY(md_html_tags)];
+    if(tag->len != end - beg)
+        return NULL;
+
+    /* (The name is made of alphanumeric chars and '-' only, so it is enough to
+     * fold it the same way the hash does.) */
+    for(i = 0; i < tag->len; i++) {
+        if(((unsigned) CH(beg + i) | 0x20) != (unsigned) tag->name[i])
+            return NULL;
+    }
+    return tag;
+}
+
 /* Returns type of the raw HTML block, or FALSE if it is not HTML block.
  * (Refer to CommonMark specification for details about the types.)
  */
 static int
 md_is_html_block_start_condition(MD_CTX* ctx, OFF beg)
 {
-    typedef struct TAG_tag TAG;
-    struct TAG_tag {
-        const CHAR* name;
-        unsigned len    : 8;
-    };
-
-    /* Type 6 is started by a long list of allowed tags. We use two-level
-     * tree to speed-up the search. */
-#ifdef X
-    #undef X
-#endif
-#define X(name)     { _T(name), sizeof(name)-1 }
-#define Xend        { NULL, 0 }
-    static const TAG t1[] = { X("script"), X("pre"), X("style"), Xend };
-
-    static const TAG a6[] = { X("address"), X("article"), X("aside"), Xend };
-    static const TAG b6[] = { X("base"), X("basefont"), X("blockquote"), X("body"), Xend };
-    static const TAG c6[] = { X("caption"), X("center"), X("col"), X("colgroup"), Xend };
-    static const TAG d6[] = { X("dd"), X("details"), X("dialog"), X("dir"),
-                              X("div"), X("dl"), X("dt"), Xend };
-    static const TAG f6[] = { X("fieldset"), X("figcaption"), X("figure"), X("footer"),
-                              X("form"), X("frame"), X("frameset"), Xend };
-    static const TAG h6[] = { X("h1"), X("head"), X("header"), X("hr"), X("html"), Xend };
-    static const TAG i6[] = { X("iframe"), Xend };
-    static const TAG l6[] = { X("legend"), X("li"), X("link"), Xend };
-    static const TAG m6[] = { X("main"), X("menu"), X("menuitem"), X("meta"), Xend };
-    static const TAG n6[] = { X("nav"), X("noframes"), Xend };
-    static const TAG o6[] = { X("ol"), X("optgroup"), X("option"), Xend };
-    static const TAG p6[] = { X("p"), X("param"), Xend };
-    static const TAG s6[] = { X("section"), X("source"), X("summary"), Xend };
-    static const TAG t6[] = { X("table"), X("tbody"), X("td"), X("tfoot"), X("th"),
-                              X("thead"), X("title"), X("tr"), X("track"), Xend };
-    static const TAG u6[] = { X("ul"), Xend };
-    static const TAG xx[] = { Xend };
-#undef X
-
-    static const TAG* map6[26] = {
-        a6, b6, c6, d6, xx, f6, xx, h6, i6, xx, xx, l6, m6,
-        n6, o6, p6, xx, xx, s6, t6, u6, xx, xx, xx, xx, xx
-    };
     OFF off = beg + 1;
-    int i;
 
-    /* Check for type 1: <script, <pre, or <style */
-    for(i = 0; t1[i].name != NULL; i++) {
-        if(off + t1[i].len < ctx->size) {
-            if(md_ascii_case_eq(STR(off), t1[i].name, t1[i].len))
+    /* Check for type 1 or 6: <tag or </tag with one of the tag names in
+     * md_html_tags[]. */
+    if(off < ctx->size  &&  (ISALPHA(off) ||
+                             (CH(off) == _T('/') && off + 1 < ctx->size && ISALPHA(off+1))))
+    {
+        int is_closer = (CH(off) == _T('/'));
+        OFF name_beg = off + is_closer;
+        OFF name_end = name_beg;
+        OFF name_max = (ctx->size - name_beg > MD_HTML_TAG_MAXLEN + 1
+                                ? name_beg + MD_HTML_TAG_MAXLEN + 1 : ctx->size);
+        unsigned h = MD_HTML_TAG_HASH_SEED;
+        const MD_HTML_TAG* tag;
+
+        while(name_end < name_max  &&  (ISALNUM(name_end) || CH(name_end) == _T('-'))) {
+            h = MD_HTML_TAG_HASH_STEP(h, CH(name_end));
+            name_end++;
+        }
+
+        tag = md_lookup_html_tag(ctx, name_beg, name_end, h);
+        if(tag != NULL  &&  tag->type == 1) {
+            if(!is_closer  &&  (name_end >= ctx->size  ||  ISWHITESPACE(name_end)  ||
+                                ISNEWLINE(name_end)  ||  CH(name_end) == _T('>')))
                 return 1;
+        } else if(tag != NULL) {
+            if(name_end >= ctx->size  ||  ISBLANK(name_end)  ||  ISNEWLINE(name_end)  ||
+               CH(name_end) == _T('>'))
+                return 6;
+            if(name_end+1 < ctx->size  &&  CH(name_end) == _T('/')  &&  CH(name_end+1) == _T('>'))
+                return 6;
         }
     }
 
@@ -4501,33 +5887,6 @@ md_is_html_block_start_condition(MD_CTX* ctx, OFF beg)
         }
     }
 
-    /* Check for type 6: Many possible starting tags listed above. */
-    if(off + 1 < ctx->size  &&  (ISALPHA(off) || (CH(off) == _T('/') && ISALPHA(off+1)))) {
-        int slot;
-        const TAG* tags;
-
-        if(CH(off) == _T('/'))
-            off++;
-
-        slot = (ISUPPER(off) ? CH(off) - 'A' : CH(off) - 'a');
-        tags = map6[slot];
-
-        for(i = 0; tags[i].name != NULL; i++) {
-            if(off + tags[i].len <= ctx->size) {
-                if(md_ascii_case_eq(STR(off), tags[i].name, tags[i].len)) {
-                    OFF tmp = off + tags[i].len;
-                    if(tmp >= ctx->size)
-                        return 6;
-                    if(ISBLANK(tmp) || ISNEWLINE(tmp) || CH(tmp) == _T('>'))
-                        return 6;
-                    if(tmp+1 < ctx->size && CH(tmp) == _T('/') && CH(tmp+1) == _T('>'))
-                        return 6;
-                    break;
-                }
-            }
-        }
-    }
-
     /* Check for type 7: any COMPLETE other opening or closing tag. */
     if(off + 1 < ctx->size) {
         OFF end;
@@ -4550,10 +5909,8 @@ static int
 md_line_contains(MD_CTX* ctx, OFF beg, const CHAR* what, SZ what_len, OFF* p_end)
 {
     OFF i;
-    for(i = beg; i + what_len < ctx->size; i++) {
-        if(ISNEWLINE(i))
-            break;
-        if(memcmp(STR(i), what, what_len * sizeof(CHAR)) == 0) {
+    for(i = beg; i < ctx->size  &&  !ISNEWLINE(i); i++) {
+        if(i + what_len <= ctx->size  &&  memcmp(STR(i), what, what_len * sizeof(CHAR)) == 0) {
             *p_end = i + what_len;
             return TRUE;
         }
@@ -4615,18 +5972,148 @@ md_is_html_block_end_condition(MD_CTX* ctx, OFF beg, OFF* p_end)
         case 6:     /* Pass through */
         case 7:
             *p_end = beg;
-            return (ISNEWLINE(beg) ? ctx->html_block_type : FALSE);
+            return (beg >= ctx->size || ISNEWLINE(beg) ? ctx->html_block_type : FALSE);
 
         default:
             MD_UNREACHABLE();
     }
 }
 
-/* Check whether there is a given unescaped char 'ch' between 'beg' and end of line. */
-static int
-md_line_contains_char(MD_CTX* ctx, OFF beg, CHAR ch, OFF* p_pos)
+/* Find the first occurrence of the pair of chars c1, c2 in <off, end).
+ * Returns end if there is none. */
+static OFF
+md_find_pair_scalar(MD_CTX* ctx, OFF off, OFF end, CHAR c1, CHAR c2)
 {
-    OFF off = beg;
+    while(off + 1 < end) {
+        off = md_find_char(ctx, off, c1);
+        if(off + 1 >= end)
+            break;
+        if(CH(off+1) == c2)
+            return off;
+        off++;
+    }
+
+    return end;
+}
+
+#ifdef MD4C_SIMD_X86
+/* The vectorized variants compare 16 (or 32) chars at once with c1, and the
+ * same block shifted by one char with c2. (SSE2 is always available on
+ * x86-64.) */
+static OFF
+md_find_pair_sse2(MD_CTX* ctx, OFF off, OFF end, CHAR c1, CHAR c2)
+{
+    const __m128i v1 = _mm_set1_epi8((char) c1);
+    const __m128i v2 = _mm_set1_epi8((char) c2);
+
+    while(off + 17 <= end) {
+        __m128i a = _mm_loadu_si128((const __m128i*) STR(off));
+        __m128i b = _mm_loadu_si128((const __m128i*) STR(off+1));
+        unsigned bits = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, v1), _mm_cmpeq_epi8(b, v2)));
+
+        if(bits != 0)
+            return off + __builtin_ctz(bits);
+        off += 16;
+    }
+
+    return md_find_pair_scalar(ctx, off, end, c1, c2);
+}
+
+__attribute__((target("avx2")))
+static OFF
+md_find_pair_avx2(MD_CTX* ctx, OFF off, OFF end, CHAR c1, CHAR c2)
+{
+    const __m256i v1 = _mm256_set1_epi8((char) c1);
+    const __m256i v2 = _mm256_set1_epi8((char) c2);
+
+    while(off + 33 <= end) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) STR(off));
+        __m256i b = _mm256_loadu_si256((const __m256i*) STR(off+1));
+        unsigned bits = (unsigned) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, v1), _mm256_cmpeq_epi8(b, v2)));
+
+        if(bits != 0)
+            return off + __builtin_ctz(bits);
+        off += 32;
+    }
+
+    return md_find_pair_scalar(ctx, off, end, c1, c2);
+}
+#endif  /* MD4C_SIMD_X86 */
+
+static void
+md_setup_pair_finder(MD_CTX* ctx)
+{
+#ifdef MD4C_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        ctx->find_pair = md_find_pair_avx2;
+    else
+        ctx->find_pair = md_find_pair_sse2;
+#else
+    ctx->find_pair = md_find_pair_scalar;
+#endif
+}
+
+/* Find where the end condition of the current raw HTML block (of type 1 - 5)
+ * is met in <off, end), i.e. the offset of the string closing the block.
+ * Returns end if there is none. This gives the same result as calling
+ * md_is_html_block_end_condition() on each line, only (as the strings cannot
+ * span multiple lines) we do not need to care about the lines at all. */
+static OFF
+md_find_html_block_end(MD_CTX* ctx, OFF off, OFF end)
+{
+    switch(ctx->html_block_type) {
+        case 1:
+            while(1) {
+                off = ctx->find_pair(ctx, off, end, _T('<'), _T('/'));
+                if(off >= end)
+                    return end;
+                if((off + 9 <= end  &&  md_ascii_case_eq(STR(off), _T("</script>"), 9))  ||
+                   (off + 8 <= end  &&  md_ascii_case_eq(STR(off), _T("</style>"), 8))  ||
+                   (off + 6 <= end  &&  md_ascii_case_eq(STR(off), _T("</pre>"), 6)))
+                    return off;
+                off++;
+            }
+
+        case 2:
+            while(1) {
+                off = ctx->find_pair(ctx, off, end, _T('-'), _T('-'));
+                if(off + 2 >= end)
+                    return end;
+                if(CH(off+2) == _T('>'))
+                    return off;
+                off++;
+            }
+
+        case 3:
+            return ctx->find_pair(ctx, off, end, _T('?'), _T('>'));
+
+        case 4:
+            off = md_find_char(ctx, off, _T('>'));
+            return (off < end ? off : end);
+
+        case 5:
+            while(1) {
+                off = ctx->find_pair(ctx, off, end, _T(']'), _T(']'));
+                if(off + 2 >= end)
+                    return end;
+                if(CH(off+2) == _T('>'))
+                    return off;
+                off++;
+            }
+
+        default:
+            MD_UNREACHABLE();
+            return end;
+    }
+}
+
+/* Check whether there is a given unescaped char 'ch' between 'beg' and end of line. */
+static int
+md_line_contains_char(MD_CTX* ctx, OFF beg, CHAR ch, OFF* p_pos)
+{
+    OFF off = beg;
 
     while(off < ctx->size) {
         if(ISNEWLINE(off)) {
@@ -4666,18 +6153,23 @@ md_push_container(MD_CTX* ctx, const MD_CONTAINER* container)
 {
     if(ctx->n_containers >= ctx->alloc_containers) {
         MD_CONTAINER* new_containers;
+        int new_alloc = (ctx->alloc_containers > 0 ? ctx->alloc_containers * 2 : 16);
 
-        ctx->alloc_containers = (ctx->alloc_containers > 0 ? ctx->alloc_containers * 2 : 16);
-        new_containers = realloc(ctx->containers, ctx->alloc_containers * sizeof(MD_CONTAINER));
+        new_containers = md_realloc(ctx, ctx->containers,
+                                    ctx->alloc_containers * sizeof(MD_CONTAINER),
+                                    new_alloc * sizeof(MD_CONTAINER));
         if(new_containers == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
         }
 
         ctx->containers = new_containers;
+        ctx->alloc_containers = new_alloc;
+        MD_STAT_ADD(containers.n_reallocs, 1);
     }
 
     memcpy(&ctx->containers[ctx->n_containers++], container, sizeof(MD_CONTAINER));
+    MD_STAT_PEAK(containers, ctx->n_containers * sizeof(MD_CONTAINER));
     return 0;
 }
 
@@ -4707,7 +6199,7 @@ md_enter_child_containers(MD_CTX* ctx, unsigned n_children, unsigned data)
 
                 MD_CHECK(md_push_container_bytes(ctx,
                                 (is_ordered_list ? MD_BLOCK_OL : MD_BLOCK_UL),
-                                c->start, data, MD_BLOCK_CONTAINER_OPENER));
+                                c->start, c->ch, MD_BLOCK_CONTAINER_OPENER));
                 MD_CHECK(md_push_container_bytes(ctx, MD_BLOCK_LI, 0, data, MD_BLOCK_CONTAINER_OPENER));
                 break;
 
@@ -4837,10 +6329,12 @@ static const MD_LINE_ANALYSIS md_dummy_blank_line = { MD_LINE_BLANK, 0 };
 
 /* Analyze type of the line and find some its properties. This serves as a
  * main input for determining type and boundaries of a block. */
-static int
-md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
-                const MD_LINE_ANALYSIS* pivot_line, MD_LINE_ANALYSIS* line)
+MD_FORCEINLINE int
+md_analyze_line_(MD_CTX* ctx, OFF beg, OFF* p_end,
+                 const MD_LINE_ANALYSIS* pivot_line, MD_LINE_ANALYSIS* line, unsigned flags)
 {
+    /* Minimal indentation to call the block "indented code block". */
+    const unsigned code_indent_offset = (flags & MD_FLAG_NOINDENTEDCODEBLOCKS) ? (unsigned)(-1) : 4;
     unsigned total_indent = 0;
     int n_parents = 0;
     int n_brothers = 0;
@@ -4859,7 +6353,7 @@ md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
     while(n_parents < ctx->n_containers) {
         MD_CONTAINER* c = &ctx->containers[n_parents];
 
-        if(c->ch == _T('>')  &&  line->indent < ctx->code_indent_offset  &&
+        if(c->ch == _T('>')  &&  line->indent < code_indent_offset  &&
             off < ctx->size  &&  CH(off) == _T('>'))
         {
             /* Block quote mark. */
@@ -4890,7 +6384,7 @@ redo:
 
         /* We are another MD_LINE_FENCEDCODE unless we are closing fence
          * which we transform into MD_LINE_BLANK. */
-        if(line->indent < ctx->code_indent_offset) {
+        if(line->indent < code_indent_offset) {
             if(md_is_closing_code_fence(ctx, CH(pivot_line->beg), off, &off)) {
                 line->type = MD_LINE_BLANK;
                 ctx->last_line_has_list_loosening_effect = FALSE;
@@ -4919,8 +6413,12 @@ redo:
         }
     }
 
-    /* Check whether we are HTML block continuation. */
-    if(pivot_line->type == MD_LINE_HTML  &&  ctx->html_block_type > 0) {
+    /* Check whether we are HTML block continuation. (If the line does not
+     * belong to all the containers of the block, it is not, and the end
+     * condition must not move 'off' past the line contents.) */
+    if(pivot_line->type == MD_LINE_HTML  &&  ctx->html_block_type > 0  &&
+       n_parents == ctx->n_containers)
+    {
         int html_block_type;
 
         html_block_type = md_is_html_block_end_condition(ctx, off, &off);
@@ -4938,10 +6436,8 @@ redo:
             }
         }
 
-        if(n_parents == ctx->n_containers) {
-            line->type = MD_LINE_HTML;
-            goto done;
-        }
+        line->type = MD_LINE_HTML;
+        goto done;
     }
 
     /* Check for blank line. */
@@ -4955,8 +6451,8 @@ redo:
 
         if(pivot_line->type == MD_LINE_INDENTEDCODE  &&  n_parents == ctx->n_containers) {
             line->type = MD_LINE_INDENTEDCODE;
-            if(line->indent > ctx->code_indent_offset)
-                line->indent -= ctx->code_indent_offset;
+            if(line->indent > code_indent_offset)
+                line->indent -= code_indent_offset;
             else
                 line->indent = 0;
             ctx->last_line_has_list_loosening_effect = FALSE;
@@ -4978,7 +6474,7 @@ redo:
              */
             if(n_parents > 0  &&  ctx->containers[n_parents-1].ch != _T('>')  &&
                n_brothers + n_children == 0  &&  ctx->current_block == NULL  &&
-               ctx->n_block_bytes > sizeof(MD_BLOCK))
+               ctx->n_block_bytes == ctx->container_block_bytes_end)
             {
                 MD_BLOCK* top_block = (MD_BLOCK*) ((char*)ctx->block_bytes + ctx->n_block_bytes - sizeof(MD_BLOCK));
                 if(top_block->type == MD_BLOCK_LI)
@@ -4996,7 +6492,7 @@ redo:
         if(ctx->last_list_item_starts_with_two_blank_lines) {
             if(n_parents > 0  &&  ctx->containers[n_parents-1].ch != _T('>')  &&
                n_brothers + n_children == 0  &&  ctx->current_block == NULL  &&
-               ctx->n_block_bytes > sizeof(MD_BLOCK))
+               ctx->n_block_bytes == ctx->container_block_bytes_end)
             {
                 MD_BLOCK* top_block = (MD_BLOCK*) ((char*)ctx->block_bytes + ctx->n_block_bytes - sizeof(MD_BLOCK));
                 if(top_block->type == MD_BLOCK_LI)
@@ -5009,7 +6505,7 @@ redo:
     }
 
     /* Check whether we are Setext underline. */
-    if(line->indent < ctx->code_indent_offset  &&  pivot_line->type == MD_LINE_TEXT
+    if(line->indent < code_indent_offset  &&  pivot_line->type == MD_LINE_TEXT
         &&  (CH(off) == _T('=') || CH(off) == _T('-'))
         &&  (n_parents == ctx->n_containers))
     {
@@ -5023,7 +6519,7 @@ redo:
     }
 
     /* Check for thematic break line. */
-    if(line->indent < ctx->code_indent_offset  &&  ISANYOF(off, _T("-_*"))) {
+    if(line->indent < code_indent_offset  &&  ISANYOF(off, _T("-_*"))) {
         if(md_is_hr_line(ctx, off, &off)) {
             line->type = MD_LINE_HR;
             goto done;
@@ -5058,7 +6554,7 @@ redo:
             /* Some of the following whitespace actually still belongs to the mark. */
             if(off >= ctx->size || ISNEWLINE(off)) {
                 container.contents_indent++;
-            } else if(line->indent <= ctx->code_indent_offset) {
+            } else if(line->indent <= code_indent_offset) {
                 container.contents_indent += line->indent;
                 line->indent = 0;
             } else {
@@ -5076,18 +6572,18 @@ redo:
 
     /* Check for indented code.
      * Note indented code block cannot interrupt paragraph. */
-    if(line->indent >= ctx->code_indent_offset  &&
+    if(line->indent >= code_indent_offset  &&
         (pivot_line->type == MD_LINE_BLANK || pivot_line->type == MD_LINE_INDENTEDCODE))
     {
         line->type = MD_LINE_INDENTEDCODE;
-        MD_ASSERT(line->indent >= ctx->code_indent_offset);
-        line->indent -= ctx->code_indent_offset;
+        MD_ASSERT(line->indent >= code_indent_offset);
+        line->indent -= code_indent_offset;
         line->data = 0;
         goto done;
     }
 
     /* Check for start of a new container block. */
-    if(line->indent < ctx->code_indent_offset  &&
+    if(line->indent < code_indent_offset  &&
        md_is_container_mark(ctx, line->indent, off, &off, &container))
     {
         if(pivot_line->type == MD_LINE_TEXT  &&  n_parents == ctx->n_containers  &&
@@ -5109,7 +6605,7 @@ redo:
             /* Some of the following whitespace actually still belongs to the mark. */
             if(off >= ctx->size || ISNEWLINE(off)) {
                 container.contents_indent++;
-            } else if(line->indent <= ctx->code_indent_offset) {
+            } else if(line->indent <= code_indent_offset) {
                 container.contents_indent += line->indent;
                 line->indent = 0;
             } else {
@@ -5130,10 +6626,10 @@ redo:
     }
 
     /* Check for ATX header. */
-    if(line->indent < ctx->code_indent_offset  &&  CH(off) == _T('#')) {
+    if(line->indent < code_indent_offset  &&  off < ctx->size  &&  CH(off) == _T('#')) {
         unsigned level;
 
-        if(md_is_atxheader_line(ctx, off, &line->beg, &off, &level)) {
+        if(md_is_atxheader_line(ctx, off, &line->beg, &off, &level, flags)) {
             line->type = MD_LINE_ATXHEADER;
             line->data = level;
             goto done;
@@ -5150,7 +6646,7 @@ redo:
     }
 
     /* Check for start of raw HTML block. */
-    if(CH(off) == _T('<')  &&  !(ctx->r.flags & MD_FLAG_NOHTMLBLOCKS))
+    if(CH(off) == _T('<')  &&  !(flags & MD_FLAG_NOHTMLBLOCKS))
     {
         ctx->html_block_type = md_is_html_block_start_condition(ctx, off);
 
@@ -5171,8 +6667,9 @@ redo:
     }
 
     /* Check for table underline. */
-    if((ctx->r.flags & MD_FLAG_TABLES)  &&  pivot_line->type == MD_LINE_TEXT  &&
-       (CH(off) == _T('|') || CH(off) == _T('-') || CH(off) == _T(':')))
+    if((flags & MD_FLAG_TABLES)  &&  pivot_line->type == MD_LINE_TEXT  &&
+       (CH(off) == _T('|') || CH(off) == _T('-') || CH(off) == _T(':'))  &&
+       n_parents == ctx->n_containers)
     {
         unsigned col_count;
 
@@ -5194,9 +6691,12 @@ redo:
     }
 
 done:
-    /* Eat rest of the line contents */
-    while(off < ctx->size  &&  !ISNEWLINE(off))
-        off++;
+    /* Eat rest of the line contents. (We know where the line ends from the
+     * line index.) */
+    MD_ASSERT(ctx->current_line < ctx->n_lines);
+    MD_ASSERT(off <= ctx->line_ends[ctx->current_line]);
+    off = ctx->line_ends[ctx->current_line];
+    ctx->current_line++;
 
     /* Set end of the line. */
     line->end = off;
@@ -5208,7 +6708,7 @@ done:
             tmp--;
         while(tmp > line->beg && CH(tmp-1) == _T('#'))
             tmp--;
-        if(tmp == line->beg || CH(tmp-1) == _T(' ') || (ctx->r.flags & MD_FLAG_PERMISSIVEATXHEADERS))
+        if(tmp == line->beg || CH(tmp-1) == _T(' ') || (flags & MD_FLAG_PERMISSIVEATXHEADERS))
             line->end = tmp;
     }
 
@@ -5253,12 +6753,28 @@ abort:
     return ret;
 }
 
+#define MD_ANALYZE_LINE_INSTANCE(name, flags)                                   \
+    static int                                                                  \
+    name(MD_CTX* ctx, OFF beg, OFF* p_end,                                      \
+         const MD_LINE_ANALYSIS* pivot_line, MD_LINE_ANALYSIS* line)            \
+    {                                                                           \
+        return md_analyze_line_(ctx, beg, p_end, pivot_line, line, (flags));    \
+    }
+
+MD_ANALYZE_LINE_INSTANCE(md_analyze_line, ctx->r.flags)
+#ifndef MD4C_NO_SPECIALIZATION
+MD_ANALYZE_LINE_INSTANCE(md_analyze_line_commonmark, MD_SPEC_COMMONMARK)
+MD_ANALYZE_LINE_INSTANCE(md_analyze_line_github, MD_SPEC_GITHUB)
+#endif
+
 static int
 md_process_line(MD_CTX* ctx, const MD_LINE_ANALYSIS** p_pivot_line, const MD_LINE_ANALYSIS* line)
 {
     const MD_LINE_ANALYSIS* pivot_line = *p_pivot_line;
     int ret = 0;
 
+    MD_STAT_ADD(n_lines, 1);
+
     /* Blank line ends current leaf block. */
     if(line->type == MD_LINE_BLANK) {
         MD_CHECK(md_end_current_block(ctx));
@@ -5317,6 +6833,148 @@ abort:
     return ret;
 }
 
+/* Fast path for the contents of a raw HTML block of type 1 - 5 (e.g. a large
+ * embedded script or style sheet) which is not nested in any container. Only
+ * the line meeting the end condition can end such block, so we search for it
+ * in all the following lines at once, and add all the lines before it into
+ * the block without analyzing them one by one. The line with the end condition
+ * is left to the normal line analysis.
+ *
+ * Called after the line (starting at *p_off) of the block has been analyzed
+ * and processed, and updates *p_off accordingly. */
+static int
+md_process_html_block_lines(MD_CTX* ctx, OFF* p_off)
+{
+    OFF off = *p_off;
+    OFF end = md_find_html_block_end(ctx, off, ctx->size);
+    MD_VERBATIMLINE* lines;
+    SZ n = 0;
+    SZ i;
+
+    MD_ASSERT(ctx->current_block != NULL  &&  ctx->current_block->type == MD_BLOCK_HTML);
+
+    while(ctx->current_line + n < ctx->n_lines  &&  ctx->line_ends[ctx->current_line + n] < end)
+        n++;
+    if(n == 0)
+        return 0;
+
+    lines = (MD_VERBATIMLINE*) md_push_block_bytes(ctx, n * sizeof(MD_VERBATIMLINE));
+    if(lines == NULL)
+        return -1;
+
+    /* (The same as md_analyze_line() does for the HTML block continuation
+     * lines.) */
+    for(i = 0; i < n; i++) {
+        OFF line_end = ctx->line_ends[ctx->current_line++];
+
+        lines[i].indent = md_line_indentation(ctx, 0, off, &off);
+        lines[i].beg = off;
+        lines[i].end = line_end;
+        while(lines[i].end > lines[i].beg  &&  CH(lines[i].end-1) == _T(' '))
+            lines[i].end--;
+
+        off = line_end;
+        if(off < ctx->size  &&  CH(off) == _T('\r'))
+            off++;
+        if(off < ctx->size  &&  CH(off) == _T('\n'))
+            off++;
+    }
+
+    ctx->current_block->n_lines += n;
+    MD_STAT_ADD(n_lines, n);
+    *p_off = off;
+    return 0;
+}
+
+/* Fast path for the contents of a fenced code block which is not nested in
+ * any container. Only the closing fence can end such block, so we just walk
+ * the line index, looking at the start of each line for the closing fence,
+ * and add all the lines before it into the block at once. The closing fence
+ * is left to the normal line analysis.
+ *
+ * Called after the line (starting at *p_off) of the block has been analyzed
+ * and processed, and updates *p_off accordingly. */
+static int
+md_process_fenced_code_lines(MD_CTX* ctx, const MD_LINE_ANALYSIS* pivot_line, OFF* p_off)
+{
+    const unsigned code_indent_offset = (ctx->r.flags & MD_FLAG_NOINDENTEDCODEBLOCKS) ? (unsigned)(-1) : 4;
+    const CHAR fence_ch = CH(pivot_line->beg);
+    OFF off = *p_off;
+    MD_VERBATIMLINE* lines;
+    SZ n = 0;
+    SZ i;
+
+    MD_ASSERT(ctx->current_block != NULL  &&  ctx->current_block->type == MD_BLOCK_CODE);
+
+    /* Find the closing fence. */
+    while(off < ctx->size  &&  ctx->current_line + n < ctx->n_lines) {
+        OFF tmp;
+
+        if(md_line_indentation(ctx, 0, off, &tmp) < code_indent_offset  &&
+           tmp < ctx->size  &&  CH(tmp) == fence_ch  &&
+           md_is_closing_code_fence(ctx, fence_ch, tmp, &tmp))
+            break;
+
+        off = ctx->line_ends[ctx->current_line + n];
+        if(off < ctx->size  &&  CH(off) == _T('\r'))
+            off++;
+        if(off < ctx->size  &&  CH(off) == _T('\n'))
+            off++;
+        n++;
+    }
+    if(n == 0)
+        return 0;
+
+    lines = (MD_VERBATIMLINE*) md_push_block_bytes(ctx, n * sizeof(MD_VERBATIMLINE));
+    if(lines == NULL)
+        return -1;
+
+    /* (The same as md_analyze_line() does for the fenced code continuation
+     * lines.) */
+    off = *p_off;
+    for(i = 0; i < n; i++) {
+        OFF line_end = ctx->line_ends[ctx->current_line++];
+        unsigned indent = md_line_indentation(ctx, 0, off, &off);
+
+        lines[i].indent = (indent > pivot_line->indent ? indent - pivot_line->indent : 0);
+        lines[i].beg = off;
+        lines[i].end = line_end;
+
+        off = line_end;
+        if(off < ctx->size  &&  CH(off) == _T('\r'))
+            off++;
+        if(off < ctx->size  &&  CH(off) == _T('\n'))
+            off++;
+    }
+
+    ctx->current_block->n_lines += n;
+    MD_STAT_ADD(n_lines, n);
+    *p_off = off;
+    return 0;
+}
+
+/* Whether md_process_verbatim_lines() may be used after the line just
+ * processed. */
+#define MD_VERBATIM_FAST_PATH(ctx)                                          \
+    ((ctx)->n_containers == 0  &&  (ctx)->current_block != NULL  &&         \
+     ((ctx)->current_block->type == MD_BLOCK_HTML  ||                       \
+      (ctx)->current_block->type == MD_BLOCK_CODE))
+
+static int
+md_process_verbatim_lines(MD_CTX* ctx, const MD_LINE_ANALYSIS* pivot_line, OFF* p_off)
+{
+    /* (Note ctx->html_block_type may be stale if the block has been ended by
+     * its container, so check also the block type.) */
+    if(ctx->current_block->type == MD_BLOCK_HTML  &&
+       ctx->html_block_type >= 1  &&  ctx->html_block_type <= 5)
+        return md_process_html_block_lines(ctx, p_off);
+
+    if(pivot_line->type == MD_LINE_FENCEDCODE)
+        return md_process_fenced_code_lines(ctx, pivot_line, p_off);
+
+    return 0;
+}
+
 static int
 md_process_doc(MD_CTX *ctx)
 {
@@ -5324,90 +6982,3025 @@ md_process_doc(MD_CTX *ctx)
     MD_LINE_ANALYSIS line_buf[2];
     MD_LINE_ANALYSIS* line = &line_buf[0];
     OFF off = 0;
+    double t0 = 0.0;
+    double t1 = 0.0;
     int ret = 0;
 
+    if(ctx->stats != NULL)
+        t0 = md_stats_clock();
+
+    MD_CHECK(md_build_line_index(ctx, 0));
+
     MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
 
     while(off < ctx->size) {
         if(line == pivot_line)
             line = (line == &line_buf[0] ? &line_buf[1] : &line_buf[0]);
 
-        MD_CHECK(md_analyze_line(ctx, off, &off, pivot_line, line));
+        MD_CHECK(ctx->analyze_line(ctx, off, &off, pivot_line, line));
         MD_CHECK(md_process_line(ctx, &pivot_line, line));
+        if(MD_VERBATIM_FAST_PATH(ctx))
+            MD_CHECK(md_process_verbatim_lines(ctx, pivot_line, &off));
     }
 
     /* Process all blocks. */
     md_end_current_block(ctx);
     MD_CHECK(md_leave_child_containers(ctx, 0));
+
+    if(ctx->stats != NULL) {
+        MD_STAT_PEAK(block_bytes, (SZ) ctx->n_block_bytes);
+        t1 = md_stats_clock();
+        ctx->stats->block_time += t1 - t0;
+    }
+
     MD_CHECK(md_process_all_blocks(ctx));
 
+    if(ctx->stats != NULL)
+        ctx->stats->inline_time += md_stats_clock() - t1;
+
     MD_LEAVE_BLOCK(MD_BLOCK_DOC, NULL);
 
 abort:
+    return ret;
+}
 
-#if 0
-    /* Output some memory consumption statistics. */
-    {
-        char buffer[256];
-        sprintf(buffer, "Alloced %u bytes for block buffer.",
-                    (unsigned)(ctx->alloc_block_bytes));
-        MD_LOG(buffer);
 
-        sprintf(buffer, "Alloced %u bytes for containers buffer.",
-                    (unsigned)(ctx->alloc_containers * sizeof(MD_CONTAINER)));
-        MD_LOG(buffer);
+/*************************
+ ***  UTF-8 Validation  ***
+ *************************/
+
+/* With MD_FLAG_VALIDATEUTF8, the input is checked to be a valid UTF-8 (i.e.
+ * without any overlong encodings, surrogates or codepoints beyond U+10FFFF)
+ * before it is parsed. Any invalid sequence is then replaced with U+FFFD in
+ * a copy of the input (see md_utf8_repair()). As most of the input is valid,
+ * the check is the hot path: It is vectorized where possible. */
+
+/* Check the sequence at the start of str[0 .. size). Returns its length if it
+ * is a complete valid sequence, zero if it is valid but cut by the end of the
+ * string, or minus the length of its maximal valid part if it is invalid (at
+ * least 1 byte; the part is replaced with single U+FFFD, as recommended by
+ * Unicode). */
+static int
+md_utf8_check_seq(const unsigned char* str, SZ size)
+{
+    unsigned lead = str[0];
+    unsigned lo = 0x80;
+    unsigned hi = 0xbf;
+    int len;
+    int i;
 
-        sprintf(buffer, "Alloced %u bytes for marks buffer.",
-                    (unsigned)(ctx->alloc_marks * sizeof(MD_MARK)));
-        MD_LOG(buffer);
+    if(lead <= 0x7f)
+        return 1;
+
+    if(0xc2 <= lead  &&  lead <= 0xdf) {
+        len = 2;
+    } else if(0xe0 <= lead  &&  lead <= 0xef) {
+        len = 3;
+        if(lead == 0xe0)
+            lo = 0xa0;      /* Overlong. */
+        else if(lead == 0xed)
+            hi = 0x9f;      /* Surrogate. */
+    } else if(0xf0 <= lead  &&  lead <= 0xf4) {
+        len = 4;
+        if(lead == 0xf0)
+            lo = 0x90;      /* Overlong. */
+        else if(lead == 0xf4)
+            hi = 0x8f;      /* Beyond U+10FFFF. */
+    } else {
+        return -1;
+    }
 
-        sprintf(buffer, "Alloced %u bytes for aux. buffer.",
-                    (unsigned)(ctx->alloc_buffer * sizeof(MD_CHAR)));
-        MD_LOG(buffer);
+    for(i = 1; i < len; i++) {
+        if(i >= size)
+            return 0;
+        if(str[i] < lo  ||  str[i] > hi)
+            return -i;
+        lo = 0x80;
+        hi = 0xbf;
     }
-#endif
 
-    return ret;
+    return len;
 }
 
+/* Get length of the valid part of str[0 .. size), i.e. offset of the first
+ * sequence which is invalid or cut by the end of the string. */
+static SZ
+md_utf8_valid_prefix_scalar(const unsigned char* str, SZ size)
+{
+    SZ off = 0;
 
-/********************
- ***  Public API  ***
- ********************/
+    while(off < size) {
+        int n;
 
-int
-md_parse(const MD_CHAR* text, MD_SIZE size, const MD_RENDERER* renderer, void* userdata)
+        if(str[off] <= 0x7f) {
+            off++;
+            continue;
+        }
+
+        n = md_utf8_check_seq(str + off, size - off);
+        if(n <= 0)
+            break;
+        off += n;
+    }
+
+    return off;
+}
+
+#ifdef MD4C_SIMD_X86
+/* The vectorized variants check 16 (or 32) bytes at once, using the lookup
+ * algorithm of Keiser and Lemire ("Validating UTF-8 In Less Than One
+ * Instruction Per Byte"): Each error in a 2-byte window is identified by
+ * the high nibble of the 1st byte, the low nibble of the 1st byte and the
+ * high nibble of the 2nd byte, each of which is used as an index into a
+ * table (PSHUFB) of bits of the errors it may take part in. Only the 3rd
+ * and 4th bytes of longer sequences have to be checked separately.
+ *
+ * On any error, we only go back to the start of the sequence and let
+ * md_utf8_valid_prefix_scalar() find where exactly it is. */
+#define MD_UTF8_TOO_SHORT       0x01    /* Lead byte (or ASCII) followed by a lead byte (or ASCII). */
+#define MD_UTF8_TOO_LONG        0x02    /* ASCII followed by a continuation byte. */
+#define MD_UTF8_OVERLONG_3      0x04
+#define MD_UTF8_TOO_LARGE       0x08
+#define MD_UTF8_SURROGATE       0x10
+#define MD_UTF8_OVERLONG_2      0x20
+#define MD_UTF8_TOO_LARGE_1000  0x40
+#define MD_UTF8_OVERLONG_4      0x40
+#define MD_UTF8_TWO_CONTS       0x80    /* Two continuation bytes (which is fine for 3rd or 4th byte). */
+#define MD_UTF8_CARRY           (MD_UTF8_TOO_SHORT | MD_UTF8_TOO_LONG | MD_UTF8_TWO_CONTS)
+
+static const unsigned char md_utf8_byte1_high[16] = {
+    MD_UTF8_TOO_LONG, MD_UTF8_TOO_LONG, MD_UTF8_TOO_LONG, MD_UTF8_TOO_LONG,
+    MD_UTF8_TOO_LONG, MD_UTF8_TOO_LONG, MD_UTF8_TOO_LONG, MD_UTF8_TOO_LONG,
+    MD_UTF8_TWO_CONTS, MD_UTF8_TWO_CONTS, MD_UTF8_TWO_CONTS, MD_UTF8_TWO_CONTS,
+    MD_UTF8_TOO_SHORT | MD_UTF8_OVERLONG_2,
+    MD_UTF8_TOO_SHORT,
+    MD_UTF8_TOO_SHORT | MD_UTF8_OVERLONG_3 | MD_UTF8_SURROGATE,
+    MD_UTF8_TOO_SHORT | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000 | MD_UTF8_OVERLONG_4
+};
+
+static const unsigned char md_utf8_byte1_low[16] = {
+    MD_UTF8_CARRY | MD_UTF8_OVERLONG_3 | MD_UTF8_OVERLONG_2 | MD_UTF8_OVERLONG_4,
+    MD_UTF8_CARRY | MD_UTF8_OVERLONG_2,
+    MD_UTF8_CARRY,
+    MD_UTF8_CARRY,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000 | MD_UTF8_SURROGATE,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000,
+    MD_UTF8_CARRY | MD_UTF8_TOO_LARGE | MD_UTF8_TOO_LARGE_1000
+};
+
+static const unsigned char md_utf8_byte2_high[16] = {
+    MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT,
+    MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT,
+    MD_UTF8_TOO_LONG | MD_UTF8_OVERLONG_2 | MD_UTF8_TWO_CONTS | MD_UTF8_OVERLONG_3 | MD_UTF8_TOO_LARGE_1000 | MD_UTF8_OVERLONG_4,
+    MD_UTF8_TOO_LONG | MD_UTF8_OVERLONG_2 | MD_UTF8_TWO_CONTS | MD_UTF8_OVERLONG_3 | MD_UTF8_TOO_LARGE,
+    MD_UTF8_TOO_LONG | MD_UTF8_OVERLONG_2 | MD_UTF8_TWO_CONTS | MD_UTF8_SURROGATE | MD_UTF8_TOO_LARGE,
+    MD_UTF8_TOO_LONG | MD_UTF8_OVERLONG_2 | MD_UTF8_TWO_CONTS | MD_UTF8_SURROGATE | MD_UTF8_TOO_LARGE,
+    MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT, MD_UTF8_TOO_SHORT
+};
+
+/* The last bytes of a block which may start a sequence continuing in the
+ * next block are those greater then these. */
+static const unsigned char md_utf8_incomplete_max[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf
+};
+
+/* Go back from the end of the valid blocks to the start of the sequence
+ * which may continue beyond it, and finish the check in the scalar way. */
+static SZ
+md_utf8_valid_prefix_finish(const unsigned char* str, SZ size, SZ off)
 {
-    MD_CTX ctx;
     int i;
-    int ret;
 
-    /* Setup context structure. */
-    memset(&ctx, 0, sizeof(MD_CTX));
-    ctx.text = text;
-    ctx.size = size;
-    memcpy(&ctx.r, renderer, sizeof(MD_RENDERER));
-    ctx.userdata = userdata;
-    ctx.code_indent_offset = (ctx.r.flags & MD_FLAG_NOINDENTEDCODEBLOCKS) ? (OFF)(-1) : 4;
-    md_build_mark_char_map(&ctx);
+    for(i = 1; i <= 3  &&  i <= off; i++) {
+        if((str[off-i] & 0xc0) != 0x80) {
+            if(str[off-i] >= 0xc0)
+                off -= i;
+            break;
+        }
+    }
 
-    /* Reset all unresolved opener mark chains. */
-    for(i = 0; i < SIZEOF_ARRAY(ctx.mark_chains); i++) {
-        ctx.mark_chains[i].head = -1;
-        ctx.mark_chains[i].tail = -1;
+    return off + md_utf8_valid_prefix_scalar(str + off, size - off);
+}
+
+__attribute__((target("ssse3")))
+static SZ
+md_utf8_valid_prefix_ssse3(const unsigned char* str, SZ size)
+{
+    const __m128i byte1_high = _mm_loadu_si128((const __m128i*) md_utf8_byte1_high);
+    const __m128i byte1_low = _mm_loadu_si128((const __m128i*) md_utf8_byte1_low);
+    const __m128i byte2_high = _mm_loadu_si128((const __m128i*) md_utf8_byte2_high);
+    const __m128i incomplete_max = _mm_loadu_si128((const __m128i*) (md_utf8_incomplete_max + 16));
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    __m128i prev = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    SZ off = 0;
+
+    while(off + 16 <= size) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (str + off));
+
+        if(_mm_movemask_epi8(v) == 0) {
+            /* Only ASCII. Fine unless a sequence from the previous block
+             * is cut by it. */
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(prev_incomplete, _mm_setzero_si128())) != 0xffff)
+                break;
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(v, prev, 15);
+            __m128i prev2 = _mm_alignr_epi8(v, prev, 14);
+            __m128i prev3 = _mm_alignr_epi8(v, prev, 13);
+            __m128i err, must23;
+
+            err = _mm_and_si128(
+                    _mm_and_si128(
+                        _mm_shuffle_epi8(byte1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble_mask)),
+                        _mm_shuffle_epi8(byte1_low, _mm_and_si128(prev1, nibble_mask))),
+                    _mm_shuffle_epi8(byte2_high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask)));
+
+            /* The 3rd and 4th bytes must be continuations (two of them in a
+             * row are then not an error). */
+            must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xe0 - 0x80))),
+                                  _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xf0 - 0x80))));
+            err = _mm_xor_si128(err, _mm_and_si128(must23, _mm_set1_epi8((char) 0x80)));
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(err, _mm_setzero_si128())) != 0xffff)
+                break;
+
+            prev_incomplete = _mm_subs_epu8(v, incomplete_max);
+        }
+
+        prev = v;
+        off += 16;
     }
-    ctx.unresolved_link_head = -1;
-    ctx.unresolved_link_tail = -1;
 
-    /* All the work. */
-    ret = md_process_doc(&ctx);
+    return md_utf8_valid_prefix_finish(str, size, off);
+}
 
-    /* Clean-up. */
-    md_free_link_ref_defs(&ctx);
-    free(ctx.buffer);
-    free(ctx.marks);
-    free(ctx.block_bytes);
-    free(ctx.containers);
+__attribute__((target("avx2")))
+static SZ
+md_utf8_valid_prefix_avx2(const unsigned char* str, SZ size)
+{
+    const __m256i byte1_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) md_utf8_byte1_high));
+    const __m256i byte1_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) md_utf8_byte1_low));
+    const __m256i byte2_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) md_utf8_byte2_high));
+    const __m256i incomplete_max = _mm256_loadu_si256((const __m256i*) md_utf8_incomplete_max);
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    __m256i prev = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    SZ off = 0;
+
+    while(off + 32 <= size) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (str + off));
+
+        if(_mm256_movemask_epi8(v) == 0) {
+            if(!_mm256_testz_si256(prev_incomplete, prev_incomplete))
+                break;
+        } else {
+            /* (PALIGNR works within the 128-bit lanes only, so the bytes
+             * preceding the upper lane have to be brought in first.) */
+            __m256i shifted = _mm256_permute2x128_si256(prev, v, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(v, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(v, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(v, shifted, 13);
+            __m256i err, must23;
+
+            err = _mm256_and_si256(
+                    _mm256_and_si256(
+                        _mm256_shuffle_epi8(byte1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble_mask)),
+                        _mm256_shuffle_epi8(byte1_low, _mm256_and_si256(prev1, nibble_mask))),
+                    _mm256_shuffle_epi8(byte2_high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble_mask)));
+
+            must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xe0 - 0x80))),
+                                     _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xf0 - 0x80))));
+            err = _mm256_xor_si256(err, _mm256_and_si256(must23, _mm256_set1_epi8((char) 0x80)));
+            if(!_mm256_testz_si256(err, err))
+                break;
 
-    return ret;
+            prev_incomplete = _mm256_subs_epu8(v, incomplete_max);
+        }
+
+        prev = v;
+        off += 32;
+    }
+
+    return md_utf8_valid_prefix_finish(str, size, off);
+}
+#endif  /* MD4C_SIMD_X86 */
+
+/* Get length of the valid part of str[0 .. size), i.e. offset of the first
+ * sequence which is invalid or cut by the end of the string. */
+static SZ
+md_utf8_valid_prefix(const unsigned char* str, SZ size)
+{
+#ifdef MD4C_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return md_utf8_valid_prefix_avx2(str, size);
+    if(__builtin_cpu_supports("ssse3"))
+        return md_utf8_valid_prefix_ssse3(str, size);
+#endif
+    return md_utf8_valid_prefix_scalar(str, size);
+}
+
+
+/************************
+ ***  Parser Context  ***
+ ************************/
+
+/* See md_parser_edit(). */
+typedef struct MD_DOC_CHUNK_tag MD_DOC_CHUNK;
+struct MD_DOC_CHUNK_tag {
+    OFF end;            /* (Start of a chunk is the end of the previous one.) */
+    int n_blocks;       /* Count of top-level blocks in the chunk. */
+    int n_ref_defs;     /* Count of link reference definitions in the chunk. */
+};
+
+/* A recorded event. See md_tape_record(). */
+typedef struct MD_TAPE_EVENT_tag MD_TAPE_EVENT;
+struct MD_TAPE_EVENT_tag {
+    unsigned char event;    /* MD_EVENTTYPE */
+    unsigned char type;     /* MD_BLOCKTYPE, MD_SPANTYPE or MD_TEXTTYPE */
+    unsigned char flags;    /* MD_TAPE_EVENT_xxxx */
+    OFF off;                /* Offset of the detail or the text in the arena (or of the text in the document). */
+    SZ size;                /* Size of the detail or the text. */
+};
+
+/* Recorded callbacks. See md_parse_to_tape(). */
+struct MD_TAPE_tag {
+    MD_ALLOCATOR allocator;
+
+    /* The document the text events refer to, and the parser flags it has
+     * been parsed with. */
+    const CHAR* text;
+    SZ size;
+    unsigned flags;
+    CHAR* own_text;     /* Repaired copy of the document (see MD_FLAG_VALIDATEUTF8). */
+
+    MD_TAPE_EVENT* events;
+    SZ n_events;
+    SZ alloc_events;
+
+    char* arena;
+    SZ arena_size;
+    SZ alloc_arena;
+};
+
+/* Parser of a part of the document. See md_parallel_run(). */
+typedef struct MD_WORKER_tag MD_WORKER;
+struct MD_WORKER_tag {
+    MD_CTX ctx;
+    OFF beg;                /* The part of the document. */
+    OFF end;
+    int is_merged;          /* Set if the preceding worker has taken the part over. */
+
+    /* Line analysis state. */
+    const MD_LINE_ANALYSIS* pivot_line;
+    MD_LINE_ANALYSIS* line;
+    MD_LINE_ANALYSIS line_buf[2];
+
+    /* Own buffers of the link reference definitions, set aside while the
+     * worker uses the ones of the main context. */
+    MD_LINK_REF_DEF* own_link_ref_defs;
+    int own_alloc_link_ref_defs;
+    int* own_ref_def_hashtable;
+    int own_alloc_ref_def_hashtable;
+    int* own_ref_def_labels;
+    int own_alloc_ref_def_labels;
+
+    MD_TAPE tape;
+    MD_STATS stats;
+
+    /* The function the worker runs (possibly in its own thread). */
+    int (*func)(MD_WORKER*);
+    int ret;
+    int is_running;
+#ifndef MD4C_NO_THREADS
+  #ifdef _WIN32
+    HANDLE thread;
+  #else
+    pthread_t thread;
+  #endif
+#endif
+};
+
+/* The parser object is just a context surviving between parsing of
+ * individual documents, so that all the growing buffers in MD_CTX can be
+ * reused. */
+struct MD_PARSER_tag {
+    MD_CTX ctx;
+    unsigned flags;
+    SZ high_water_mark;
+    MD_STATS* stats;
+
+    /* Input buffered by md_parser_feed(). It starts with the destinations of
+     * the link reference definitions seen so far (stream_keep bytes of it),
+     * followed by the text which has not been flushed yet. */
+    CHAR* stream_buf;
+    SZ stream_size;
+    SZ alloc_stream;
+    SZ stream_keep;
+    int n_kept_ref_defs;    /* How many definitions have their dest. kept. */
+    OFF stream_beg;         /* Start of the text not yet flushed. */
+    OFF stream_off;         /* Where the line analysis continues. */
+    int stream_ret;         /* Error status of the stream. */
+
+    /* Line analysis state surviving between md_parser_feed() calls. */
+    const MD_LINE_ANALYSIS* pivot_line;
+    MD_LINE_ANALYSIS* line;
+    MD_LINE_ANALYSIS line_buf[2];
+
+    /* Document kept by md_parser_load() for md_parser_edit(). */
+    CHAR* doc_text;
+    SZ doc_size;
+    SZ alloc_doc;
+    MD_DOC_CHUNK* doc_chunks;
+    int n_doc_chunks;
+    int alloc_doc_chunks;
+    MD_DOC_CHUNK* new_chunks;   /* Chunks found by (re-)parsing. */
+    int n_new_chunks;
+    int alloc_new_chunks;
+    int doc_is_loaded;
+
+    /* Parallel parsing (see md_parser_set_threads()). */
+    unsigned n_threads;
+    MD_WORKER* workers;
+    int alloc_workers;
+
+    /* Repaired copy of the input (see MD_FLAG_VALIDATEUTF8), and a UTF-8
+     * sequence cut by the end of the input fed so far (see md_utf8_repair()). */
+    CHAR* utf8_buf;
+    SZ utf8_size;
+    SZ alloc_utf8;
+    unsigned char utf8_tail[4];
+    int n_utf8_tail;
+};
+
+static void*
+md_default_alloc(MD_SIZE size, void* userdata)
+{
+    return malloc(size);
+}
+
+static void*
+md_default_resize(void* ptr, MD_SIZE old_size, MD_SIZE new_size, void* userdata)
+{
+    return realloc(ptr, new_size);
+}
+
+static void
+md_default_release(void* ptr, void* userdata)
+{
+    free(ptr);
+}
+
+static const MD_ALLOCATOR md_default_allocator = {
+    md_default_alloc,
+    md_default_resize,
+    md_default_release,
+    NULL
+};
+
+static void
+md_parser_init(MD_PARSER* parser, unsigned flags, const MD_ALLOCATOR* allocator)
+{
+#ifdef MD4C_USE_UTF16
+    /* The input is not a UTF-8 at all. */
+    flags &= ~MD_FLAG_VALIDATEUTF8;
+#endif
+
+    memset(parser, 0, sizeof(MD_PARSER));
+    parser->flags = flags;
+    memcpy(&parser->ctx.allocator, allocator, sizeof(MD_ALLOCATOR));
+
+    /* The map depends only on the flags so we build it just once. */
+    parser->ctx.r.flags = flags;
+    md_build_mark_char_map(&parser->ctx);
+    md_setup_mark_scanner(&parser->ctx);
+    md_setup_pair_finder(&parser->ctx);
+}
+
+static void
+md_ctx_fini(MD_CTX* ctx)
+{
+    md_free_link_ref_defs(ctx);
+    md_free(ctx, ctx->link_ref_defs);
+    md_free(ctx, ctx->ref_def_hashtable);
+    md_free(ctx, ctx->ref_def_labels);
+    md_free(ctx, ctx->buffer);
+    md_free(ctx, ctx->text_buffer);
+    md_free(ctx, ctx->marks);
+    md_free(ctx, ctx->block_bytes);
+    md_free(ctx, ctx->containers);
+    md_free(ctx, ctx->line_ends);
+}
+
+static void
+md_parser_fini(MD_PARSER* parser)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int i;
+
+    for(i = 0; i < parser->alloc_workers; i++) {
+        md_ctx_fini(&parser->workers[i].ctx);
+        md_free(ctx, parser->workers[i].tape.events);
+        md_free(ctx, parser->workers[i].tape.arena);
+    }
+    md_free(ctx, parser->workers);
+
+    md_ctx_fini(ctx);
+    md_free(ctx, parser->stream_buf);
+    md_free(ctx, parser->doc_text);
+    md_free(ctx, parser->doc_chunks);
+    md_free(ctx, parser->new_chunks);
+    md_free(ctx, parser->utf8_buf);
+}
+
+/* Release any buffer which has grown beyond the high water mark. */
+static void
+md_ctx_trim(MD_CTX* ctx, SZ max_bytes)
+{
+    if(ctx->alloc_link_ref_defs * sizeof(MD_LINK_REF_DEF) > max_bytes) {
+        md_free(ctx, ctx->link_ref_defs);
+        ctx->link_ref_defs = NULL;
+        ctx->alloc_link_ref_defs = 0;
+    }
+    if(ctx->alloc_ref_def_hashtable * sizeof(int) > max_bytes) {
+        md_free(ctx, ctx->ref_def_hashtable);
+        ctx->ref_def_hashtable = NULL;
+        ctx->alloc_ref_def_hashtable = 0;
+    }
+    if(ctx->alloc_ref_def_labels * sizeof(int) > max_bytes) {
+        md_free(ctx, ctx->ref_def_labels);
+        ctx->ref_def_labels = NULL;
+        ctx->alloc_ref_def_labels = 0;
+    }
+    if(ctx->alloc_buffer * sizeof(CHAR) > max_bytes) {
+        md_free(ctx, ctx->buffer);
+        ctx->buffer = NULL;
+        ctx->alloc_buffer = 0;
+    }
+    if(ctx->alloc_text_buffer * sizeof(CHAR) > max_bytes) {
+        md_free(ctx, ctx->text_buffer);
+        ctx->text_buffer = NULL;
+        ctx->alloc_text_buffer = 0;
+    }
+    if(ctx->alloc_marks * sizeof(MD_MARK) > max_bytes) {
+        md_free(ctx, ctx->marks);
+        ctx->marks = NULL;
+        ctx->alloc_marks = 0;
+    }
+    if(ctx->alloc_block_bytes > max_bytes) {
+        md_free(ctx, ctx->block_bytes);
+        ctx->block_bytes = NULL;
+        ctx->alloc_block_bytes = 0;
+    }
+    if(ctx->alloc_containers * sizeof(MD_CONTAINER) > max_bytes) {
+        md_free(ctx, ctx->containers);
+        ctx->containers = NULL;
+        ctx->alloc_containers = 0;
+    }
+    if(ctx->alloc_lines * sizeof(OFF) > max_bytes) {
+        md_free(ctx, ctx->line_ends);
+        ctx->line_ends = NULL;
+        ctx->alloc_lines = 0;
+    }
+}
+
+static void
+md_parser_trim(MD_PARSER* parser)
+{
+    MD_CTX* ctx = &parser->ctx;
+    SZ max_bytes = parser->high_water_mark;
+    int i;
+
+    /* Everything is still needed when a document is loaded (see
+     * md_parser_load()). */
+    if(max_bytes == 0  ||  parser->doc_is_loaded)
+        return;
+
+    md_ctx_trim(ctx, max_bytes);
+    for(i = 0; i < parser->alloc_workers; i++) {
+        MD_WORKER* w = &parser->workers[i];
+
+        md_ctx_trim(&w->ctx, max_bytes);
+        if(w->tape.alloc_events * sizeof(MD_TAPE_EVENT) > max_bytes) {
+            md_free(ctx, w->tape.events);
+            w->tape.events = NULL;
+            w->tape.alloc_events = 0;
+        }
+        if(w->tape.alloc_arena > max_bytes) {
+            md_free(ctx, w->tape.arena);
+            w->tape.arena = NULL;
+            w->tape.alloc_arena = 0;
+        }
+    }
+
+    if(parser->alloc_stream * sizeof(CHAR) > max_bytes) {
+        md_free(ctx, parser->stream_buf);
+        parser->stream_buf = NULL;
+        parser->alloc_stream = 0;
+    }
+    if(parser->alloc_doc * sizeof(CHAR) > max_bytes) {
+        md_free(ctx, parser->doc_text);
+        parser->doc_text = NULL;
+        parser->alloc_doc = 0;
+    }
+    if(parser->alloc_doc_chunks * sizeof(MD_DOC_CHUNK) > max_bytes) {
+        md_free(ctx, parser->doc_chunks);
+        parser->doc_chunks = NULL;
+        parser->alloc_doc_chunks = 0;
+    }
+    if(parser->alloc_new_chunks * sizeof(MD_DOC_CHUNK) > max_bytes) {
+        md_free(ctx, parser->new_chunks);
+        parser->new_chunks = NULL;
+        parser->alloc_new_chunks = 0;
+    }
+    if(parser->alloc_utf8 * sizeof(CHAR) > max_bytes) {
+        md_free(ctx, parser->utf8_buf);
+        parser->utf8_buf = NULL;
+        parser->alloc_utf8 = 0;
+    }
+}
+
+/* Forget the document loaded by md_parser_load(), if any. */
+static void
+md_parser_unload(MD_PARSER* parser)
+{
+    if(parser->doc_is_loaded) {
+        md_free_link_ref_defs(&parser->ctx);
+        parser->doc_is_loaded = FALSE;
+    }
+}
+
+/* Select the instantiations of the hottest functions (md_analyze_line() and
+ * md_collect_marks()) for ctx->r.flags. Only the flags in MD_SPEC_MASK
+ * matter: Any other flag does not affect them. For the common flag sets, the
+ * compiler has folded away all the tests of the flags. Define
+ * MD4C_NO_SPECIALIZATION to build only the generic instantiations. */
+static void
+md_setup_specialized(MD_CTX* ctx)
+{
+    ctx->analyze_line = md_analyze_line;
+    ctx->collect_marks = md_collect_marks;
+
+#ifndef MD4C_NO_SPECIALIZATION
+    switch(ctx->r.flags & MD_SPEC_MASK) {
+        case MD_SPEC_COMMONMARK:
+            ctx->analyze_line = md_analyze_line_commonmark;
+            ctx->collect_marks = md_collect_marks_commonmark;
+            break;
+
+        case MD_SPEC_GITHUB:
+            ctx->analyze_line = md_analyze_line_github;
+            ctx->collect_marks = md_collect_marks_github;
+            break;
+    }
+#endif
+}
+
+/* Setup the context for a new document. Only the per-document state is
+ * reset here; the buffers are reused as they are. */
+static void
+md_ctx_reset(MD_CTX* ctx, const MD_RENDERER* renderer, void* userdata, unsigned flags)
+{
+    int i;
+
+    memcpy(&ctx->r, renderer, sizeof(MD_RENDERER));
+    ctx->r.flags = flags;
+    ctx->userdata = userdata;
+    md_setup_specialized(ctx);
+
+    ctx->n_marks = 0;
+    ctx->text_size = 0;
+    ctx->n_block_bytes = 0;
+    ctx->container_block_bytes_end = 0;
+    ctx->current_block = NULL;
+    ctx->n_containers = 0;
+    ctx->last_line_has_list_loosening_effect = FALSE;
+    ctx->last_list_item_starts_with_two_blank_lines = FALSE;
+    ctx->code_fence_length = 0;
+    ctx->html_block_type = 0;
+
+    /* Reset all unresolved opener mark chains. */
+    for(i = 0; i < SIZEOF_ARRAY(ctx->mark_chains); i++) {
+        ctx->mark_chains[i].head = -1;
+        ctx->mark_chains[i].tail = -1;
+    }
+    for(i = 0; i < SIZEOF_ARRAY(ctx->backtick_openers); i++)
+        ctx->backtick_openers[i] = -1;
+    ctx->unresolved_link_head = -1;
+    ctx->unresolved_link_tail = -1;
+    ctx->text_is_volatile = FALSE;
+}
+
+static void
+md_parser_reset(MD_PARSER* parser, const MD_RENDERER* renderer, void* userdata)
+{
+    md_ctx_reset(&parser->ctx, renderer, userdata, parser->flags);
+}
+
+/* Append the string to parser->utf8_buf. */
+static int
+md_utf8_put(MD_PARSER* parser, const CHAR* str, SZ size)
+{
+    MD_CTX* ctx = &parser->ctx;
+
+    if(size == 0)
+        return 0;
+
+    if(parser->utf8_size + size > parser->alloc_utf8) {
+        CHAR* new_utf8_buf;
+        SZ new_alloc = (parser->alloc_utf8 > 0 ? parser->alloc_utf8 : 4096);
+
+        while(new_alloc < parser->utf8_size + size)
+            new_alloc *= 2;
+
+        new_utf8_buf = (CHAR*) md_realloc(ctx, parser->utf8_buf,
+                    parser->alloc_utf8 * sizeof(CHAR), new_alloc * sizeof(CHAR));
+        if(new_utf8_buf == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        parser->utf8_buf = new_utf8_buf;
+        parser->alloc_utf8 = new_alloc;
+    }
+
+    memcpy(parser->utf8_buf + parser->utf8_size, str, size * sizeof(CHAR));
+    parser->utf8_size += size;
+    return 0;
+}
+
+/* Append the text to parser->utf8_buf, with each invalid UTF-8 sequence
+ * replaced with U+FFFD.
+ *
+ * The text may be just a part of the input: A sequence cut by its end is kept
+ * in parser->utf8_tail, to be completed by the text appended next, unless
+ * is_final is set (then it is invalid). */
+static int
+md_utf8_repair(MD_PARSER* parser, const CHAR* text, SZ size, int is_final)
+{
+    static const CHAR replacement[] = { _T('\xef'), _T('\xbf'), _T('\xbd') };
+    const unsigned char* str = (const unsigned char*) text;
+    OFF off = 0;
+    int ret = 0;
+
+    /* Complete the sequence left from the previous call, byte by byte: Until
+     * it is complete, it is a valid one, so a byte which breaks it (and which
+     * then starts another sequence) is the end of its maximal valid part. */
+    while(parser->n_utf8_tail > 0  &&  off < size) {
+        int n;
+
+        parser->utf8_tail[parser->n_utf8_tail++] = str[off];
+        n = md_utf8_check_seq(parser->utf8_tail, parser->n_utf8_tail);
+        if(n > 0) {
+            MD_CHECK(md_utf8_put(parser, (const CHAR*) parser->utf8_tail, n));
+            parser->n_utf8_tail = 0;
+            off++;
+        } else if(n < 0) {
+            MD_CHECK(md_utf8_put(parser, replacement, SIZEOF_ARRAY(replacement)));
+            parser->n_utf8_tail = 0;
+        } else {
+            off++;
+        }
+    }
+
+    while(off < size) {
+        SZ n_valid = md_utf8_valid_prefix(str + off, size - off);
+        int n;
+
+        MD_CHECK(md_utf8_put(parser, text + off, n_valid));
+        off += n_valid;
+        if(off >= size)
+            break;
+
+        n = md_utf8_check_seq(str + off, size - off);
+        if(n == 0) {
+            /* Cut by the end of the text. */
+            memcpy(parser->utf8_tail, str + off, size - off);
+            parser->n_utf8_tail = size - off;
+            break;
+        }
+
+        MD_CHECK(md_utf8_put(parser, replacement, SIZEOF_ARRAY(replacement)));
+        off += -n;
+    }
+
+    if(is_final  &&  parser->n_utf8_tail > 0) {
+        MD_CHECK(md_utf8_put(parser, replacement, SIZEOF_ARRAY(replacement)));
+        parser->n_utf8_tail = 0;
+    }
+
+abort:
+    return ret;
+}
+
+/* If MD_FLAG_VALIDATEUTF8 is set and the text is not a valid UTF-8, replace it
+ * with its repaired copy in parser->utf8_buf. */
+static int
+md_parser_validate_utf8(MD_PARSER* parser, const CHAR** p_text, SZ* p_size)
+{
+    int ret = 0;
+
+    if(!(parser->flags & MD_FLAG_VALIDATEUTF8))
+        return 0;
+    if(md_utf8_valid_prefix((const unsigned char*) *p_text, *p_size) == *p_size)
+        return 0;
+
+    parser->utf8_size = 0;
+    parser->n_utf8_tail = 0;
+    MD_CHECK(md_utf8_repair(parser, *p_text, *p_size, TRUE));
+    *p_text = parser->utf8_buf;
+    *p_size = parser->utf8_size;
+
+abort:
+    return ret;
+}
+
+static int md_parallel_run(MD_PARSER* parser);
+
+static int
+md_parser_run(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size,
+              const MD_RENDERER* renderer, void* userdata)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int ret;
+
+    md_parser_unload(parser);
+    md_parser_reset(parser, renderer, userdata);
+    if(md_parser_validate_utf8(parser, &text, &size) != 0)
+        return -1;
+    ctx->text = text;
+    ctx->size = size;
+
+    if(parser->stats != NULL) {
+        memset(parser->stats, 0, sizeof(MD_STATS));
+        ctx->stats = parser->stats;
+    }
+
+    /* All the work. */
+    if(parser->n_threads > 1)
+        ret = md_parallel_run(parser);
+    else
+        ret = md_process_doc(ctx);
+    ctx->stats = NULL;
+
+    /* Clean-up. */
+    md_free_link_ref_defs(ctx);
+    md_parser_trim(parser);
+
+    return ret;
+}
+
+
+/*******************
+ ***  Streaming  ***
+ *******************/
+
+/* When the input is fed in chunks (md_parser_feed()), we analyze every
+ * complete line as soon as it is available. Whenever we get past a line after
+ * which no container and no leaf block remains open, nothing which follows
+ * can change the blocks seen so far (e.g. make a Setext header or a table of
+ * them, or make a list loose). So we flush them: Their inlines get processed
+ * and they are passed to the renderer, and their text is not needed anymore.
+ *
+ * The link reference definitions have to survive that. Their labels and
+ * titles are copies anyway (see MD_CTX::text_is_volatile); their destinations
+ * are moved to the start of the buffer when we discard the flushed text.
+ */
+
+static int
+md_stream_append(MD_PARSER* parser, const CHAR* text, SZ size)
+{
+    MD_CTX* ctx = &parser->ctx;
+
+    if(size == 0)
+        return 0;
+
+    if(parser->stream_size + size > parser->alloc_stream) {
+        CHAR* new_stream_buf;
+        SZ new_alloc = (parser->alloc_stream > 0 ? parser->alloc_stream : 4096);
+
+        while(new_alloc < parser->stream_size + size)
+            new_alloc *= 2;
+
+        new_stream_buf = (CHAR*) md_realloc(ctx, parser->stream_buf,
+                    parser->alloc_stream * sizeof(CHAR), new_alloc * sizeof(CHAR));
+        if(new_stream_buf == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        parser->stream_buf = new_stream_buf;
+        parser->alloc_stream = new_alloc;
+    }
+
+    memcpy(parser->stream_buf + parser->stream_size, text, size * sizeof(CHAR));
+    parser->stream_size += size;
+    return 0;
+}
+
+/* Find end of the last complete line in the buffer. Only <beg, stream_size)
+ * is searched for a line break, as we already know there is none in the
+ * preceding text not yet analyzed. Note a trailing '\r' does not end a line
+ * yet as it may be the first half of "\r\n". */
+static OFF
+md_stream_lines_end(MD_PARSER* parser, OFF beg)
+{
+    const CHAR* buf = parser->stream_buf;
+    OFF off = parser->stream_size;
+
+    if(off > beg  &&  buf[off-1] == _T('\r'))
+        off--;
+
+    while(off > beg) {
+        if(buf[off-1] == _T('\n')  ||  buf[off-1] == _T('\r'))
+            return off;
+        off--;
+    }
+
+    return parser->stream_off;
+}
+
+/* Discard the text preceding parser->stream_off which has been flushed.
+ * Only the destinations of the link reference definitions are preserved, and
+ * also the line break just before stream_off so that the subsequent text
+ * still sees the start of a line before itself. */
+static void
+md_stream_discard(MD_PARSER* parser)
+{
+    MD_CTX* ctx = &parser->ctx;
+    CHAR* buf = parser->stream_buf;
+    OFF off = parser->stream_keep;
+    int i;
+
+    MD_ASSERT(parser->stream_off > 0);
+
+    for(i = parser->n_kept_ref_defs; i < ctx->n_link_ref_defs; i++) {
+        MD_LINK_REF_DEF* def = &ctx->link_ref_defs[i];
+        SZ len = def->dest_end - def->dest_beg;
+
+        memmove(buf + off, buf + def->dest_beg, len * sizeof(CHAR));
+        def->dest_beg = off;
+        def->dest_end = off + len;
+        off += len;
+    }
+    parser->n_kept_ref_defs = ctx->n_link_ref_defs;
+    parser->stream_keep = off;
+
+    memmove(buf + off, buf + parser->stream_off - 1,
+            (parser->stream_size - parser->stream_off + 1) * sizeof(CHAR));
+    parser->stream_size = off + 1 + (parser->stream_size - parser->stream_off);
+    parser->stream_beg = off + 1;
+    parser->stream_off = off + 1;
+}
+
+/* Analyze all lines up to lines_end and flush the blocks whenever possible. */
+static int
+md_stream_process(MD_PARSER* parser, OFF lines_end)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int ret = 0;
+
+again:
+    ctx->text = parser->stream_buf;
+    ctx->size = lines_end;
+    MD_CHECK(md_build_line_index(ctx, parser->stream_off));
+
+    while(parser->stream_off < ctx->size) {
+        if(parser->line == parser->pivot_line) {
+            parser->line = (parser->line == &parser->line_buf[0]
+                                ? &parser->line_buf[1] : &parser->line_buf[0]);
+        }
+
+        MD_CHECK(ctx->analyze_line(ctx, parser->stream_off, &parser->stream_off,
+                    parser->pivot_line, parser->line));
+        MD_CHECK(md_process_line(ctx, &parser->pivot_line, parser->line));
+
+        if(ctx->current_block == NULL  &&  ctx->n_containers == 0) {
+            MD_CHECK(md_process_all_blocks(ctx));
+
+            /* Get rid of the flushed text. But to stay linear, only if we
+             * discard at least as much as we have to move. */
+            if(parser->stream_off - parser->stream_beg >= parser->stream_size - parser->stream_off) {
+                OFF old_off = parser->stream_off;
+
+                md_stream_discard(parser);
+                lines_end -= old_off - parser->stream_off;
+                goto again;
+            }
+
+            parser->stream_beg = parser->stream_off;
+        }
+    }
+
+abort:
+    return ret;
+}
+
+static int
+md_stream_begin(MD_PARSER* parser, const MD_RENDERER* renderer, void* userdata)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int ret = 0;
+
+    md_parser_unload(parser);
+    md_parser_reset(parser, renderer, userdata);
+    ctx->text_is_volatile = TRUE;
+    ctx->text = parser->stream_buf;
+    ctx->size = 0;
+    ctx->n_lines = 0;
+    ctx->current_line = 0;
+
+    parser->stream_size = 0;
+    parser->stream_keep = 0;
+    parser->n_kept_ref_defs = 0;
+    parser->n_utf8_tail = 0;
+    parser->stream_beg = 0;
+    parser->stream_off = 0;
+    parser->pivot_line = &md_dummy_blank_line;
+    parser->line = &parser->line_buf[0];
+
+    MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
+
+abort:
+    parser->stream_ret = ret;
+    return ret;
+}
+
+static int
+md_stream_feed(MD_PARSER* parser, const CHAR* text, SZ size)
+{
+    OFF old_size = parser->stream_size;
+    int ret = 0;
+
+    if(parser->stream_ret != 0)
+        return parser->stream_ret;
+
+    if((parser->flags & MD_FLAG_VALIDATEUTF8)  &&  (parser->n_utf8_tail > 0  ||
+       md_utf8_valid_prefix((const unsigned char*) text, size) < size))
+    {
+        parser->utf8_size = 0;
+        MD_CHECK(md_utf8_repair(parser, text, size, FALSE));
+        text = parser->utf8_buf;
+        size = parser->utf8_size;
+    }
+
+    MD_CHECK(md_stream_append(parser, text, size));
+
+    /* We know there is no line break in the text we have not analyzed yet,
+     * except for a possible trailing '\r'. */
+    MD_CHECK(md_stream_process(parser, md_stream_lines_end(parser,
+                (old_size > parser->stream_off ? old_size - 1 : parser->stream_off))));
+
+abort:
+    parser->stream_ret = ret;
+    return ret;
+}
+
+static int
+md_stream_finish(MD_PARSER* parser)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int ret = parser->stream_ret;
+
+    if(ret != 0)
+        goto abort;
+
+    /* A UTF-8 sequence cut by the end of the input is invalid. */
+    if(parser->n_utf8_tail > 0) {
+        parser->utf8_size = 0;
+        MD_CHECK(md_utf8_repair(parser, NULL, 0, TRUE));
+        MD_CHECK(md_stream_append(parser, parser->utf8_buf, parser->utf8_size));
+    }
+
+    /* Whatever remains, including the last line without a line break. */
+    MD_CHECK(md_stream_process(parser, parser->stream_size));
+
+    md_end_current_block(ctx);
+    MD_CHECK(md_leave_child_containers(ctx, 0));
+    MD_CHECK(md_process_all_blocks(ctx));
+
+    MD_LEAVE_BLOCK(MD_BLOCK_DOC, NULL);
+
+abort:
+    /* Clean-up. */
+    md_free_link_ref_defs(ctx);
+    ctx->text_is_volatile = FALSE;
+    parser->stream_size = 0;
+    parser->stream_ret = 0;
+    md_parser_trim(parser);
+
+    return ret;
+}
+
+
+/*****************************
+ ***  Incremental Parsing  ***
+ *****************************/
+
+/* md_parser_load() keeps a copy of the document, so that md_parser_edit() can
+ * later apply an edit to it and re-parse only the part of the document the
+ * edit may influence.
+ *
+ * For that we remember the chunks the document consists of. A chunk ends
+ * after a line after which no container and no leaf block remains open (the
+ * same condition md_stream_process() uses for flushing): The blocks before
+ * such line cannot be changed by anything which follows, and the analysis of
+ * the next line starts in the same state as at the start of the document.
+ *
+ * Hence after an edit we start the analysis at the start of the chunk where
+ * the edit begins, and we can stop as soon as we get (past the edit) to the
+ * end of a chunk which is also an end of some old chunk: From there on, the
+ * analysis would be the same as before. Only blocks of the chunks in between
+ * are then passed to the renderer.
+ *
+ * Link reference definitions may influence links anywhere in the document.
+ * So if there was, or there is, one in the re-parsed chunks, we re-parse the
+ * whole document.
+ */
+
+static int
+md_doc_push_chunk(MD_PARSER* parser, OFF end, int n_blocks, int n_ref_defs)
+{
+    MD_CTX* ctx = &parser->ctx;
+    MD_DOC_CHUNK* chunk;
+
+    /* Chunks with nothing interesting (i.e. made of blank lines) are merged
+     * into the preceding chunk. */
+    if(n_blocks == 0  &&  n_ref_defs == 0  &&  parser->n_new_chunks > 0) {
+        parser->new_chunks[parser->n_new_chunks - 1].end = end;
+        return 0;
+    }
+
+    if(parser->n_new_chunks >= parser->alloc_new_chunks) {
+        MD_DOC_CHUNK* new_new_chunks;
+        int new_alloc = (parser->alloc_new_chunks > 0 ? parser->alloc_new_chunks * 2 : 64);
+
+        new_new_chunks = (MD_DOC_CHUNK*) md_realloc(ctx, parser->new_chunks,
+                    parser->alloc_new_chunks * sizeof(MD_DOC_CHUNK),
+                    new_alloc * sizeof(MD_DOC_CHUNK));
+        if(new_new_chunks == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        parser->new_chunks = new_new_chunks;
+        parser->alloc_new_chunks = new_alloc;
+    }
+
+    chunk = &parser->new_chunks[parser->n_new_chunks++];
+    chunk->end = end;
+    chunk->n_blocks = n_blocks;
+    chunk->n_ref_defs = n_ref_defs;
+    return 0;
+}
+
+/* Count top-level blocks in ctx->block_bytes, starting at byte_off. */
+static int
+md_count_top_level_blocks(MD_CTX* ctx, SZ byte_off)
+{
+    int depth = 0;
+    int n = 0;
+
+    while(byte_off < ctx->n_block_bytes) {
+        MD_BLOCK* block = (MD_BLOCK*)((char*)ctx->block_bytes + byte_off);
+
+        if(block->flags & MD_BLOCK_CONTAINER) {
+            if(block->flags & MD_BLOCK_CONTAINER_CLOSER)
+                depth--;
+            if(block->flags & MD_BLOCK_CONTAINER_OPENER) {
+                if(depth == 0)
+                    n++;
+                depth++;
+            }
+        } else {
+            if(depth == 0)
+                n++;
+
+            if(block->type == MD_BLOCK_CODE || block->type == MD_BLOCK_HTML)
+                byte_off += block->n_lines * sizeof(MD_VERBATIMLINE);
+            else
+                byte_off += block->n_lines * sizeof(MD_LINE);
+        }
+
+        byte_off += sizeof(MD_BLOCK);
+    }
+
+    return n;
+}
+
+/* Get end of the line which contains the offset off. */
+static OFF
+md_doc_line_end(MD_PARSER* parser, OFF off)
+{
+    const CHAR* text = parser->doc_text;
+    SZ size = parser->doc_size;
+
+    while(off < size  &&  text[off] != _T('\n')  &&  text[off] != _T('\r'))
+        off++;
+    if(off < size  &&  text[off] == _T('\r'))
+        off++;
+    if(off < size  &&  text[off] == _T('\n'))
+        off++;
+    return off;
+}
+
+/* Analyze the document from beg (which has to be a chunk start) and record
+ * the chunks into parser->new_chunks. The blocks are left in ctx->block_bytes.
+ *
+ * If p_last is not NULL, we stop at the first chunk end at or after the
+ * offset resync_off which corresponds (in the document before the edit) to
+ * an end of some old chunk. Its index is then stored into *p_last (which
+ * has to be initialized to the index of the first old chunk re-parsed).
+ * If we get to the end of the document instead, it is the last old chunk.
+ */
+static int
+md_doc_analyze(MD_PARSER* parser, OFF beg, OFF resync_off,
+               SZ n_removed, SZ n_inserted, int* p_last)
+{
+    MD_CTX* ctx = &parser->ctx;
+    const MD_LINE_ANALYSIS* pivot_line = &md_dummy_blank_line;
+    MD_LINE_ANALYSIS line_buf[2];
+    MD_LINE_ANALYSIS* line = &line_buf[0];
+    OFF off = beg;
+    OFF chunk_beg = beg;
+    SZ window = 4096;
+    SZ chunk_bytes = 0;
+    int chunk_defs = ctx->n_link_ref_defs;
+    int ret = 0;
+
+    ctx->text = parser->doc_text;
+    ctx->size = beg;
+    ctx->n_block_bytes = 0;
+    ctx->container_block_bytes_end = 0;
+    ctx->current_block = NULL;
+    ctx->n_containers = 0;
+    ctx->last_line_has_list_loosening_effect = FALSE;
+    ctx->last_list_item_starts_with_two_blank_lines = FALSE;
+    ctx->code_fence_length = 0;
+    ctx->html_block_type = 0;
+    parser->n_new_chunks = 0;
+
+    while(off < parser->doc_size) {
+        /* Split only a part of the document into lines at a time. The part
+         * grows exponentially so we get to the end of a large re-parsed
+         * range quickly, yet we do not waste time on the rest of the
+         * document. */
+        if(off >= ctx->size) {
+            OFF end = (resync_off > off ? resync_off : off) + window;
+            window *= 2;
+            ctx->size = md_doc_line_end(parser, (end < parser->doc_size ? end : parser->doc_size));
+            MD_CHECK(md_build_line_index(ctx, off));
+        }
+
+        if(line == pivot_line)
+            line = (line == &line_buf[0] ? &line_buf[1] : &line_buf[0]);
+
+        MD_CHECK(ctx->analyze_line(ctx, off, &off, pivot_line, line));
+        MD_CHECK(md_process_line(ctx, &pivot_line, line));
+        if(MD_VERBATIM_FAST_PATH(ctx))
+            MD_CHECK(md_process_verbatim_lines(ctx, pivot_line, &off));
+
+        if(ctx->current_block == NULL  &&  ctx->n_containers == 0) {
+            MD_CHECK(md_doc_push_chunk(parser, off,
+                        md_count_top_level_blocks(ctx, chunk_bytes),
+                        ctx->n_link_ref_defs - chunk_defs));
+            chunk_beg = off;
+            chunk_bytes = ctx->n_block_bytes;
+            chunk_defs = ctx->n_link_ref_defs;
+
+            if(p_last != NULL  &&  off >= resync_off) {
+                OFF old_off = off - n_inserted + n_removed;
+
+                while(*p_last < parser->n_doc_chunks  &&  parser->doc_chunks[*p_last].end < old_off)
+                    (*p_last)++;
+                if(*p_last < parser->n_doc_chunks  &&  parser->doc_chunks[*p_last].end == old_off)
+                    goto abort;
+            }
+        }
+    }
+
+    /* We have reached the end of the document. */
+    md_end_current_block(ctx);
+    MD_CHECK(md_leave_child_containers(ctx, 0));
+    if(off > chunk_beg) {
+        MD_CHECK(md_doc_push_chunk(parser, off,
+                    md_count_top_level_blocks(ctx, chunk_bytes),
+                    ctx->n_link_ref_defs - chunk_defs));
+    }
+    if(p_last != NULL)
+        *p_last = parser->n_doc_chunks - 1;
+
+abort:
+    ctx->size = parser->doc_size;
+    return ret;
+}
+
+/* Replace the text <off, off + n_removed) of the loaded document with the
+ * inserted text. */
+static int
+md_doc_apply_edit(MD_PARSER* parser, OFF off, SZ n_removed,
+                  const CHAR* inserted, SZ n_inserted)
+{
+    MD_CTX* ctx = &parser->ctx;
+    SZ new_size = parser->doc_size - n_removed + n_inserted;
+    int i;
+
+    /* (+1 for a terminating NUL: The parser may peek one char beyond the end
+     * of the document, so make what it sees there well defined.) */
+    if(new_size + 1 > parser->alloc_doc) {
+        CHAR* new_doc_text;
+        SZ new_alloc = (parser->alloc_doc > 0 ? parser->alloc_doc : 4096);
+
+        while(new_alloc < new_size + 1)
+            new_alloc *= 2;
+
+        new_doc_text = (CHAR*) md_realloc(ctx, parser->doc_text,
+                    parser->alloc_doc * sizeof(CHAR), new_alloc * sizeof(CHAR));
+        if(new_doc_text == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        parser->doc_text = new_doc_text;
+        parser->alloc_doc = new_alloc;
+    }
+
+    memmove(parser->doc_text + off + n_inserted, parser->doc_text + off + n_removed,
+            (parser->doc_size - off - n_removed) * sizeof(CHAR));
+    if(n_inserted > 0)
+        memcpy(parser->doc_text + off, inserted, n_inserted * sizeof(CHAR));
+    parser->doc_text[new_size] = _T('\0');
+    parser->doc_size = new_size;
+
+    /* Update the link reference definitions after the edit. (Those in the
+     * edited chunk, if any, will be thrown away anyway.) */
+    for(i = 0; i < ctx->n_link_ref_defs; i++) {
+        MD_LINK_REF_DEF* def = &ctx->link_ref_defs[i];
+
+        if(def->dest_beg >= off + n_removed) {
+            def->dest_beg = def->dest_beg - n_removed + n_inserted;
+            def->dest_end = def->dest_end - n_removed + n_inserted;
+        }
+    }
+
+    return 0;
+}
+
+/* Replace the old chunks <first, last> with the new ones. The chunks after
+ * them are shifted by the edit. */
+static int
+md_doc_splice_chunks(MD_PARSER* parser, int first, int last,
+                     SZ n_removed, SZ n_inserted)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int n_tail = parser->n_doc_chunks - (last + 1);
+    int n = first + parser->n_new_chunks + n_tail;
+    int i;
+
+    if(n > parser->alloc_doc_chunks) {
+        MD_DOC_CHUNK* new_doc_chunks;
+        int new_alloc = (parser->alloc_doc_chunks > 0 ? parser->alloc_doc_chunks : 64);
+
+        while(new_alloc < n)
+            new_alloc *= 2;
+
+        new_doc_chunks = (MD_DOC_CHUNK*) md_realloc(ctx, parser->doc_chunks,
+                    parser->alloc_doc_chunks * sizeof(MD_DOC_CHUNK),
+                    new_alloc * sizeof(MD_DOC_CHUNK));
+        if(new_doc_chunks == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        parser->doc_chunks = new_doc_chunks;
+        parser->alloc_doc_chunks = new_alloc;
+    }
+
+    /* (Either array may still be NULL if there is nothing to copy.) */
+    if(n_tail > 0) {
+        memmove(parser->doc_chunks + first + parser->n_new_chunks, parser->doc_chunks + last + 1,
+                n_tail * sizeof(MD_DOC_CHUNK));
+    }
+    if(parser->n_new_chunks > 0) {
+        memcpy(parser->doc_chunks + first, parser->new_chunks,
+                parser->n_new_chunks * sizeof(MD_DOC_CHUNK));
+    }
+    for(i = first + parser->n_new_chunks; i < n; i++)
+        parser->doc_chunks[i].end = parser->doc_chunks[i].end - n_removed + n_inserted;
+    parser->n_doc_chunks = n;
+
+    return 0;
+}
+
+static int
+md_doc_load(MD_PARSER* parser, const CHAR* text, SZ size,
+            const MD_RENDERER* renderer, void* userdata)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int ret = 0;
+
+    md_parser_unload(parser);
+    md_parser_reset(parser, renderer, userdata);
+    ctx->text_is_volatile = TRUE;
+
+    parser->doc_size = 0;
+    parser->n_doc_chunks = 0;
+    MD_CHECK(md_parser_validate_utf8(parser, &text, &size));
+    MD_CHECK(md_doc_apply_edit(parser, 0, 0, text, size));
+
+    MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
+    MD_CHECK(md_doc_analyze(parser, 0, 0, 0, 0, NULL));
+    MD_CHECK(md_doc_splice_chunks(parser, 0, -1, 0, 0));
+    MD_CHECK(md_process_all_blocks(ctx));
+    MD_LEAVE_BLOCK(MD_BLOCK_DOC, NULL);
+
+    parser->doc_is_loaded = TRUE;
+
+abort:
+    if(ret != 0)
+        md_free_link_ref_defs(ctx);
+    return ret;
+}
+
+static int
+md_doc_edit(MD_PARSER* parser, OFF off, SZ n_removed, const CHAR* inserted, SZ n_inserted,
+            const MD_RENDERER* renderer, void* userdata, MD_EDIT_INFO* info)
+{
+    MD_CTX* ctx = &parser->ctx;
+    int first, last;
+    int n_ref_defs;
+    int i;
+    int ret = 0;
+
+    if(!parser->doc_is_loaded  ||  off > parser->doc_size  ||  n_removed > parser->doc_size - off)
+        return -1;
+
+    md_parser_reset(parser, renderer, userdata);
+    ctx->text_is_volatile = TRUE;
+
+    if(parser->flags & MD_FLAG_VALIDATEUTF8) {
+        /* The edit may cut a UTF-8 sequence in the (valid) document. So we
+         * extend it to the whole sequences on its both ends, and repair
+         * whatever they then become. */
+        const CHAR* doc = parser->doc_text;
+        OFF beg = off;
+        OFF end = off + n_removed;
+
+        while(beg > 0  &&  beg < parser->doc_size  &&  (doc[beg] & 0xc0) == 0x80)
+            beg--;
+        while(end < parser->doc_size  &&  (doc[end] & 0xc0) == 0x80)
+            end++;
+
+        if(beg < off  ||  end > off + n_removed  ||
+           md_utf8_valid_prefix((const unsigned char*) inserted, n_inserted) < n_inserted)
+        {
+            parser->utf8_size = 0;
+            parser->n_utf8_tail = 0;
+            MD_CHECK(md_utf8_repair(parser, doc + beg, off - beg, FALSE));
+            MD_CHECK(md_utf8_repair(parser, inserted, n_inserted, FALSE));
+            MD_CHECK(md_utf8_repair(parser, doc + off + n_removed, end - (off + n_removed), TRUE));
+            off = beg;
+            n_removed = end - beg;
+            inserted = parser->utf8_buf;
+            n_inserted = parser->utf8_size;
+        }
+    }
+
+    MD_CHECK(md_doc_apply_edit(parser, off, n_removed, inserted, n_inserted));
+
+    /* Find the first chunk which ends after the edit start. (If the edit is
+     * at the very end of the document, it is the last chunk as the edit may
+     * be appending to its last line.) */
+    {
+        int lo = 0;
+        int hi = parser->n_doc_chunks;
+
+        while(lo < hi) {
+            int pivot = (lo + hi) / 2;
+            if(parser->doc_chunks[pivot].end > off)
+                hi = pivot;
+            else
+                lo = pivot + 1;
+        }
+        first = lo;
+        if(first == parser->n_doc_chunks  &&  first > 0)
+            first--;
+
+        /* If the chunk starts right after '\r', the edit may turn it into
+         * "\r\n" and hence change the end of the preceding chunk. */
+        if(first > 0  &&  parser->doc_chunks[first-1].end == off  &&  off > 0  &&
+           parser->doc_text[off-1] == _T('\r'))
+            first--;
+    }
+
+    last = first;
+    n_ref_defs = ctx->n_link_ref_defs;
+    MD_CHECK(md_doc_analyze(parser, (first > 0 ? parser->doc_chunks[first-1].end : 0),
+                off + n_inserted, n_removed, n_inserted, &last));
+    n_ref_defs = ctx->n_link_ref_defs - n_ref_defs;
+
+    for(i = first; i <= last; i++)
+        n_ref_defs += parser->doc_chunks[i].n_ref_defs;
+    if(n_ref_defs > 0) {
+        /* A link reference definition has been (or is now) in the edited
+         * chunks. We have to re-parse everything. */
+        md_free_link_ref_defs(ctx);
+        first = 0;
+        last = parser->n_doc_chunks - 1;
+        MD_CHECK(md_doc_analyze(parser, 0, 0, 0, 0, NULL));
+    }
+
+    info->first_block = 0;
+    for(i = 0; i < first; i++)
+        info->first_block += parser->doc_chunks[i].n_blocks;
+    info->n_old_blocks = 0;
+    for(i = first; i <= last; i++)
+        info->n_old_blocks += parser->doc_chunks[i].n_blocks;
+    info->n_new_blocks = 0;
+    for(i = 0; i < parser->n_new_chunks; i++)
+        info->n_new_blocks += parser->new_chunks[i].n_blocks;
+
+    MD_CHECK(md_doc_splice_chunks(parser, first, last, n_removed, n_inserted));
+    MD_CHECK(md_process_all_blocks(ctx));
+
+abort:
+    if(ret != 0) {
+        md_free_link_ref_defs(ctx);
+        parser->doc_is_loaded = FALSE;
+    }
+    return ret;
+}
+
+
+/*************************
+ ***  Event Recording  ***
+ *************************/
+
+/* The callbacks may be recorded into a tape (MD_TAPE) and replayed later.
+ *
+ * The tape is an array of events (MD_TAPE_EVENT) and an arena. The details
+ * of blocks and spans are stored in the arena; strings in them (MD_ATTRIBUTE)
+ * are stored as MD_TAPE_ATTR followed by the arrays of substring offsets and
+ * types, and by the text itself. The text of MD_EVENT_TEXT is referred to
+ * directly in the document if it is a part of it. Otherwise it is copied into
+ * the arena.
+ *
+ * Everything in the arena is referred to by offsets, so the tape does not
+ * depend on where the arena (or the document) is located in memory.
+ */
+
+#define MD_TAPE_ALIGN           8
+#define MD_TAPE_ALIGNED(size)   (((size) + MD_TAPE_ALIGN - 1) & ~(SZ)(MD_TAPE_ALIGN - 1))
+
+/* MD_TAPE_EVENT::flags */
+#define MD_TAPE_EVENT_HASDETAIL 0x01    /* The detail passed to the callback was not NULL. */
+#define MD_TAPE_EVENT_INARENA   0x02    /* The text is stored in the arena. */
+
+typedef struct MD_TAPE_ATTR_tag MD_TAPE_ATTR;
+struct MD_TAPE_ATTR_tag {
+    SZ size;
+    SZ n_substrs;       /* (SZ)(-1) if the attribute has no substring arrays at all. */
+};
+
+/* Count of MD_ATTRIBUTEs in the detail of the block or span. (If non-zero,
+ * the detail is made of just them.) Other details are copied as they are. */
+static int
+md_tape_n_detail_attrs(int event, int type)
+{
+    if(event == MD_EVENT_ENTER_BLOCK  ||  event == MD_EVENT_LEAVE_BLOCK)
+        return (type == MD_BLOCK_CODE ? 2 : 0);
+    else
+        return (type == MD_SPAN_A  ||  type == MD_SPAN_IMG ? 2 : 0);
+}
+
+static SZ
+md_tape_detail_size(int event, int type)
+{
+    if(event == MD_EVENT_ENTER_BLOCK  ||  event == MD_EVENT_LEAVE_BLOCK) {
+        switch(type) {
+            case MD_BLOCK_UL:   return sizeof(MD_BLOCK_UL_DETAIL);
+            case MD_BLOCK_OL:   return sizeof(MD_BLOCK_OL_DETAIL);
+            case MD_BLOCK_H:    return sizeof(MD_BLOCK_H_DETAIL);
+            case MD_BLOCK_TH:   /* Pass through. */
+            case MD_BLOCK_TD:   return sizeof(MD_BLOCK_TD_DETAIL);
+        }
+    }
+    return 0;
+}
+
+static SZ
+md_tape_attr_n_substrs(const MD_ATTRIBUTE* attr)
+{
+    SZ n = 0;
+
+    if(attr->substr_offsets == NULL)
+        return (SZ)(-1);
+    while(attr->substr_offsets[n] < attr->size)
+        n++;
+    return n;
+}
+
+static SZ
+md_tape_attr_size(SZ size, SZ n_substrs)
+{
+    SZ attr_size = sizeof(MD_TAPE_ATTR) + size * sizeof(CHAR);
+
+    if(n_substrs != (SZ)(-1))
+        attr_size += (n_substrs + 1) * sizeof(OFF) + n_substrs * sizeof(MD_TEXTTYPE);
+    return MD_TAPE_ALIGNED(attr_size);
+}
+
+static char*
+md_tape_store_attr(char* ptr, const MD_ATTRIBUTE* attr, SZ n_substrs)
+{
+    MD_TAPE_ATTR* tape_attr = (MD_TAPE_ATTR*) ptr;
+    char* p = ptr + sizeof(MD_TAPE_ATTR);
+
+    tape_attr->size = attr->size;
+    tape_attr->n_substrs = n_substrs;
+    if(n_substrs != (SZ)(-1)) {
+        memcpy(p, attr->substr_offsets, (n_substrs + 1) * sizeof(OFF));
+        p += (n_substrs + 1) * sizeof(OFF);
+        memcpy(p, attr->substr_types, n_substrs * sizeof(MD_TEXTTYPE));
+        p += n_substrs * sizeof(MD_TEXTTYPE);
+    }
+    if(attr->size > 0)
+        memcpy(p, attr->text, attr->size * sizeof(CHAR));
+
+    return ptr + md_tape_attr_size(attr->size, n_substrs);
+}
+
+static const char*
+md_tape_load_attr(const char* ptr, MD_ATTRIBUTE* attr)
+{
+    static const MD_TEXTTYPE empty_types[] = { MD_TEXT_NORMAL };
+    static const OFF empty_offsets[] = { 0, 0 };
+    const MD_TAPE_ATTR* tape_attr = (const MD_TAPE_ATTR*) ptr;
+    const char* p = ptr + sizeof(MD_TAPE_ATTR);
+
+    attr->size = tape_attr->size;
+    if(tape_attr->n_substrs == (SZ)(-1)) {
+        attr->substr_offsets = NULL;
+        attr->substr_types = NULL;
+    } else if(tape_attr->size == 0) {
+        /* See md_build_attribute(). */
+        attr->substr_offsets = empty_offsets;
+        attr->substr_types = empty_types;
+    } else {
+        attr->substr_offsets = (const OFF*) p;
+        p += (tape_attr->n_substrs + 1) * sizeof(OFF);
+        attr->substr_types = (const MD_TEXTTYPE*) p;
+        p += tape_attr->n_substrs * sizeof(MD_TEXTTYPE);
+    }
+    attr->text = (tape_attr->size > 0 ? (const CHAR*) p : NULL);
+
+    return ptr + md_tape_attr_size(tape_attr->size, tape_attr->n_substrs);
+}
+
+static void
+md_tape_init(MD_TAPE* tape, const MD_ALLOCATOR* allocator)
+{
+    memset(tape, 0, sizeof(MD_TAPE));
+    memcpy(&tape->allocator, allocator, sizeof(MD_ALLOCATOR));
+}
+
+static void
+md_tape_fini(MD_TAPE* tape)
+{
+    if(tape->events != NULL)
+        tape->allocator.release(tape->events, tape->allocator.userdata);
+    if(tape->arena != NULL)
+        tape->allocator.release(tape->arena, tape->allocator.userdata);
+    if(tape->own_text != NULL)
+        tape->allocator.release(tape->own_text, tape->allocator.userdata);
+}
+
+/* Start recording of (another) document. */
+static void
+md_tape_reset(MD_TAPE* tape, const CHAR* text, SZ size)
+{
+    tape->text = text;
+    tape->size = size;
+    tape->n_events = 0;
+    tape->arena_size = 0;
+}
+
+/* Append an event to the tape. If arena_size is not zero, space for its
+ * payload is also reserved in the arena; MD_TAPE_EVENT::off then refers to
+ * it. */
+static MD_TAPE_EVENT*
+md_tape_push(MD_TAPE* tape, int event, int type, int flags, SZ arena_size)
+{
+    MD_TAPE_EVENT* ev;
+
+    if(tape->n_events >= tape->alloc_events) {
+        MD_TAPE_EVENT* new_events;
+        SZ new_alloc = (tape->alloc_events > 0 ? tape->alloc_events * 2 : 512);
+
+        new_events = (MD_TAPE_EVENT*) tape->allocator.resize(tape->events,
+                    tape->alloc_events * sizeof(MD_TAPE_EVENT),
+                    new_alloc * sizeof(MD_TAPE_EVENT), tape->allocator.userdata);
+        if(new_events == NULL)
+            return NULL;
+
+        tape->events = new_events;
+        tape->alloc_events = new_alloc;
+    }
+
+    if(arena_size > 0) {
+        arena_size = MD_TAPE_ALIGNED(arena_size);
+
+        if(tape->arena_size + arena_size > tape->alloc_arena) {
+            char* new_arena;
+            SZ new_alloc = (tape->alloc_arena > 0 ? tape->alloc_arena : 4096);
+
+            while(new_alloc < tape->arena_size + arena_size)
+                new_alloc *= 2;
+
+            new_arena = (char*) tape->allocator.resize(tape->arena, tape->alloc_arena,
+                        new_alloc, tape->allocator.userdata);
+            if(new_arena == NULL)
+                return NULL;
+
+            tape->arena = new_arena;
+            tape->alloc_arena = new_alloc;
+        }
+    }
+
+    ev = &tape->events[tape->n_events++];
+    ev->event = (unsigned char) event;
+    ev->type = (unsigned char) type;
+    ev->flags = (unsigned char) flags;
+    ev->off = tape->arena_size;
+    ev->size = 0;
+    tape->arena_size += arena_size;
+    return ev;
+}
+
+static int
+md_tape_record(MD_TAPE* tape, int event, int type, void* detail)
+{
+    MD_TAPE_EVENT* ev;
+    SZ size = 0;
+
+    if(detail != NULL) {
+        int n_attrs = md_tape_n_detail_attrs(event, type);
+
+        if(n_attrs > 0) {
+            /* (The detail is made of the attributes only.) */
+            const MD_ATTRIBUTE* attrs = (const MD_ATTRIBUTE*) detail;
+            SZ n_substrs[2];
+            char* ptr;
+            int i;
+
+            for(i = 0; i < n_attrs; i++) {
+                n_substrs[i] = md_tape_attr_n_substrs(&attrs[i]);
+                size += md_tape_attr_size(attrs[i].size, n_substrs[i]);
+            }
+
+            ev = md_tape_push(tape, event, type, MD_TAPE_EVENT_HASDETAIL, size);
+            if(ev == NULL)
+                return -1;
+            ev->size = size;
+            ptr = tape->arena + ev->off;
+            for(i = 0; i < n_attrs; i++)
+                ptr = md_tape_store_attr(ptr, &attrs[i], n_substrs[i]);
+            return 0;
+        }
+
+        size = md_tape_detail_size(event, type);
+    }
+
+    ev = md_tape_push(tape, event, type, (detail != NULL ? MD_TAPE_EVENT_HASDETAIL : 0), size);
+    if(ev == NULL)
+        return -1;
+    ev->size = size;
+    if(size > 0)
+        memcpy(tape->arena + ev->off, detail, size);
+    return 0;
+}
+
+static int
+md_tape_record_text(MD_TAPE* tape, MD_TEXTTYPE type, const CHAR* text, SZ size)
+{
+    MD_TAPE_EVENT* ev;
+
+    if(text >= tape->text  &&  text + size <= tape->text + tape->size) {
+        ev = md_tape_push(tape, MD_EVENT_TEXT, type, 0, 0);
+        if(ev == NULL)
+            return -1;
+        ev->off = (OFF) (text - tape->text);
+    } else {
+        ev = md_tape_push(tape, MD_EVENT_TEXT, type, MD_TAPE_EVENT_INARENA, size * sizeof(CHAR));
+        if(ev == NULL)
+            return -1;
+        memcpy(tape->arena + ev->off, text, size * sizeof(CHAR));
+    }
+
+    ev->size = size;
+    return 0;
+}
+
+static int
+md_tape_enter_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    return md_tape_record((MD_TAPE*) userdata, MD_EVENT_ENTER_BLOCK, type, detail);
+}
+
+static int
+md_tape_leave_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    return md_tape_record((MD_TAPE*) userdata, MD_EVENT_LEAVE_BLOCK, type, detail);
+}
+
+static int
+md_tape_enter_span_callback(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    return md_tape_record((MD_TAPE*) userdata, MD_EVENT_ENTER_SPAN, type, detail);
+}
+
+static int
+md_tape_leave_span_callback(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    return md_tape_record((MD_TAPE*) userdata, MD_EVENT_LEAVE_SPAN, type, detail);
+}
+
+static int
+md_tape_text_callback(MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    return md_tape_record_text((MD_TAPE*) userdata, type, text, size);
+}
+
+/* Renderer recording the callbacks into the tape passed as the userdata. */
+static const MD_RENDERER md_tape_recorder = {
+    md_tape_enter_block_callback,
+    md_tape_leave_block_callback,
+    md_tape_enter_span_callback,
+    md_tape_leave_span_callback,
+    md_tape_text_callback,
+    NULL,
+    0
+};
+
+/* Load the event the iterator points to. */
+static void
+md_tape_iter_load(MD_TAPE_ITER* iter)
+{
+    const MD_TAPE* tape = iter->tape;
+    const MD_TAPE_EVENT* ev = &tape->events[iter->index];
+
+    iter->event = (MD_EVENTTYPE) ev->event;
+    iter->type = ev->type;
+    iter->detail = NULL;
+    iter->text = NULL;
+    iter->size = 0;
+    iter->offset = (MD_OFFSET)(-1);
+
+    if(ev->event == MD_EVENT_TEXT) {
+        if(ev->flags & MD_TAPE_EVENT_INARENA) {
+            iter->text = (const CHAR*) (tape->arena + ev->off);
+        } else {
+            iter->text = tape->text + ev->off;
+            iter->offset = ev->off;
+        }
+        iter->size = ev->size;
+    } else if(ev->flags & MD_TAPE_EVENT_HASDETAIL) {
+        int n_attrs = md_tape_n_detail_attrs(ev->event, ev->type);
+
+        memset(&iter->detail_buf, 0, sizeof(iter->detail_buf));
+        if(n_attrs > 0) {
+            const char* ptr = tape->arena + ev->off;
+            MD_ATTRIBUTE* attrs = (MD_ATTRIBUTE*) &iter->detail_buf;
+            int i;
+
+            for(i = 0; i < n_attrs; i++)
+                ptr = md_tape_load_attr(ptr, &attrs[i]);
+        } else if(ev->size > 0) {
+            memcpy(&iter->detail_buf, tape->arena + ev->off, ev->size);
+        }
+        iter->detail = (void*) &iter->detail_buf;
+    }
+}
+
+static int
+md_tape_iter_step(MD_TAPE_ITER* iter)
+{
+    if(iter->index + 1 >= iter->tape->n_events) {
+        iter->index = iter->tape->n_events;
+        return FALSE;
+    }
+
+    iter->index++;
+    md_tape_iter_load(iter);
+    return TRUE;
+}
+
+/* Call the callbacks of the renderer as recorded in the tape. */
+static int
+md_tape_play(const MD_TAPE* tape, const MD_RENDERER* r, void* userdata)
+{
+    MD_TAPE_ITER iter;
+    int ret = 0;
+
+    if(tape->n_events == 0)
+        return 0;
+
+    iter.tape = tape;
+    iter.index = (MD_SIZE)(-1);
+    while(ret == 0  &&  md_tape_iter_step(&iter)) {
+        switch(iter.event) {
+            case MD_EVENT_ENTER_BLOCK:  ret = r->enter_block((MD_BLOCKTYPE) iter.type, iter.detail, userdata); break;
+            case MD_EVENT_LEAVE_BLOCK:  ret = r->leave_block((MD_BLOCKTYPE) iter.type, iter.detail, userdata); break;
+            case MD_EVENT_ENTER_SPAN:   ret = r->enter_span((MD_SPANTYPE) iter.type, iter.detail, userdata); break;
+            case MD_EVENT_LEAVE_SPAN:   ret = r->leave_span((MD_SPANTYPE) iter.type, iter.detail, userdata); break;
+            case MD_EVENT_TEXT:         ret = r->text((MD_TEXTTYPE) iter.type, iter.text, iter.size, userdata); break;
+            default:                    ret = -1; break;    /* Corrupted tape. */
+        }
+    }
+
+    return ret;
+}
+
+
+/***********************
+ ***  Binary Images  ***
+ ***********************/
+
+/* A tape may be serialized into a binary image (see md_tape_serialize()),
+ * which can be stored e.g. in a file and replayed later directly from
+ * memory it is mapped to, without any parsing or deserialization.
+ *
+ * The image is made of the header (MD_IMAGE_HEADER), the events, the arena
+ * and a copy of the document (so that the text events can refer to it), each
+ * of these parts aligned to MD_TAPE_ALIGN. As the tape uses only offsets, the
+ * parts are just copied as they are; the image then works wherever it is
+ * located in memory (as long as it is aligned to MD_TAPE_ALIGN).
+ *
+ * The image can only be used by MD4C built with the same configuration
+ * (encoding, size of the offsets etc.) on a machine with the same byte
+ * order. The header records all of that, so other images are just rejected.
+ */
+
+#define MD_IMAGE_VERSION        1
+#define MD_IMAGE_BYTE_ORDER     0x01020304U
+
+typedef struct MD_IMAGE_HEADER_tag MD_IMAGE_HEADER;
+struct MD_IMAGE_HEADER_tag {
+    char magic[4];                  /* "MD4T" */
+    unsigned version;               /* MD_IMAGE_VERSION */
+    unsigned char char_size;        /* sizeof(CHAR) */
+    unsigned char off_size;         /* sizeof(OFF) */
+    unsigned char enum_size;        /* sizeof(MD_TEXTTYPE) */
+    unsigned char event_size;       /* sizeof(MD_TAPE_EVENT) */
+    unsigned byte_order;            /* MD_IMAGE_BYTE_ORDER */
+    unsigned flags;                 /* The parser flags. */
+    unsigned hash;                  /* md_image_hash() of the document and the flags. */
+    SZ doc_size;
+    SZ n_events;
+    SZ arena_size;
+};
+
+/* Offsets of the parts of the image. */
+typedef struct MD_IMAGE_LAYOUT_tag MD_IMAGE_LAYOUT;
+struct MD_IMAGE_LAYOUT_tag {
+    SZ events_off;
+    SZ arena_off;
+    SZ doc_off;
+    SZ size;
+};
+
+static const char md_image_magic[4] = { 'M', 'D', '4', 'T' };
+
+/* FNV-1a hash of the document and the parser flags. */
+static unsigned
+md_image_hash_doc(const CHAR* text, SZ size, unsigned flags)
+{
+    const unsigned char* bytes = (const unsigned char*) text;
+    SZ n = size * sizeof(CHAR);
+    unsigned hash = 2166136261U;
+    SZ i;
+
+    for(i = 0; i < n; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619U;
+    }
+    for(i = 0; i < sizeof(unsigned); i++) {
+        hash ^= (flags >> (8 * i)) & 0xff;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static void
+md_image_layout(SZ doc_size, SZ n_events, SZ arena_size, MD_IMAGE_LAYOUT* layout)
+{
+    layout->events_off = MD_TAPE_ALIGNED(sizeof(MD_IMAGE_HEADER));
+    layout->arena_off = layout->events_off + MD_TAPE_ALIGNED(n_events * sizeof(MD_TAPE_EVENT));
+    layout->doc_off = layout->arena_off + MD_TAPE_ALIGNED(arena_size);
+    layout->size = layout->doc_off + MD_TAPE_ALIGNED(doc_size * sizeof(CHAR));
+}
+
+static SZ
+md_image_write(const MD_TAPE* tape, void* buffer, SZ buffer_size)
+{
+    MD_IMAGE_HEADER* header = (MD_IMAGE_HEADER*) buffer;
+    MD_IMAGE_LAYOUT layout;
+
+    md_image_layout(tape->size, tape->n_events, tape->arena_size, &layout);
+    if(buffer == NULL  ||  buffer_size < layout.size)
+        return layout.size;
+
+    memset(buffer, 0, layout.size);
+    memcpy(header->magic, md_image_magic, sizeof(md_image_magic));
+    header->version = MD_IMAGE_VERSION;
+    header->char_size = sizeof(CHAR);
+    header->off_size = sizeof(OFF);
+    header->enum_size = sizeof(MD_TEXTTYPE);
+    header->event_size = sizeof(MD_TAPE_EVENT);
+    header->byte_order = MD_IMAGE_BYTE_ORDER;
+    header->flags = tape->flags;
+    header->hash = md_image_hash_doc(tape->text, tape->size, tape->flags);
+    header->doc_size = tape->size;
+    header->n_events = tape->n_events;
+    header->arena_size = tape->arena_size;
+
+    if(tape->n_events > 0)
+        memcpy((char*) buffer + layout.events_off, tape->events, tape->n_events * sizeof(MD_TAPE_EVENT));
+    if(tape->arena_size > 0)
+        memcpy((char*) buffer + layout.arena_off, tape->arena, tape->arena_size);
+    if(tape->size > 0)
+        memcpy((char*) buffer + layout.doc_off, tape->text, tape->size * sizeof(CHAR));
+
+    return layout.size;
+}
+
+/* Check the image header and set up a (read-only) tape over the image. */
+static int
+md_image_open(const void* image, SZ image_size, MD_TAPE* tape)
+{
+    const MD_IMAGE_HEADER* header = (const MD_IMAGE_HEADER*) image;
+    MD_IMAGE_LAYOUT layout;
+
+    if(image == NULL  ||  image_size < sizeof(MD_IMAGE_HEADER)  ||
+       ((size_t) image & (MD_TAPE_ALIGN - 1)) != 0)
+        return -1;
+    if(memcmp(header->magic, md_image_magic, sizeof(md_image_magic)) != 0  ||
+       header->version != MD_IMAGE_VERSION  ||
+       header->char_size != sizeof(CHAR)  ||
+       header->off_size != sizeof(OFF)  ||
+       header->enum_size != sizeof(MD_TEXTTYPE)  ||
+       header->event_size != sizeof(MD_TAPE_EVENT)  ||
+       header->byte_order != MD_IMAGE_BYTE_ORDER)
+        return -1;
+
+    /* Make sure the parts fit into the image (without any overflow in the
+     * layout computation). */
+    if(header->n_events > image_size / sizeof(MD_TAPE_EVENT)  ||
+       header->arena_size > image_size  ||
+       header->doc_size > image_size / sizeof(CHAR))
+        return -1;
+    md_image_layout(header->doc_size, header->n_events, header->arena_size, &layout);
+    if(layout.size > image_size)
+        return -1;
+
+    memset(tape, 0, sizeof(MD_TAPE));
+    tape->text = (const CHAR*) ((const char*) image + layout.doc_off);
+    tape->size = header->doc_size;
+    tape->flags = header->flags;
+    tape->events = (MD_TAPE_EVENT*) ((const char*) image + layout.events_off);
+    tape->n_events = header->n_events;
+    tape->arena = (char*) ((const char*) image + layout.arena_off);
+    tape->arena_size = header->arena_size;
+    return 0;
+}
+
+static int
+md_image_check_attr(const char* ptr, SZ avail, SZ* p_size)
+{
+    const MD_TAPE_ATTR* tape_attr = (const MD_TAPE_ATTR*) ptr;
+    SZ size;
+
+    if(avail < sizeof(MD_TAPE_ATTR))
+        return -1;
+    if(tape_attr->size > avail / sizeof(CHAR))
+        return -1;
+    if(tape_attr->n_substrs != (SZ)(-1)) {
+        const OFF* offsets = (const OFF*) (ptr + sizeof(MD_TAPE_ATTR));
+        const MD_TEXTTYPE* types;
+        SZ i;
+
+        if(tape_attr->n_substrs >= avail / (sizeof(OFF) + sizeof(MD_TEXTTYPE)))
+            return -1;
+        if(md_tape_attr_size(tape_attr->size, tape_attr->n_substrs) > avail)
+            return -1;
+
+        /* The substrings must be in order and cover the whole string. */
+        if(tape_attr->size > 0) {
+            types = (const MD_TEXTTYPE*) (offsets + tape_attr->n_substrs + 1);
+            if(tape_attr->n_substrs == 0  ||  offsets[0] != 0  ||
+               offsets[tape_attr->n_substrs] != tape_attr->size)
+                return -1;
+            for(i = 0; i < tape_attr->n_substrs; i++) {
+                if(offsets[i] >= offsets[i+1])
+                    return -1;
+                if(types[i] != MD_TEXT_NORMAL  &&  types[i] != MD_TEXT_ENTITY  &&
+                   types[i] != MD_TEXT_NULLCHAR)
+                    return -1;
+            }
+        }
+    }
+
+    size = md_tape_attr_size(tape_attr->size, tape_attr->n_substrs);
+    if(size > avail)
+        return -1;
+    *p_size = size;
+    return 0;
+}
+
+/* Check the values in a fixed-size detail are those the parser may produce.
+ * (The renderer may e.g. use them as indexes.) */
+static int
+md_image_check_detail(int event, int type, const char* ptr)
+{
+    if(event != MD_EVENT_ENTER_BLOCK  &&  event != MD_EVENT_LEAVE_BLOCK)
+        return 0;
+
+    switch(type) {
+        case MD_BLOCK_UL:
+        {
+            const MD_BLOCK_UL_DETAIL* det = (const MD_BLOCK_UL_DETAIL*) ptr;
+            if(det->mark != _T('-')  &&  det->mark != _T('+')  &&  det->mark != _T('*'))
+                return -1;
+            break;
+        }
+
+        case MD_BLOCK_OL:
+        {
+            const MD_BLOCK_OL_DETAIL* det = (const MD_BLOCK_OL_DETAIL*) ptr;
+            /* (The start index has at most 9 digits.) */
+            if(det->start > 999999999  ||
+               (det->mark_delimiter != _T('.')  &&  det->mark_delimiter != _T(')')))
+                return -1;
+            break;
+        }
+
+        case MD_BLOCK_H:
+        {
+            const MD_BLOCK_H_DETAIL* det = (const MD_BLOCK_H_DETAIL*) ptr;
+            if(det->level < 1  ||  det->level > 6)
+                return -1;
+            break;
+        }
+
+        case MD_BLOCK_TH:   /* Pass through. */
+        case MD_BLOCK_TD:
+        {
+            const MD_BLOCK_TD_DETAIL* det = (const MD_BLOCK_TD_DETAIL*) ptr;
+            if(det->align != MD_ALIGN_DEFAULT  &&  det->align != MD_ALIGN_LEFT  &&
+               det->align != MD_ALIGN_CENTER  &&  det->align != MD_ALIGN_RIGHT)
+                return -1;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* Check all the events of the image refer to something within the image, and
+ * that the details are there (and make sense) where the renderer expects them.
+ * (So that a damaged image cannot make us read outside of it, nor the renderer
+ * get a detail it does not expect.) */
+static int
+md_image_check_events(const MD_TAPE* tape)
+{
+    SZ i;
+
+    for(i = 0; i < tape->n_events; i++) {
+        const MD_TAPE_EVENT* ev = &tape->events[i];
+        int n_attrs;
+        SZ detail_size;
+
+        switch(ev->event) {
+            case MD_EVENT_ENTER_BLOCK:
+            case MD_EVENT_LEAVE_BLOCK:
+                if(ev->type > MD_BLOCK_TD)
+                    return -1;
+                break;
+            case MD_EVENT_ENTER_SPAN:
+            case MD_EVENT_LEAVE_SPAN:
+                if(ev->type > MD_SPAN_CODE)
+                    return -1;
+                break;
+            case MD_EVENT_TEXT:
+                if(ev->type > MD_TEXT_HTML)
+                    return -1;
+                break;
+            default:
+                return -1;
+        }
+
+        if(ev->event == MD_EVENT_TEXT) {
+            if(ev->flags & MD_TAPE_EVENT_INARENA) {
+                if(ev->off > tape->arena_size  ||
+                   ev->size > (tape->arena_size - ev->off) / sizeof(CHAR))
+                    return -1;
+            } else {
+                if(ev->off > tape->size  ||  ev->size > tape->size - ev->off)
+                    return -1;
+            }
+            continue;
+        }
+
+        /* The types with a detail structure always get one; the others may
+         * get NULL or a detail with nothing in it. */
+        n_attrs = md_tape_n_detail_attrs(ev->event, ev->type);
+        detail_size = md_tape_detail_size(ev->event, ev->type);
+        if(!(ev->flags & MD_TAPE_EVENT_HASDETAIL)) {
+            if(n_attrs > 0  ||  detail_size > 0  ||  ev->size != 0)
+                return -1;
+            continue;
+        }
+
+        if(ev->off > tape->arena_size  ||  ev->size > tape->arena_size - ev->off  ||
+           (ev->off & (MD_TAPE_ALIGN - 1)) != 0)
+            return -1;
+
+        if(n_attrs > 0) {
+            const char* ptr = tape->arena + ev->off;
+            SZ avail = ev->size;
+            SZ attr_size;
+            int j;
+
+            for(j = 0; j < n_attrs; j++) {
+                if(md_image_check_attr(ptr, avail, &attr_size) != 0)
+                    return -1;
+                ptr += attr_size;
+                avail -= attr_size;
+            }
+            if(avail != 0)
+                return -1;
+        } else {
+            if(ev->size != detail_size)
+                return -1;
+            if(detail_size > 0  &&
+               md_image_check_detail(ev->event, ev->type, tape->arena + ev->off) != 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Check each leave event of the image closes the block or span the last
+ * unclosed enter event has opened, and that nothing is left unclosed. (The
+ * renderer, as well as md_tape_iter_skip(), relies on that.)
+ *
+ * The stack of the unclosed events lives on the C stack, unless the nesting
+ * is very deep. */
+#define MD_IMAGE_NESTING_STACK      256
+
+static int
+md_image_check_nesting(const MD_TAPE* tape)
+{
+    unsigned char local_stack[MD_IMAGE_NESTING_STACK];
+    unsigned char* stack = local_stack;
+    SZ alloc_stack = MD_IMAGE_NESTING_STACK;
+    SZ depth = 0;
+    SZ i;
+    int ret = -1;
+
+    for(i = 0; i < tape->n_events; i++) {
+        const MD_TAPE_EVENT* ev = &tape->events[i];
+        /* (Both the block and the span types are less than 0x80.) */
+        unsigned char key = ev->type | (ev->event == MD_EVENT_ENTER_SPAN  ||
+                                        ev->event == MD_EVENT_LEAVE_SPAN ? 0x80 : 0);
+
+        switch(ev->event) {
+            case MD_EVENT_ENTER_BLOCK:
+            case MD_EVENT_ENTER_SPAN:
+                if(depth >= alloc_stack) {
+                    unsigned char* new_stack;
+
+                    new_stack = (unsigned char*) md_default_allocator.alloc(
+                                2 * alloc_stack, md_default_allocator.userdata);
+                    if(new_stack == NULL)
+                        goto abort;
+                    memcpy(new_stack, stack, depth);
+                    if(stack != local_stack)
+                        md_default_allocator.release(stack, md_default_allocator.userdata);
+                    stack = new_stack;
+                    alloc_stack *= 2;
+                }
+                stack[depth++] = key;
+                break;
+
+            case MD_EVENT_LEAVE_BLOCK:
+            case MD_EVENT_LEAVE_SPAN:
+                if(depth == 0  ||  stack[depth-1] != key)
+                    goto abort;
+                depth--;
+                break;
+        }
+    }
+
+    if(depth == 0)
+        ret = 0;
+
+abort:
+    if(stack != local_stack)
+        md_default_allocator.release(stack, md_default_allocator.userdata);
+    return ret;
+}
+
+/* Check the image may be replayed safely. */
+static int
+md_image_check(const MD_TAPE* tape)
+{
+    if(md_image_check_events(tape) != 0  ||  md_image_check_nesting(tape) != 0)
+        return -1;
+    return 0;
+}
+
+
+/**************************
+ ***  Parallel Parsing  ***
+ **************************/
+
+/* With md_parser_set_threads(), a large document is split into parts, and
+ * each part is parsed by a worker (each with its own MD_CTX) in its own
+ * thread:
+ *
+ *  -- The split points are found by a quick scan of the text: A line starting
+ *     with a letter which follows a blank line most likely starts a new
+ *     top-level paragraph (see md_find_split_point()).
+ *
+ *  -- The workers analyze the blocks of their parts. Then we check whether
+ *     each part has really started outside of any block, i.e. whether the
+ *     preceding worker has ended with no block open. (It may not be the case
+ *     e.g. if the blank line is in a fenced code block.) If not, the
+ *     preceding worker takes the part over (in the calling thread).
+ *
+ *  -- The link reference definitions found by the workers are moved (in the
+ *     document order) into the main context, and all the workers then use
+ *     them from there.
+ *
+ *  -- The workers process the inlines of their blocks. The first one does so
+ *     in the calling thread, calling the callbacks directly. The others
+ *     record them into their tapes, which we then replay in the document
+ *     order.
+ */
+
+#define MD_PARALLEL_MIN_PART_SIZE   (64 * 1024)
+
+#ifndef MD4C_NO_THREADS
+  #ifdef _WIN32
+    static DWORD WINAPI
+    md_worker_thread_proc(LPVOID param)
+    {
+        MD_WORKER* w = (MD_WORKER*) param;
+        w->ret = w->func(w);
+        return 0;
+    }
+  #else
+    static void*
+    md_worker_thread_proc(void* param)
+    {
+        MD_WORKER* w = (MD_WORKER*) param;
+        w->ret = w->func(w);
+        return NULL;
+    }
+  #endif
+#endif
+
+/* Run the function in a new thread. If that fails, run it right away in
+ * the calling thread. */
+static void
+md_worker_start(MD_WORKER* w, int (*func)(MD_WORKER*))
+{
+    w->func = func;
+    w->is_running = FALSE;
+
+#ifndef MD4C_NO_THREADS
+  #ifdef _WIN32
+    w->thread = CreateThread(NULL, 0, md_worker_thread_proc, (LPVOID) w, 0, NULL);
+    w->is_running = (w->thread != NULL);
+  #else
+    w->is_running = (pthread_create(&w->thread, NULL, md_worker_thread_proc, (void*) w) == 0);
+  #endif
+#endif
+
+    if(!w->is_running)
+        w->ret = func(w);
+}
+
+static void
+md_worker_join(MD_WORKER* w)
+{
+    if(!w->is_running)
+        return;
+
+#ifndef MD4C_NO_THREADS
+  #ifdef _WIN32
+    WaitForSingleObject(w->thread, INFINITE);
+    CloseHandle(w->thread);
+  #else
+    pthread_join(w->thread, NULL);
+  #endif
+#endif
+
+    w->is_running = FALSE;
+}
+
+/* Add the statistics of a worker to the total ones. (Sizes of the buffers add
+ * up as well, as the workers use their buffers at the same time.) */
+static void
+md_stats_add(MD_STATS* stats, const MD_STATS* w)
+{
+    stats->n_lines += w->n_lines;
+    stats->n_blocks += w->n_blocks;
+    stats->n_marks += w->n_marks;
+    stats->n_resolved_marks += w->n_resolved_marks;
+    stats->n_rollbacks += w->n_rollbacks;
+    stats->n_link_ref_defs += w->n_link_ref_defs;
+
+    stats->marks.n_reallocs += w->marks.n_reallocs;
+    stats->marks.peak_bytes += w->marks.peak_bytes;
+    stats->block_bytes.n_reallocs += w->block_bytes.n_reallocs;
+    stats->block_bytes.peak_bytes += w->block_bytes.peak_bytes;
+    stats->containers.n_reallocs += w->containers.n_reallocs;
+    stats->containers.peak_bytes += w->containers.peak_bytes;
+    stats->buffer.n_reallocs += w->buffer.n_reallocs;
+    stats->buffer.peak_bytes += w->buffer.peak_bytes;
+}
+
+static int
+md_parser_alloc_workers(MD_PARSER* parser, int n)
+{
+    MD_CTX* ctx = &parser->ctx;
+    MD_WORKER* new_workers;
+    int i;
+
+    if(n <= parser->alloc_workers)
+        return 0;
+
+    new_workers = (MD_WORKER*) md_realloc(ctx, parser->workers,
+                parser->alloc_workers * sizeof(MD_WORKER), n * sizeof(MD_WORKER));
+    if(new_workers == NULL) {
+        MD_LOG("realloc() failed.");
+        return -1;
+    }
+
+    for(i = parser->alloc_workers; i < n; i++) {
+        MD_CTX* wctx = &new_workers[i].ctx;
+
+        memset(&new_workers[i], 0, sizeof(MD_WORKER));
+        memcpy(&wctx->allocator, &ctx->allocator, sizeof(MD_ALLOCATOR));
+        wctx->r.flags = parser->flags;
+        md_build_mark_char_map(wctx);
+        md_setup_mark_scanner(wctx);
+        md_setup_pair_finder(wctx);
+        md_tape_init(&new_workers[i].tape, &ctx->allocator);
+    }
+
+    parser->workers = new_workers;
+    parser->alloc_workers = n;
+    return 0;
+}
+
+/* Find a start of a line at or after off which follows a blank line and
+ * starts with a letter. (Such line cannot start anything but a paragraph;
+ * unless it is inside of a fenced code block or a raw HTML block, it starts
+ * a new top-level block.) */
+static OFF
+md_find_split_point(MD_CTX* ctx, OFF off)
+{
+    while(TRUE) {
+        OFF tmp;
+
+        off = md_find_char(ctx, off, _T('\n'));
+        if(off >= ctx->size)
+            return ctx->size;
+        off++;
+
+        tmp = off;
+        while(tmp < ctx->size  &&  ISBLANK(tmp))
+            tmp++;
+        if(tmp < ctx->size  &&  CH(tmp) == _T('\r'))
+            tmp++;
+        if(tmp + 1 < ctx->size  &&  CH(tmp) == _T('\n')  &&  ISALPHA(tmp + 1))
+            return tmp + 1;
+    }
+}
+
+/* Analyze the lines in the range <beg, end) of the document. */
+static int
+md_worker_analyze(MD_WORKER* w, OFF beg, OFF end)
+{
+    MD_CTX* ctx = &w->ctx;
+    OFF off = beg;
+    int ret = 0;
+
+    ctx->size = end;
+    MD_CHECK(md_build_line_index(ctx, beg));
+
+    while(off < end) {
+        if(w->line == w->pivot_line)
+            w->line = (w->line == &w->line_buf[0] ? &w->line_buf[1] : &w->line_buf[0]);
+
+        MD_CHECK(ctx->analyze_line(ctx, off, &off, w->pivot_line, w->line));
+        MD_CHECK(md_process_line(ctx, &w->pivot_line, w->line));
+        if(MD_VERBATIM_FAST_PATH(ctx))
+            MD_CHECK(md_process_verbatim_lines(ctx, w->pivot_line, &off));
+    }
+
+abort:
+    return ret;
+}
+
+static int
+md_worker_analyze_part(MD_WORKER* w)
+{
+    return md_worker_analyze(w, w->beg, w->end);
+}
+
+static int
+md_worker_process_blocks(MD_WORKER* w)
+{
+    return md_process_all_blocks(&w->ctx);
+}
+
+/* Move the link reference definitions of the worker into the main context. */
+static int
+md_merge_link_ref_defs(MD_CTX* ctx, MD_CTX* wctx)
+{
+    int i;
+
+    for(i = 0; i < wctx->n_link_ref_defs; i++) {
+        MD_LINK_REF_DEF* wdef = &wctx->link_ref_defs[i];
+        MD_LINK_REF_DEF* def;
+
+        def = md_push_link_ref_def(ctx);
+        if(def == NULL)
+            return -1;
+
+        def->title = wdef->title;
+        def->title_size = wdef->title_size;
+        def->title_needs_free = wdef->title_needs_free;
+        def->dest_beg = wdef->dest_beg;
+        def->dest_end = wdef->dest_end;
+        wdef->title_needs_free = FALSE;
+
+        /* (Those not registered in the worker are superseded by a preceding
+         * definition with the same label.) */
+        if(wdef->label_len > 0) {
+            if(md_register_link_ref_def(ctx, wctx->ref_def_labels + wdef->label_off, wdef->label_len) != 0)
+                return -1;
+        }
+    }
+
+    md_free_link_ref_defs(wctx);
+    return 0;
+}
+
+/* Let the worker use the link reference definitions of the main context. */
+static void
+md_worker_borrow_ref_defs(MD_WORKER* w, MD_CTX* ctx)
+{
+    MD_CTX* wctx = &w->ctx;
+
+    w->own_link_ref_defs = wctx->link_ref_defs;
+    w->own_alloc_link_ref_defs = wctx->alloc_link_ref_defs;
+    w->own_ref_def_hashtable = wctx->ref_def_hashtable;
+    w->own_alloc_ref_def_hashtable = wctx->alloc_ref_def_hashtable;
+    w->own_ref_def_labels = wctx->ref_def_labels;
+    w->own_alloc_ref_def_labels = wctx->alloc_ref_def_labels;
+
+    wctx->link_ref_defs = ctx->link_ref_defs;
+    wctx->n_link_ref_defs = ctx->n_link_ref_defs;
+    wctx->alloc_link_ref_defs = ctx->alloc_link_ref_defs;
+    wctx->ref_def_hashtable = ctx->ref_def_hashtable;
+    wctx->alloc_ref_def_hashtable = ctx->alloc_ref_def_hashtable;
+    wctx->ref_def_labels = ctx->ref_def_labels;
+    wctx->n_ref_def_labels = ctx->n_ref_def_labels;
+    wctx->alloc_ref_def_labels = ctx->alloc_ref_def_labels;
+}
+
+static void
+md_worker_return_ref_defs(MD_WORKER* w)
+{
+    MD_CTX* wctx = &w->ctx;
+
+    wctx->link_ref_defs = w->own_link_ref_defs;
+    wctx->n_link_ref_defs = 0;
+    wctx->alloc_link_ref_defs = w->own_alloc_link_ref_defs;
+    wctx->ref_def_hashtable = w->own_ref_def_hashtable;
+    wctx->alloc_ref_def_hashtable = w->own_alloc_ref_def_hashtable;
+    wctx->ref_def_labels = w->own_ref_def_labels;
+    wctx->n_ref_def_labels = 0;
+    wctx->alloc_ref_def_labels = w->own_alloc_ref_def_labels;
+}
+
+static int
+md_parallel_run(MD_PARSER* parser)
+{
+    MD_CTX* ctx = &parser->ctx;
+    MD_WORKER* prev;
+    OFF beg = 0;
+    int n_parts;
+    int n = 0;
+    int defs_are_borrowed = FALSE;
+    double t0 = 0.0;
+    double t1 = 0.0;
+    int i;
+    int ret = 0;
+
+    n_parts = ctx->size / MD_PARALLEL_MIN_PART_SIZE;
+    if(n_parts > (int) parser->n_threads)
+        n_parts = parser->n_threads;
+    if(n_parts < 2)
+        return md_process_doc(ctx);
+
+    MD_CHECK(md_parser_alloc_workers(parser, n_parts));
+
+    if(ctx->stats != NULL)
+        t0 = md_stats_clock();
+
+    /* Split the document. */
+    while(beg < ctx->size) {
+        MD_WORKER* w = &parser->workers[n++];
+        OFF end = ctx->size;
+
+        if(n < n_parts) {
+            OFF target = (OFF) (((double) ctx->size * n) / n_parts);
+            end = md_find_split_point(ctx, (target > beg ? target : beg));
+        }
+
+        md_ctx_reset(&w->ctx, (n == 1 ? &ctx->r : &md_tape_recorder),
+                     (n == 1 ? ctx->userdata : (void*) &w->tape), parser->flags);
+        w->ctx.text = ctx->text;
+        w->beg = beg;
+        w->end = end;
+        w->is_merged = FALSE;
+        w->pivot_line = &md_dummy_blank_line;
+        w->line = &w->line_buf[0];
+        md_tape_reset(&w->tape, ctx->text, ctx->size);
+        memset(&w->stats, 0, sizeof(MD_STATS));
+        w->ctx.stats = (ctx->stats != NULL ? &w->stats : NULL);
+        w->ret = 0;
+        beg = end;
+    }
+
+    if(n < 2)
+        return md_process_doc(ctx);
+
+    /* Analyze the blocks. */
+    for(i = 1; i < n; i++)
+        md_worker_start(&parser->workers[i], md_worker_analyze_part);
+    parser->workers[0].ret = md_worker_analyze_part(&parser->workers[0]);
+    for(i = 0; i < n; i++) {
+        md_worker_join(&parser->workers[i]);
+        if(ret == 0)
+            ret = parser->workers[i].ret;
+    }
+    if(ret != 0)
+        goto abort;
+
+    /* Check each part has started outside of any block. If not, re-analyze
+     * it as a continuation of the preceding one. */
+    prev = &parser->workers[0];
+    for(i = 1; i < n; i++) {
+        MD_WORKER* w = &parser->workers[i];
+
+        if(prev->ctx.current_block != NULL  ||  prev->ctx.n_containers > 0) {
+            w->is_merged = TRUE;
+            md_free_link_ref_defs(&w->ctx);
+            MD_CHECK(md_worker_analyze(prev, w->beg, w->end));
+            prev->end = w->end;
+        } else {
+            prev = w;
+        }
+    }
+
+    /* End any blocks still open at the end of the document. Collect all the
+     * link reference definitions. */
+    for(i = 0; i < n; i++) {
+        MD_WORKER* w = &parser->workers[i];
+
+        if(w->is_merged)
+            continue;
+
+        w->ctx.size = ctx->size;
+        MD_CHECK(md_end_current_block(&w->ctx));
+        MD_CHECK(md_leave_child_containers(&w->ctx, 0));
+        MD_CHECK(md_merge_link_ref_defs(ctx, &w->ctx));
+        if(w->ctx.stats != NULL)
+            w->stats.block_bytes.peak_bytes = w->ctx.n_block_bytes;
+    }
+
+    if(ctx->stats != NULL) {
+        t1 = md_stats_clock();
+        ctx->stats->block_time += t1 - t0;
+    }
+
+    /* Process the inlines. */
+    for(i = 0; i < n; i++) {
+        if(!parser->workers[i].is_merged)
+            md_worker_borrow_ref_defs(&parser->workers[i], ctx);
+    }
+    defs_are_borrowed = TRUE;
+
+    for(i = 1; i < n; i++) {
+        if(!parser->workers[i].is_merged)
+            md_worker_start(&parser->workers[i], md_worker_process_blocks);
+    }
+
+    ret = ctx->r.enter_block(MD_BLOCK_DOC, NULL, ctx->userdata);
+    if(ret == 0)
+        ret = md_worker_process_blocks(&parser->workers[0]);
+    for(i = 1; i < n; i++) {
+        MD_WORKER* w = &parser->workers[i];
+
+        if(w->is_merged)
+            continue;
+
+        md_worker_join(w);
+        if(ret == 0)
+            ret = w->ret;
+        if(ret == 0)
+            ret = md_tape_play(&w->tape, &ctx->r, ctx->userdata);
+    }
+    if(ret == 0)
+        ret = ctx->r.leave_block(MD_BLOCK_DOC, NULL, ctx->userdata);
+
+    if(ctx->stats != NULL)
+        ctx->stats->inline_time += md_stats_clock() - t1;
+
+abort:
+    for(i = 0; i < n; i++) {
+        MD_WORKER* w = &parser->workers[i];
+
+        if(defs_are_borrowed  &&  !w->is_merged)
+            md_worker_return_ref_defs(w);
+        md_free_link_ref_defs(&w->ctx);
+        if(w->ctx.stats != NULL) {
+            md_stats_add(ctx->stats, &w->stats);
+            w->ctx.stats = NULL;
+        }
+    }
+    return ret;
+}
+
+
+/********************
+ ***  Public API  ***
+ ********************/
+
+int
+md_parse(const MD_CHAR* text, MD_SIZE size, const MD_RENDERER* renderer, void* userdata)
+{
+    MD_PARSER parser;
+    int ret;
+
+    md_parser_init(&parser, renderer->flags, &md_default_allocator);
+    ret = md_parser_run(&parser, text, size, renderer, userdata);
+    md_parser_fini(&parser);
+
+    return ret;
+}
+
+MD_PARSER*
+md_parser_new(unsigned flags)
+{
+    return md_parser_new_with_allocator(flags, &md_default_allocator);
+}
+
+MD_PARSER*
+md_parser_new_with_allocator(unsigned flags, const MD_ALLOCATOR* allocator)
+{
+    MD_PARSER* parser;
+
+    parser = (MD_PARSER*) allocator->alloc(sizeof(MD_PARSER), allocator->userdata);
+    if(parser == NULL)
+        return NULL;
+
+    md_parser_init(parser, flags, allocator);
+    return parser;
+}
+
+void
+md_parser_free(MD_PARSER* parser)
+{
+    MD_ALLOCATOR allocator;
+
+    if(parser == NULL)
+        return;
+
+    memcpy(&allocator, &parser->ctx.allocator, sizeof(MD_ALLOCATOR));
+    md_parser_fini(parser);
+    allocator.release(parser, allocator.userdata);
+}
+
+void
+md_parser_set_high_water_mark(MD_PARSER* parser, MD_SIZE max_bytes)
+{
+    parser->high_water_mark = max_bytes;
+    md_parser_trim(parser);
+}
+
+void
+md_parser_set_stats(MD_PARSER* parser, MD_STATS* stats)
+{
+    parser->stats = stats;
+}
+
+void
+md_parser_set_threads(MD_PARSER* parser, unsigned n_threads)
+{
+    parser->n_threads = n_threads;
+}
+
+int
+md_parser_parse(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size,
+                const MD_RENDERER* renderer, void* userdata)
+{
+    return md_parser_run(parser, text, size, renderer, userdata);
+}
+
+int
+md_parser_begin(MD_PARSER* parser, const MD_RENDERER* renderer, void* userdata)
+{
+    return md_stream_begin(parser, renderer, userdata);
+}
+
+int
+md_parser_feed(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size)
+{
+    return md_stream_feed(parser, text, size);
+}
+
+int
+md_parser_finish(MD_PARSER* parser)
+{
+    return md_stream_finish(parser);
+}
+
+int
+md_parser_load(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size,
+               const MD_RENDERER* renderer, void* userdata)
+{
+    return md_doc_load(parser, text, size, renderer, userdata);
+}
+
+int
+md_parser_edit(MD_PARSER* parser, MD_OFFSET offset, MD_SIZE removed_size,
+               const MD_CHAR* inserted, MD_SIZE inserted_size,
+               const MD_RENDERER* renderer, void* userdata, MD_EDIT_INFO* info)
+{
+    return md_doc_edit(parser, offset, removed_size, inserted, inserted_size,
+                renderer, userdata, info);
+}
+
+MD_TAPE*
+md_parse_to_tape(const MD_CHAR* text, MD_SIZE size, unsigned flags)
+{
+    MD_RENDERER renderer = md_tape_recorder;
+    MD_PARSER parser;
+    MD_TAPE* tape;
+    int ret;
+
+    tape = (MD_TAPE*) md_default_allocator.alloc(sizeof(MD_TAPE), md_default_allocator.userdata);
+    if(tape == NULL)
+        return NULL;
+
+    md_tape_init(tape, &md_default_allocator);
+    md_parser_init(&parser, flags, &md_default_allocator);
+
+    /* The text events refer to the document, so it has to be repaired (if
+     * needed) before the recording. The tape then keeps the repaired copy. */
+    ret = md_parser_validate_utf8(&parser, &text, &size);
+    if(ret == 0) {
+        if(text == parser.utf8_buf) {
+            tape->own_text = parser.utf8_buf;
+            parser.utf8_buf = NULL;
+            parser.alloc_utf8 = 0;
+        }
+        md_tape_reset(tape, text, size);
+
+        tape->flags = flags;
+        renderer.flags = flags;
+        ret = md_parser_run(&parser, text, size, &renderer, (void*) tape);
+    }
+    md_parser_fini(&parser);
+
+    if(ret != 0) {
+        md_tape_free(tape);
+        return NULL;
+    }
+
+    return tape;
+}
+
+void
+md_tape_free(MD_TAPE* tape)
+{
+    MD_ALLOCATOR allocator = tape->allocator;
+
+    md_tape_fini(tape);
+    allocator.release(tape, allocator.userdata);
+}
+
+void
+md_tape_iter_init(MD_TAPE_ITER* iter, const MD_TAPE* tape)
+{
+    memset(iter, 0, sizeof(MD_TAPE_ITER));
+    iter->tape = tape;
+    iter->index = (MD_SIZE)(-1);
+}
+
+int
+md_tape_iter_next(MD_TAPE_ITER* iter)
+{
+    return md_tape_iter_step(iter);
+}
+
+void
+md_tape_iter_skip(MD_TAPE_ITER* iter)
+{
+    const MD_TAPE* tape = iter->tape;
+    MD_SIZE index = iter->index;
+    int depth = 0;
+
+    if(index >= tape->n_events)
+        return;
+    if(iter->event != MD_EVENT_ENTER_BLOCK  &&  iter->event != MD_EVENT_ENTER_SPAN)
+        return;
+
+    do {
+        switch(tape->events[index].event) {
+            case MD_EVENT_ENTER_BLOCK:  /* Pass through. */
+            case MD_EVENT_ENTER_SPAN:   depth++; break;
+            case MD_EVENT_LEAVE_BLOCK:  /* Pass through. */
+            case MD_EVENT_LEAVE_SPAN:   depth--; break;
+        }
+        index++;
+    } while(depth > 0  &&  index < tape->n_events);
+
+    iter->index = index - 1;
+    md_tape_iter_load(iter);
+}
+
+int
+md_tape_replay(const MD_TAPE* tape, const MD_RENDERER* renderer, void* userdata)
+{
+    return md_tape_play(tape, renderer, userdata);
+}
+
+MD_SIZE
+md_tape_serialize(const MD_TAPE* tape, void* buffer, MD_SIZE buffer_size)
+{
+    return md_image_write(tape, buffer, buffer_size);
+}
+
+unsigned
+md_image_hash(const MD_CHAR* text, MD_SIZE size, unsigned flags)
+{
+    return md_image_hash_doc(text, size, flags);
+}
+
+int
+md_image_matches(const void* image, MD_SIZE image_size,
+                 const MD_CHAR* text, MD_SIZE size, unsigned flags)
+{
+    const MD_IMAGE_HEADER* header = (const MD_IMAGE_HEADER*) image;
+    MD_TAPE tape;
+
+    if(md_image_open(image, image_size, &tape) != 0)
+        return FALSE;
+
+    return (header->flags == flags  &&  header->doc_size == size  &&
+            header->hash == md_image_hash_doc(text, size, flags)  &&
+            memcmp(tape.text, text, size * sizeof(CHAR)) == 0  &&
+            md_image_check(&tape) == 0);
+}
+
+int
+md_replay_mapped(const void* image, MD_SIZE image_size,
+                 const MD_RENDERER* renderer, void* userdata)
+{
+    MD_TAPE tape;
+
+    if(md_image_open(image, image_size, &tape) != 0  ||  md_image_check(&tape) != 0)
+        return -1;
+
+    return md_tape_play(&tape, renderer, userdata);
 }
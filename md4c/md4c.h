@@ -48,8 +48,20 @@
     typedef char            MD_CHAR;
 #endif
 
-typedef unsigned MD_SIZE;
-typedef unsigned MD_OFFSET;
+/* Sizes and offsets of the text. These are 32-bit by default, which limits
+ * the size of the document to 4 GiB. Define MD4C_USE_64BIT_OFFSETS (for
+ * both MD4C and the application) to make them 64-bit, so larger documents
+ * can be parsed. (Note the size of the marks and of the blocks of the lines
+ * MD4C keeps during the parsing then grows too, and MD_SIZE changes also in
+ * the callbacks.)
+ */
+#if defined MD4C_USE_64BIT_OFFSETS
+    typedef unsigned long long MD_SIZE;
+    typedef unsigned long long MD_OFFSET;
+#else
+    typedef unsigned MD_SIZE;
+    typedef unsigned MD_OFFSET;
+#endif
 
 
 /* Block represents a part of document hierarchy structure like a paragraph
@@ -201,6 +213,10 @@ enum MD_ALIGN_tag {
  *  -- substr_offsets[0] == 0
  *  -- substr_offsets[LAST+1] == size
  *  -- Only MD_TEXT_NORMAL and MD_TEXT_ENTITY substrings can appear.
+ *
+ * The attribute (including the arrays) is valid only during the callback.
+ * (Unless there is an escape or an entity in it, its text points directly
+ * into the document.)
  */
 typedef struct MD_ATTRIBUTE_tag MD_ATTRIBUTE;
 struct MD_ATTRIBUTE_tag {
@@ -275,6 +291,52 @@ struct MD_SPAN_IMG_DETAIL_tag {
 #define MD_FLAG_NOHTMLSPANS                 0x0040  /* Disable raw HTML (inline). */
 #define MD_FLAG_NOHTML                      (MD_FLAG_NOHTMLBLOCKS | MD_FLAG_NOHTMLSPANS)
 #define MD_FLAG_TABLES                      0x0100  /* Enable tables extension. */
+#define MD_FLAG_VALIDATEUTF8                0x0200  /* Replace invalid UTF-8 sequences in the input with U+FFFD. */
+#define MD_FLAG_COALESCETEXT                0x0400  /* Merge adjacent text of the same type into a single text callback. */
+#define MD_FLAG_SOFTBRASTEXT                0x0800  /* Send soft breaks as '\n' in MD_TEXT_NORMAL. */
+#define MD_FLAG_CONTIGUOUSCODE              0x1000  /* Send contents of a code block in a single MD_TEXT_CODE if possible. */
+
+/* With MD_FLAG_VALIDATEUTF8, the whole input is checked to be a valid UTF-8
+ * before it is parsed. If it is not, each invalid sequence (or its maximal
+ * valid part, e.g. a lead byte without its continuation bytes) is replaced
+ * with U+FFFD in a copy of the input, and the copy is parsed instead. So all
+ * the text passed to the callbacks is a valid UTF-8 (as long as the renderer
+ * itself does not make it invalid), and the offsets refer to the copy.
+ *
+ * This applies to all the ways of parsing: md_parser_feed() handles sequences
+ * split between the chunks, and md_parser_edit() repairs also sequences cut
+ * by the edit range. A tape recorded by md_parse_to_tape() keeps the copy,
+ * so md_image_matches() compares the image with the repaired document.
+ *
+ * (The flag is ignored when MD4C is built with MD4C_USE_UTF16.)
+ */
+
+/* With MD_FLAG_COALESCETEXT, text which would otherwise be sent in
+ * multiple MD_TEXT_NORMAL (or MD_TEXT_CODE, MD_TEXT_HTML) callbacks in a row,
+ * e.g. around backslash escapes or delimiters which have not become spans, is
+ * sent in a single one. (This applies to the inline contents of blocks, not
+ * to code blocks and raw HTML blocks.) Combined with MD_FLAG_SOFTBRASTEXT,
+ * the lines of a paragraph are merged too. Note the renderer then cannot
+ * tell a soft break from the '\n' in the text (md2html e.g. renders soft
+ * breaks as spaces in the alt text of images).
+ *
+ * The merged text points into the document if its pieces are contiguous in
+ * it; otherwise it is staged in a buffer which is valid only during the
+ * callback.
+ */
+
+/* With MD_FLAG_CONTIGUOUSCODE, the contents of a code block is sent in a
+ * single MD_TEXT_CODE callback, pointing directly into the document, if it
+ * is verbatim a contiguous part of it: I.e. if no indentation (nor any
+ * container marks like '>') has to be removed from the lines, no tab has to
+ * be expanded, and all the lines (including the last one) end with '\n'.
+ * This is typical for a fenced code block which is not nested in any
+ * container. Otherwise the contents is sent line by line as usual.
+ *
+ * If such contiguous contents contains any '\0', it is split there: The
+ * pieces between the '\0's are sent as MD_TEXT_CODE (still pointing into the
+ * document), each '\0' as a MD_TEXT_NULLCHAR.
+ */
 
 /* Renderer structure.
  */
@@ -329,6 +391,305 @@ struct MD_RENDERER_tag {
 int md_parse(const MD_CHAR* text, MD_SIZE size, const MD_RENDERER* renderer, void* userdata);
 
 
+/* Reusable parser.
+ *
+ * md_parse() allocates all its internal working buffers (e.g. the stack of
+ * inline marks or the buffer of analyzed blocks) from scratch and releases
+ * them when it returns. Applications parsing many documents (e.g. a server
+ * rendering lots of small comments) may instead create a parser object once
+ * and reuse it for all the documents: The buffers then survive between the
+ * calls, so in a steady state the parsing does not need to (re)allocate them
+ * at all.
+ *
+ * The parser is bound to the dialect flags (bitmask of MD_FLAG_xxxx) passed
+ * to md_parser_new(). MD_RENDERER::flags is ignored by md_parser_parse().
+ *
+ * Note the parser object can be used for parsing only one document at a
+ * time. Applications parsing in multiple threads should use a parser object
+ * per thread.
+ */
+typedef struct MD_PARSER_tag MD_PARSER;
+
+/* Memory allocator.
+ *
+ * By default, the parser uses malloc(), realloc() and free() from the
+ * standard C library. Applications may provide their own allocator instead,
+ * e.g. a per-request arena (whose 'release' may then be a no-op) or a
+ * thread-local pool.
+ *
+ * All the memory the parser allocates (including the MD_PARSER structure
+ * itself) goes through these hooks.
+ */
+typedef struct MD_ALLOCATOR_tag MD_ALLOCATOR;
+struct MD_ALLOCATOR_tag {
+    /* Counterpart of malloc(). */
+    void* (*alloc)(MD_SIZE /*size*/, void* /*userdata*/);
+
+    /* Counterpart of realloc(). Note 'ptr' may be NULL (with 'old_size' being
+     * zero). The old size of the block is provided for convenience of
+     * allocators which do not track it on their own (e.g. arenas). */
+    void* (*resize)(void* /*ptr*/, MD_SIZE /*old_size*/, MD_SIZE /*new_size*/, void* /*userdata*/);
+
+    /* Counterpart of free(). It is never called with NULL. */
+    void (*release)(void* /*ptr*/, void* /*userdata*/);
+
+    /* Propagated to the callbacks above. */
+    void* userdata;
+};
+
+/* Create a parser object. Returns NULL if memory allocation fails. */
+MD_PARSER* md_parser_new(unsigned flags);
+
+/* Same as md_parser_new() but the parser uses the given allocator. (The
+ * structure is copied so it does not have to outlive the call.) */
+MD_PARSER* md_parser_new_with_allocator(unsigned flags, const MD_ALLOCATOR* allocator);
+
+/* Destroy the parser object and release all the memory it holds. */
+void md_parser_free(MD_PARSER* parser);
+
+/* Set a high water mark for the retained buffers.
+ *
+ * After each md_parser_parse(), any buffer larger than 'max_bytes' is
+ * released, so that a single huge document does not pin a lot of memory
+ * for the rest of the parser's life. Zero (the default) means the buffers
+ * are never released until md_parser_free() is called.
+ */
+void md_parser_set_high_water_mark(MD_PARSER* parser, MD_SIZE max_bytes);
+
+/* Allow md_parser_parse() to use up to 'n_threads' threads for a large
+ * document. Zero or one (the default) means the document is parsed in the
+ * calling thread only.
+ *
+ * The output is exactly the same as with sequential parsing: All the
+ * callbacks are still called from the calling thread and in the document
+ * order. However the allocator (if any) must be thread-safe, and
+ * MD_RENDERER::debug_log is not called for problems met in the other threads.
+ *
+ * Small documents (below a few hundreds of kilobytes) are always parsed in
+ * the calling thread only.
+ */
+void md_parser_set_threads(MD_PARSER* parser, unsigned n_threads);
+
+/* Statistics of parsing of a single document.
+ *
+ * If set with md_parser_set_stats(), the structure is reset and filled by
+ * each md_parser_parse(), so that the application can see what makes the
+ * parsing of some documents slow (e.g. lots of inline marks which have to be
+ * rolled back, or buffers which have to grow repeatedly). The counting itself
+ * is cheap but not free; pass NULL to stop it.
+ *
+ * The times are wall clock times. The inline phase includes the time spent in
+ * the callbacks. With multiple threads (see md_parser_set_threads()), the
+ * counts and the buffer sizes are summed over all the threads.
+ */
+typedef struct MD_BUFFER_STATS_tag MD_BUFFER_STATS;
+struct MD_BUFFER_STATS_tag {
+    unsigned n_reallocs;        /* Count of times the buffer has been grown. */
+    MD_SIZE peak_bytes;         /* The most bytes of the buffer used at a time. */
+};
+
+typedef struct MD_STATS_tag MD_STATS;
+struct MD_STATS_tag {
+    unsigned n_lines;           /* Count of lines analyzed. */
+    unsigned n_blocks;          /* Count of blocks (both leaf and container ones). */
+    unsigned n_marks;           /* Count of potential inline delimiters (marks) collected. */
+    unsigned n_resolved_marks;  /* Count of marks resolved (e.g. as emphasis delimiters). */
+    unsigned n_rollbacks;       /* Count of times resolved marks have been undone. */
+    unsigned n_link_ref_defs;   /* Count of link reference definitions. */
+
+    /* Internal buffers of the parser. */
+    MD_BUFFER_STATS marks;
+    MD_BUFFER_STATS block_bytes;
+    MD_BUFFER_STATS containers;
+    MD_BUFFER_STATS buffer;
+
+    double block_time;          /* Seconds spent on analysis of blocks. */
+    double inline_time;         /* Seconds spent on inlines (and the callbacks). */
+};
+
+void md_parser_set_stats(MD_PARSER* parser, MD_STATS* stats);
+
+/* Same as md_parse() but the parser object's buffers are used (and kept for
+ * reuse). The return value has the same meaning as for md_parse().
+ */
+int md_parser_parse(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size,
+                    const MD_RENDERER* renderer, void* userdata);
+
+/* Parse a document which is fed in chunks of arbitrary size, e.g. as it is
+ * being read from a pipe:
+ *
+ *      md_parser_begin(parser, &renderer, userdata);
+ *      while((n = read_some_input(buffer, sizeof(buffer))) > 0)
+ *          md_parser_feed(parser, buffer, n);
+ *      md_parser_finish(parser);
+ *
+ * The callbacks are called as soon as the blocks they describe are complete,
+ * i.e. once no container block (list, block quote) is open and a subsequent
+ * line (typically a blank one) has closed the leaf block. Only the text of
+ * such open blocks is buffered by the parser; the rest of the input may be
+ * discarded as soon as it has been processed. (Link reference definitions
+ * are an exception: their destinations, titles and labels are retained
+ * until md_parser_finish().)
+ *
+ * Unlike md_parse(), the parser cannot see the complete document when it is
+ * processing a block. Therefore a reference link resolves only if the link
+ * reference definition precedes the link, or if it is in the same run of
+ * blocks which are flushed together (e.g. in the same list). Otherwise the
+ * output is the same as md_parse() would produce.
+ *
+ * If md_parser_begin() or md_parser_feed() fails (or a callback aborts the
+ * parsing), all subsequent calls return the same value. md_parser_finish()
+ * must be called in any case to end the document; it returns zero on
+ * success or the error value. The meaning of the values is the same as for
+ * md_parse().
+ */
+int md_parser_begin(MD_PARSER* parser, const MD_RENDERER* renderer, void* userdata);
+int md_parser_feed(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size);
+int md_parser_finish(MD_PARSER* parser);
+
+/* Incremental parsing (e.g. for a live preview in an editor).
+ *
+ * md_parser_load() parses the document (like md_parser_parse()) and keeps a
+ * copy of it in the parser. Then each md_parser_edit() replaces a range of
+ * the document text with another text and re-parses only the top-level
+ * blocks which may have been affected by the edit.
+ *
+ * The callbacks are called only for the re-parsed blocks (without any
+ * MD_BLOCK_DOC); MD_EDIT_INFO then tells how to patch the previous output:
+ * The top-level blocks [first_block, first_block + n_old_blocks) of the old
+ * document have been replaced with the n_new_blocks top-level blocks the
+ * callbacks have just been called for. (Note a block quote or a list
+ * counts as one top-level block, including all its contents.)
+ *
+ * If the edit touches a link reference definition, or if it adds a new one,
+ * the whole document is re-parsed as any link anywhere may have changed.
+ * Then first_block is zero and n_old_blocks is the count of all the old
+ * top-level blocks.
+ *
+ * The offsets passed to the callbacks (if any) refer to the edited document
+ * text. The parser keeps the document until it is freed or until it is used
+ * for parsing another document with md_parser_parse(), md_parser_begin() or
+ * md_parser_load().
+ *
+ * If md_parser_edit() fails, the document is dropped and it has to be
+ * loaded again. Invalid range of the edit makes it fail with -1 too.
+ */
+typedef struct MD_EDIT_INFO_tag MD_EDIT_INFO;
+struct MD_EDIT_INFO_tag {
+    unsigned first_block;
+    unsigned n_old_blocks;
+    unsigned n_new_blocks;
+};
+
+int md_parser_load(MD_PARSER* parser, const MD_CHAR* text, MD_SIZE size,
+                   const MD_RENDERER* renderer, void* userdata);
+int md_parser_edit(MD_PARSER* parser, MD_OFFSET offset, MD_SIZE removed_size,
+                   const MD_CHAR* inserted, MD_SIZE inserted_size,
+                   const MD_RENDERER* renderer, void* userdata, MD_EDIT_INFO* info);
+
+
+/* Parsing into a tape (pull model).
+ *
+ * md_parse_to_tape() parses the document and records all the events (i.e.
+ * what would be the calls of the MD_RENDERER callbacks) into a compact array.
+ * The application may then walk the tape with an iterator (looking ahead as
+ * needed), or replay it into any renderer (or into several of them) as many
+ * times as it likes, without parsing the document again.
+ *
+ * The tape refers to the document text (for MD_EVENT_TEXT), so the document
+ * must not be changed or freed while the tape is in use.
+ *
+ * md_parse_to_tape() returns NULL on failure.
+ */
+typedef struct MD_TAPE_tag MD_TAPE;
+
+typedef enum MD_EVENTTYPE {
+    MD_EVENT_ENTER_BLOCK = 0,
+    MD_EVENT_LEAVE_BLOCK,
+    MD_EVENT_ENTER_SPAN,
+    MD_EVENT_LEAVE_SPAN,
+    MD_EVENT_TEXT
+} MD_EVENTTYPE;
+
+/* Iterator of the tape.
+ *
+ * md_tape_iter_init() sets the iterator before the first event. Each
+ * md_tape_iter_next() then moves to the next event and returns non-zero, or
+ * it returns zero at the end of the tape. md_tape_iter_skip() may be used
+ * on MD_EVENT_ENTER_BLOCK or MD_EVENT_ENTER_SPAN to move to the matching
+ * MD_EVENT_LEAVE_BLOCK or MD_EVENT_LEAVE_SPAN (skipping all the contents).
+ *
+ * The iterator is a plain structure: To look ahead, copy it and move the
+ * copy.
+ */
+typedef struct MD_TAPE_ITER_tag MD_TAPE_ITER;
+struct MD_TAPE_ITER_tag {
+    /* The current event. */
+    MD_EVENTTYPE event;
+    int type;                   /* MD_BLOCKTYPE, MD_SPANTYPE or MD_TEXTTYPE. */
+    void* detail;               /* Same as the callbacks get; valid until the iterator is moved. */
+    const MD_CHAR* text;        /* MD_EVENT_TEXT only. */
+    MD_SIZE size;               /* MD_EVENT_TEXT only. */
+    MD_OFFSET offset;           /* MD_EVENT_TEXT only: Offset of the text in the document,
+                                 * or (MD_OFFSET)(-1) if the text is not a part of it. */
+
+    /* Internal. */
+    const MD_TAPE* tape;
+    MD_SIZE index;
+    union {
+        MD_BLOCK_UL_DETAIL ul;
+        MD_BLOCK_OL_DETAIL ol;
+        MD_BLOCK_H_DETAIL h;
+        MD_BLOCK_CODE_DETAIL code;
+        MD_BLOCK_TD_DETAIL td;
+        MD_SPAN_A_DETAIL a;
+        MD_SPAN_IMG_DETAIL img;
+    } detail_buf;
+};
+
+MD_TAPE* md_parse_to_tape(const MD_CHAR* text, MD_SIZE size, unsigned flags);
+void md_tape_free(MD_TAPE* tape);
+
+void md_tape_iter_init(MD_TAPE_ITER* iter, const MD_TAPE* tape);
+int md_tape_iter_next(MD_TAPE_ITER* iter);
+void md_tape_iter_skip(MD_TAPE_ITER* iter);
+
+/* Call the callbacks of the renderer as recorded in the tape. (Only the
+ * callbacks are used; MD_RENDERER::flags is ignored.) The return value has
+ * the same meaning as for md_parse().
+ */
+int md_tape_replay(const MD_TAPE* tape, const MD_RENDERER* renderer, void* userdata);
+
+/* Binary images of tapes (e.g. for a cache of parsed documents).
+ *
+ * md_tape_serialize() stores the tape, together with a copy of the document,
+ * into a self-contained binary image. It returns the size of the image; if
+ * the buffer is NULL or smaller than that, nothing is stored (so the function
+ * may be called twice: first to get the size, then to store the image).
+ *
+ * md_replay_mapped() then calls the callbacks of the renderer as recorded
+ * in the image, directly from the memory where the image is (e.g. a memory
+ * mapped file), without any parsing or allocations (except for a document
+ * nested very deeply). The image must be aligned to 8 bytes. An image which
+ * is damaged, or made by MD4C of another version or configuration (or on a
+ * machine with another byte order), is rejected with -1; the callbacks are
+ * then not called at all. Otherwise the return value has the same meaning as
+ * for md_parse().
+ *
+ * md_image_matches() tells whether the image has been made from the given
+ * document parsed with the given flags, i.e. whether it can be used instead
+ * of parsing the document. (A damaged image never matches.) md_image_hash()
+ * returns the hash the image is keyed with (e.g. to name the files of the
+ * cache).
+ */
+MD_SIZE md_tape_serialize(const MD_TAPE* tape, void* buffer, MD_SIZE buffer_size);
+int md_replay_mapped(const void* image, MD_SIZE image_size,
+                     const MD_RENDERER* renderer, void* userdata);
+int md_image_matches(const void* image, MD_SIZE image_size,
+                     const MD_CHAR* text, MD_SIZE size, unsigned flags);
+unsigned md_image_hash(const MD_CHAR* text, MD_SIZE size, unsigned flags);
+
+
 #ifdef __cplusplus
     }  /* extern "C" { */
 #endif
@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Generator of the corpus for the throughput benchmark (md4c-bench).
+#
+# Usage: bench_corpus.py -o corpus/
+#        md4c-bench --ftables corpus/*.md
+#
+# For each category of documents (prose, link-heavy, table-heavy, deeply
+# nested lists and quotes, code-heavy and HTML-heavy), a document of each
+# size (1 KB up to 100 MB by default) is written as "<category>-<size>.md".
+# The documents are generated from a fixed random seed, so the corpus is
+# the same on each run and benchmark results of different versions of MD4C
+# can be compared.
+
+import argparse
+import os
+import random
+import sys
+
+parser = argparse.ArgumentParser(description='Generate corpus for md4c-bench.')
+parser.add_argument('-o', '--output', dest='output', default='corpus',
+        help='directory to write the documents into')
+parser.add_argument('-m', '--max-size', dest='max_size', default='100M',
+        help='size of the largest documents (1K, 10K, ..., 100M)')
+parser.add_argument('-c', '--category', dest='categories', nargs='*', default=None,
+        help='categories to generate (all by default)')
+args = parser.parse_args(sys.argv[1:])
+
+
+WORDS = ("lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor "
+         "incididunt ut labore et dolore magna aliqua enim ad minim veniam quis nostrud "
+         "exercitation ullamco laboris nisi aliquip ex ea commodo consequat duis aute irure "
+         "in reprehenderit voluptate velit esse cillum fugiat nulla pariatur excepteur sint "
+         "occaecat cupidatat non proident sunt culpa qui officia deserunt mollit anim id est "
+         "laborum").split()
+
+
+def words(rnd, n):
+    return " ".join(rnd.choice(WORDS) for i in range(n))
+
+
+def sentence(rnd):
+    s = words(rnd, rnd.randrange(5, 15))
+    return s[0].upper() + s[1:] + rnd.choice([".", ".", ".", "!", "?", ","])
+
+
+def prose(rnd):
+    # Paragraphs with some emphasis, code spans and an occasional header.
+    parts = []
+    if rnd.randrange(8) == 0:
+        parts.append("#" * rnd.randrange(1, 4) + " " + words(rnd, 4) + "\n\n")
+    lines = []
+    for i in range(rnd.randrange(2, 8)):
+        s = sentence(rnd)
+        kind = rnd.randrange(10)
+        if kind == 0:
+            s = "*" + s + "*"
+        elif kind == 1:
+            s = s.replace(" ", " **", 1) + "**"
+        elif kind == 2:
+            s = s + " `" + rnd.choice(WORDS) + "()`"
+        lines.append(s)
+    parts.append("\n".join(lines) + "\n\n")
+    return "".join(parts)
+
+
+def links(rnd):
+    # Inline links, reference links (with their definitions) and autolinks.
+    lines = []
+    defs = []
+    for i in range(rnd.randrange(2, 6)):
+        label = words(rnd, 2)
+        kind = rnd.randrange(5)
+        if kind == 0:
+            lines.append("See [%s](http://example.com/%s \"%s\") now." % (label, label.replace(" ", "/"), words(rnd, 3)))
+        elif kind == 1:
+            n = rnd.randrange(1000)
+            lines.append("A [%s][ref%d] link." % (label, n))
+            defs.append("[ref%d]: http://example.com/%d \"%s\"\n" % (n, n, label))
+        elif kind == 2:
+            n = rnd.randrange(1000)
+            lines.append("A [%s %d] shortcut." % (label.upper(), n))
+            defs.append("[%s %d]: /%s\n" % (label, n, label.replace(" ", "-")))
+        elif kind == 3:
+            lines.append("Visit <https://www.example.com/%s> or ![%s](/img/%s.png)." % (label.replace(" ", "_"), label, label.replace(" ", "")))
+        else:
+            lines.append(sentence(rnd) + " [not a link] " + sentence(rnd))
+    return "\n".join(lines) + "\n\n" + "".join(defs) + ("\n" if defs else "")
+
+
+def tables(rnd):
+    # Tables (with MD_FLAG_TABLES) with inline markup in some cells.
+    n_cols = rnd.randrange(2, 8)
+    align = [rnd.choice(["---", ":---", "---:", ":---:"]) for i in range(n_cols)]
+    rows = ["| " + " | ".join(words(rnd, rnd.randrange(1, 3)) for i in range(n_cols)) + " |",
+            "|" + "|".join(align) + "|"]
+    for r in range(rnd.randrange(3, 20)):
+        cells = []
+        for c in range(n_cols):
+            cell = words(rnd, rnd.randrange(1, 4))
+            kind = rnd.randrange(8)
+            if kind == 0:
+                cell = "**" + cell + "**"
+            elif kind == 1:
+                cell = "`" + cell + "`"
+            elif kind == 2:
+                cell = "[" + cell + "](/url)"
+            cells.append(cell)
+        rows.append("| " + " | ".join(cells) + " |")
+    return "\n".join(rows) + "\n\n"
+
+
+def nesting(rnd):
+    # Deeply nested lists and block quotes.
+    lines = []
+    depth = rnd.randrange(4, 24)
+    prefix = ""
+    for d in range(depth):
+        kind = rnd.randrange(3)
+        if kind == 0:
+            mark = "> "
+        elif kind == 1:
+            mark = rnd.choice(["- ", "* ", "+ "])
+        else:
+            mark = "%d. " % rnd.randrange(1, 10)
+        lines.append(prefix + mark + sentence(rnd))
+        if mark == "> ":
+            prefix += "> "
+        else:
+            prefix += " " * len(mark)
+        if rnd.randrange(3) == 0:
+            lines.append(prefix.rstrip())
+            lines.append(prefix + sentence(rnd))
+    return "\n".join(lines) + "\n\n"
+
+
+def code(rnd):
+    # Fenced and indented code blocks; code spans.
+    kind = rnd.randrange(3)
+    if kind == 0:
+        body = "\n".join("    " * rnd.randrange(4) + words(rnd, rnd.randrange(1, 10)) + ";"
+                         for i in range(rnd.randrange(3, 30)))
+        fence = rnd.choice(["```", "~~~~"])
+        return fence + rnd.choice(["", "c", "python"]) + "\n" + body + "\n" + fence + "\n\n"
+    elif kind == 1:
+        body = "\n".join("    " + "  " * rnd.randrange(4) + words(rnd, rnd.randrange(1, 10))
+                         for i in range(rnd.randrange(3, 30)))
+        return body + "\n\n"
+    else:
+        return " ".join("`%s` %s" % (words(rnd, 2), sentence(rnd)) for i in range(rnd.randrange(2, 6))) + "\n\n"
+
+
+def html(rnd):
+    # Raw HTML blocks of various types and inline raw HTML.
+    kind = rnd.randrange(5)
+    if kind == 0:
+        return "<div class=\"%s\">\n%s\n</div>\n\n" % (rnd.choice(WORDS), sentence(rnd))
+    elif kind == 1:
+        rows = "".join("<tr><td>%s</td><td>%s</td></tr>\n" % (words(rnd, 2), words(rnd, 2)) for i in range(rnd.randrange(2, 10)))
+        return "<table>\n" + rows + "</table>\n\n"
+    elif kind == 2:
+        return "<!-- %s\n%s -->\n\n" % (sentence(rnd), sentence(rnd))
+    elif kind == 3:
+        return "<pre>\n%s\n%s\n</pre>\n\n" % (sentence(rnd), sentence(rnd))
+    else:
+        return "%s <span title=\"%s\">%s</span> <em>%s</em> <br/> %s\n\n" % (
+                sentence(rnd), words(rnd, 2), sentence(rnd), words(rnd, 2), sentence(rnd))
+
+
+categories = [
+    ("prose", prose),
+    ("links", links),
+    ("tables", tables),
+    ("nesting", nesting),
+    ("code", code),
+    ("html", html),
+]
+
+sizes = [("1K", 1 << 10), ("10K", 10 << 10), ("100K", 100 << 10),
+         ("1M", 1 << 20), ("10M", 10 << 20), ("100M", 100 << 20)]
+
+# Documents larger than this are made by repeating a generated one. (The
+# parser does not care, and generating all of it would take ages.)
+UNIQUE_SIZE = 4 << 20
+
+
+def make_document(generate, size):
+    rnd = random.Random(size)
+    parts = []
+    n = 0
+    while n < min(size, UNIQUE_SIZE):
+        part = generate(rnd)
+        parts.append(part)
+        n += len(part.encode('utf-8'))
+    doc = "".join(parts).encode('utf-8')
+    if len(doc) < size:
+        doc = doc * ((size + len(doc) - 1) // len(doc))
+        doc = doc[:doc.rfind(b"\n\n", 0, size) + 2]
+    return doc
+
+
+max_sizes = [s[0] for s in sizes]
+if args.max_size not in max_sizes:
+    sys.stderr.write("Unknown size %s (use one of %s).\n" % (args.max_size, ", ".join(max_sizes)))
+    exit(1)
+sizes = sizes[:max_sizes.index(args.max_size) + 1]
+
+os.makedirs(args.output, exist_ok=True)
+for (name, generate) in categories:
+    if args.categories and name not in args.categories:
+        continue
+    for (size_name, size) in sizes:
+        path = os.path.join(args.output, "%s-%s.md" % (name, size_name))
+        with open(path, 'wb') as f:
+            f.write(make_document(generate, size))
+        sys.stdout.write("%s\n" % path)
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Generates the perfect hash table of the tag names which start the raw HTML
+# blocks of type 1 and 6, used by md4c.c (see md_is_html_block_start_condition()).
+#
+# Usage: build_html_tags.py > tags.c
+#
+# Then replace the generated part of md4c.c (between the "BEGIN/END GENERATED"
+# comments) with the output.
+#
+# The hash of a tag name is computed in md4c.c char by char as the name is
+# scanned (see MD_HTML_TAG_HASH_STEP()), with the chars folded to lowercase.
+# Its top bits select a displacement, which is added to the hash to get the
+# slot in the table of the tag names. The displacements are chosen so that
+# each name gets its own slot, and the table has no empty slots (i.e. the hash
+# is a minimal perfect one).
+
+import io
+import sys
+
+
+# Type 1: Followed by whitespace, '>' or the end of the line.
+TAGS_1 = [ "pre", "script", "style" ]
+
+# Type 6: Also as the closing tag, and followed by whitespace, '>', "/>" or the
+# end of the line.
+TAGS_6 = [
+    "address", "article", "aside", "base", "basefont", "blockquote", "body",
+    "caption", "center", "col", "colgroup", "dd", "details", "dialog", "dir",
+    "div", "dl", "dt", "fieldset", "figcaption", "figure", "footer", "form",
+    "frame", "frameset", "h1", "h2", "h3", "h4", "h5", "h6", "head", "header",
+    "hr", "html", "iframe", "legend", "li", "link", "main", "menu", "menuitem",
+    "meta", "nav", "noframes", "ol", "optgroup", "option", "p", "param",
+    "section", "source", "summary", "table", "tbody", "td", "tfoot", "th",
+    "thead", "title", "tr", "track", "ul"
+]
+
+DISP_BITS = 5       # Count of the top bits of the hash selecting the displacement.
+HASH_MUL = 0x01000193
+
+
+def hash_name(name, seed):
+    h = seed
+    for ch in name:
+        h = ((h ^ (ord(ch) | 0x20)) * HASH_MUL) & 0xffffffff
+    return h
+
+
+def build(tags, seed):
+    # Assign the displacements, the largest buckets first.
+    n = len(tags)
+    buckets = [[] for i in range(1 << DISP_BITS)]
+    for name in tags:
+        h = hash_name(name, seed)
+        buckets[h >> (32 - DISP_BITS)].append((name, h))
+    disp = [0] * len(buckets)
+    slots = [None] * n
+    for b in sorted(range(len(buckets)), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for d in range(256):
+            idx = [((h + d) & 0xffffffff) % n for (name, h) in buckets[b]]
+            if len(set(idx)) == len(idx)  and  all(slots[i] is None for i in idx):
+                disp[b] = d
+                for (i, (name, h)) in zip(idx, buckets[b]):
+                    slots[i] = name
+                break
+        else:
+            return None
+    return (disp, slots)
+
+
+tags = TAGS_1 + TAGS_6
+assert len(set(tags)) == len(tags)
+for seed in range(1, 1 << 20):
+    res = build(tags, seed)
+    if res is not None:
+        break
+(disp, slots) = res
+
+# (Sanity check: look up all the names again.)
+for name in tags:
+    h = hash_name(name, seed)
+    assert slots[((h + disp[h >> (32 - DISP_BITS)]) & 0xffffffff) % len(tags)] == name
+
+out = io.StringIO()
+out.write("/* BEGIN GENERATED by scripts/build_html_tags.py. Do not edit. */\n")
+out.write("#define MD_HTML_TAG_MAXLEN          %d\n" % max(len(name) for name in tags))
+out.write("#define MD_HTML_TAG_HASH_SEED       0x%08xU\n" % seed)
+out.write("#define MD_HTML_TAG_HASH_STEP(h, ch)    ((((h) ^ ((unsigned)(ch) | 0x20)) * 0x%08xU) & 0xffffffffU)\n" % HASH_MUL)
+out.write("#define MD_HTML_TAG_DISP_SHIFT      %d\n" % (32 - DISP_BITS))
+out.write("\n")
+out.write("static const unsigned char md_html_tag_disp[%d] = {\n" % len(disp))
+for i in range(0, len(disp), 16):
+    out.write("    " + ", ".join("%d" % d for d in disp[i:i+16]) + ("," if i + 16 < len(disp) else "") + "\n")
+out.write("};\n")
+out.write("\n")
+out.write("static const MD_HTML_TAG md_html_tags[%d] = {\n" % len(slots))
+entries = ["{ _T(\"%s\"), %d, %d }" % (name, len(name), (1 if name in TAGS_1 else 6)) for name in slots]
+for i in range(0, len(entries), 4):
+    out.write("    " + ", ".join(entries[i:i+4]) + ("," if i + 4 < len(entries) else "") + "\n")
+out.write("};\n")
+out.write("/* END GENERATED */\n")
+
+sys.stdout.write(out.getvalue())
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Benchmark of the parser instantiations specialized for common flag sets
+# (see md_setup_specialized() in md4c.c).
+#
+# Usage: flags_bench.py -p path/to/md2html -b path/to/baseline/md2html
+#
+# The baseline program should be built the same way, only with the macro
+# MD4C_NO_SPECIALIZATION defined, so it runs the generic code only. Both are
+# run in the CommonMark-only and in the GitHub-like configuration (tables and
+# permissive autolinks) on a document made of the examples from the spec
+# files. The reported time is the best one of the block and inline phase (as
+# reported by "md2html --stat") of all the runs. If "perf" is available, also
+# the count of branches executed by each program is reported.
+
+import argparse
+import random
+import re
+import sys
+from shutil import which
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run benchmark of the flag set specializations.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to benchmark')
+parser.add_argument('-b', '--baseline', dest='baseline', nargs='?', default=None,
+        help='the same program built with MD4C_NO_SPECIALIZATION')
+parser.add_argument('-s', '--spec', dest='spec', nargs='*', default=['test/spec.txt', 'test/tables.txt'],
+        help='spec files to take the examples from')
+parser.add_argument('-n', '--size', dest='size', type=int, default=8*1024*1024,
+        help='minimal size of the input document (in bytes)')
+parser.add_argument('-r', '--runs', dest='runs', type=int, default=5,
+        help='number of runs of each configuration')
+args = parser.parse_args(sys.argv[1:])
+
+
+def get_examples(specfile):
+    examples = []
+    example = None
+    with open(specfile, 'r', encoding='utf-8', newline='\n') as f:
+        for line in f:
+            if line.startswith('```````````````````````````````` example'):
+                example = []
+            elif example is not None and line.strip() == '.':
+                examples.append(''.join(example).replace('→', '\t'))
+                example = None
+            elif example is not None:
+                example.append(line)
+    return examples
+
+
+def make_document(examples, seed):
+    rnd = random.Random(seed)
+    parts = []
+    size = 0
+    while size < args.size:
+        part = rnd.choice(examples)
+        parts.append(part)
+        size += len(part) + 2
+    return "\n\n".join(parts)
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+def measure_time(program, options, doc):
+    best = None
+    for i in range(args.runs):
+        p = run([program, "--stat"] + options, input=doc, stdout=DEVNULL, stderr=PIPE)
+        err = p.stderr.decode('utf-8')
+        m1 = re.search(r"Block phase:\s*([0-9.]+) ms", err)
+        m2 = re.search(r"Inline phase:\s*([0-9.]+) ms", err)
+        if p.returncode != 0 or m1 is None or m2 is None:
+            return None
+        t = (float(m1.group(1)) + float(m2.group(1))) / 1e3
+        if best is None or t < best:
+            best = t
+    return best
+
+
+def measure_branches(program, options, doc):
+    if which("perf") is None:
+        return None
+    p = run(["perf", "stat", "-x,", "-e", "branches:u", program] + options,
+            input=doc, stdout=DEVNULL, stderr=PIPE)
+    for line in p.stderr.decode('utf-8').splitlines():
+        fields = line.split(',')
+        if len(fields) > 2 and fields[2].startswith('branches') and fields[0].isdigit():
+            return int(fields[0])
+    return None
+
+
+examples = []
+for specfile in args.spec:
+    examples += get_examples(specfile)
+doc = make_document(examples, 1).encode('utf-8')
+
+configurations = [
+    ("CommonMark", []),
+    ("GitHub-like", ["--ftables", "--fpermissive-autolinks"]),
+]
+
+failed = 0
+for (name, options) in configurations:
+    for (label, program) in (("generic", args.baseline), ("specialized", args.program)):
+        out("%-30s " % (name + " (" + label + "):"))
+        t = measure_time(program, options, doc)
+        if t is None:
+            out("[ERROR]\n")
+            failed += 1
+            continue
+        out("%8.2f ms  %8.1f MB/s" % (t * 1e3, len(doc) / max(t, 1e-6) / (1024*1024)))
+        branches = measure_branches(program, options, doc)
+        if branches is not None:
+            out("  %14d branches" % branches)
+        out("\n")
+
+exit(failed)
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Microbenchmark of the recognition of the raw HTML block start conditions
+# (see md_is_html_block_start_condition() in md4c.c).
+#
+# Usage: html_tags_bench.py -p path/to/md2html [-b path/to/baseline/md2html]
+#
+# The input is dominated by lines starting with '<': tags starting the blocks
+# of type 1 and 6 (in random case, opening as well as closing), other tags
+# (which have to be checked for the type 7) and other raw HTML (comments,
+# declarations). The reported time is the best one of the block phase (as
+# reported by "md2html --stat") of all the runs. If the baseline program (e.g.
+# md2html of a previous version) is given, it is measured too for comparison.
+
+import argparse
+import random
+import re
+import sys
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run HTML block start microbenchmark.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to benchmark')
+parser.add_argument('-b', '--baseline', dest='baseline', nargs='?', default=None,
+        help='program to compare with')
+parser.add_argument('-n', '--size', dest='size', type=int, default=8*1024*1024,
+        help='minimal size of the input document (in bytes)')
+parser.add_argument('-r', '--runs', dest='runs', type=int, default=5,
+        help='number of runs of each program')
+args = parser.parse_args(sys.argv[1:])
+
+
+BLOCK_TAGS = ["address", "article", "aside", "blockquote", "body", "caption",
+              "center", "colgroup", "details", "div", "dl", "fieldset", "figcaption",
+              "figure", "footer", "form", "h1", "h2", "h6", "header", "hr", "li",
+              "main", "menu", "nav", "ol", "p", "section", "summary", "table", "tbody",
+              "td", "th", "thead", "title", "tr", "ul", "pre", "script", "style"]
+OTHER_TAGS = ["a", "span", "em", "strong", "img", "code", "abbr", "b", "i",
+              "label", "input", "button", "select", "textarea", "video"]
+
+
+def random_case(rnd, name):
+    kind = rnd.randrange(4)
+    if kind == 0:
+        return name.upper()
+    elif kind == 1:
+        return name.capitalize()
+    return name
+
+
+def make_document(rnd):
+    parts = []
+    size = 0
+    while size < args.size:
+        kind = rnd.randrange(8)
+        if kind < 4:
+            name = random_case(rnd, rnd.choice(BLOCK_TAGS))
+            closer = ("/" if rnd.randrange(3) == 0 else "")
+            line = "<%s%s%s" % (closer, name, rnd.choice([">", " class=\"x\">", "", "/>"]))
+            if name.lower() in ("pre", "script", "style"):
+                # (Or the block would last till the end of the document.)
+                line = "<%s>\n</%s>" % (name, name)
+        elif kind < 6:
+            name = random_case(rnd, rnd.choice(OTHER_TAGS))
+            line = "<%s title=\"t\">" % name
+        elif kind == 6:
+            line = "<!-- comment -->"
+        else:
+            line = "<!DOCTYPE html>"
+        part = line + "\n\n"
+        parts.append(part)
+        size += len(part)
+    return "".join(parts)
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+def measure_time(program, doc):
+    best = None
+    for i in range(args.runs):
+        p = run([program, "--stat"], input=doc, stdout=DEVNULL, stderr=PIPE)
+        m = re.search(r"Block phase:\s*([0-9.]+) ms", p.stderr.decode('utf-8'))
+        if p.returncode != 0 or m is None:
+            return None
+        t = float(m.group(1)) / 1e3
+        if best is None or t < best:
+            best = t
+    return best
+
+
+doc = make_document(random.Random(1)).encode('utf-8')
+
+failed = 0
+for (label, program) in (("baseline", args.baseline), ("program", args.program)):
+    if program is None:
+        continue
+    out("%-20s " % (label + ":"))
+    t = measure_time(program, doc)
+    if t is None:
+        out("[ERROR]\n")
+        failed += 1
+        continue
+    out("%8.2f ms  %8.1f MB/s\n" % (t * 1e3, len(doc) / max(t, 1e-6) / (1024*1024)))
+
+exit(failed)
@@ -35,3 +35,42 @@ $PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/coverage.txt" -p "$PROGRAM"
 $PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/permissive-email-autolinks.txt" -p "$PROGRAM --fpermissive-email-autolinks"
 $PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/permissive-url-autolinks.txt" -p "$PROGRAM --fpermissive-url-autolinks"
 $PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/tables.txt" -p "$PROGRAM --ftables"
+
+# Test parsing of input fed in chunks:
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/streaming.txt" -p "$PROGRAM --stream"
+
+# Test rendering from a recorded tape of events:
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/spec.txt" -p "$PROGRAM --tape"
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/tables.txt" -p "$PROGRAM --tape --ftables"
+
+# Test rendering from a binary image of the tape:
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/spec.txt" -p "$PROGRAM --image"
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/coverage.txt" -p "$PROGRAM --image"
+
+# Test damaged binary images are rejected (or rendered) safely:
+$PYTHON "$TEST_DIR/image_tests.py" -p "$PROGRAM"
+
+# Test merging of adjacent text into single callbacks:
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/spec.txt" -p "$PROGRAM --fcoalesce-text --fsoftbr-as-text"
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/coverage.txt" -p "$PROGRAM --fcoalesce-text"
+
+# Test passing contents of code blocks in single callbacks:
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/spec.txt" -p "$PROGRAM --fcontiguous-code"
+$PYTHON "$TEST_DIR/spec_tests.py" -s "$TEST_DIR/coverage.txt" -p "$PROGRAM --fcontiguous-code"
+
+# Test parsing of large documents with multiple threads:
+$PYTHON "$TEST_DIR/parallel_tests.py" -s "$TEST_DIR/spec.txt" "$TEST_DIR/coverage.txt" "$TEST_DIR/tables.txt" -p "$PROGRAM"
+
+# Test validation (and repair) of malformed UTF-8 input:
+$PYTHON "$TEST_DIR/utf8_tests.py" -s "$TEST_DIR/spec.txt" "$TEST_DIR/coverage.txt" "$TEST_DIR/tables.txt" -p "$PROGRAM"
+
+# Test documents larger than 4 GiB (if MD4C is built with
+# MD4C_USE_64BIT_OFFSETS). This needs few GB of disk space and takes a while,
+# so it only runs if MD4C_TEST_BIG_DOCS is set:
+if [ -n "$MD4C_TEST_BIG_DOCS" ]; then
+    $PYTHON "$TEST_DIR/bigdoc_tests.py" -p "$PROGRAM"
+fi
+
+# Test inputs which would take too long with a naive (quadratic or worse)
+# implementation:
+$PYTHON "$TEST_DIR/pathological_tests.py" -p "$PROGRAM"
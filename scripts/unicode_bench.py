@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Microbenchmark of the Unicode support (punctuation classification and case
+# folding) on CJK and Cyrillic heavy inputs.
+#
+# Usage: unicode_bench.py -p path/to/md2html
+#
+# Each input is dominated by emphasis delimiters next to non-ASCII characters
+# (the flanking checks classify the preceding and the following codepoint)
+# or by link reference labels which have to be case folded to be matched.
+# The program has to be built with MD4C_USE_UTF8 (or the benchmark measures
+# the ASCII-only mode). The reported time is the best one of the inline
+# phase (as reported by "md2html --stat") of all the runs.
+
+import argparse
+import random
+import re
+import sys
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run Unicode microbenchmark.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to benchmark')
+parser.add_argument('-n', '--size', dest='size', type=int, default=4*1024*1024,
+        help='minimal size of each input document (in bytes)')
+parser.add_argument('-r', '--runs', dest='runs', type=int, default=5,
+        help='number of runs of each input')
+args = parser.parse_args(sys.argv[1:])
+
+
+CJK_WORDS = ["日本語", "文字", "中文", "漢字", "한국어", "ひらがな", "カタカナ", "測試", "标点", "段落"]
+CJK_PUNCT = ["。", "、", "「", "」", "『", "』", "（", "）", "！", "？", "・", "〜"]
+CYR_WORDS = ["Привет", "мир", "Москва", "ЁЛКА", "Щука", "язык", "Разметка", "ССЫЛКА", "Ъъ", "Жук"]
+
+
+def make_words(rnd, words, punct, size):
+    parts = []
+    n = 0
+    while n < size:
+        word = rnd.choice(words)
+        kind = rnd.randrange(6)
+        if kind == 0:
+            word = "*" + word + "*"
+        elif kind == 1:
+            word = "**" + word + "**"
+        elif kind == 2:
+            word = "_" + word + "_"
+        if punct and rnd.randrange(3) == 0:
+            word = rnd.choice(punct) + word + rnd.choice(punct)
+        parts.append(word)
+        n += len(word.encode('utf-8')) + 1
+        if len(parts) % 16 == 0:
+            parts.append("\n")
+    return " ".join(parts)
+
+
+def cjk_emph(rnd, size):
+    # CJK text is not separated by spaces, so the delimiters are surrounded
+    # by the (non-ASCII) letters and punctuation.
+    return make_words(rnd, CJK_WORDS, CJK_PUNCT, size).replace(" ", "")
+
+
+def cyrillic_emph(rnd, size):
+    return make_words(rnd, CYR_WORDS, ["«", "»", "—", "„", "“"], size)
+
+
+def cyrillic_links(rnd, size):
+    # Labels differing only in the case, so the matching needs the folding.
+    defs = []
+    uses = []
+    n = 0
+    i = 0
+    while n < size:
+        label = " ".join(rnd.choice(CYR_WORDS) for j in range(3)) + " %d" % i
+        defs.append("[%s]: /url%d\n" % (label, i))
+        use = "[%s] [%s][] [%s]\n\n" % (label.upper(), label.lower(), label.swapcase())
+        uses.append(use)
+        n += len(use.encode('utf-8')) + len(defs[-1].encode('utf-8'))
+        i += 1
+    return "".join(uses) + "".join(defs)
+
+
+benchmarks = [
+    ("CJK emphasis", cjk_emph),
+    ("Cyrillic emphasis", cyrillic_emph),
+    ("Cyrillic reference links", cyrillic_links),
+]
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+failed = 0
+for (name, make_input) in benchmarks:
+    doc = make_input(random.Random(1), args.size).encode('utf-8')
+    out("%-30s " % (name + ":"))
+
+    best = None
+    for i in range(args.runs):
+        p = run([args.program, "--stat"], input=doc, stdout=DEVNULL, stderr=PIPE)
+        m = re.search(r"Inline phase:\s*([0-9.]+) ms", p.stderr.decode('utf-8'))
+        if p.returncode != 0 or m is None:
+            break
+        t = float(m.group(1)) / 1e3
+        if best is None or t < best:
+            best = t
+
+    if best is None:
+        out("[ERROR]\n")
+        failed += 1
+    else:
+        out("%8.2f ms  %8.1f MB/s\n" % (best * 1e3, len(doc) / max(best, 1e-6) / (1024*1024)))
+
+exit(failed)
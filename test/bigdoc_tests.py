@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Tests of documents larger than 4 GiB (md2html --mmap). These need MD4C built
+# with MD4C_USE_64BIT_OFFSETS; otherwise md2html refuses the input and the
+# tests are skipped.
+#
+# The test document is a (memory-mapped) file made of many copies of a chunk
+# of Markdown, followed by the link reference definitions the chunks use, so
+# the links in all the chunks refer to the definitions beyond the 4 GiB. The
+# output is not kept anywhere; it is just hashed and compared with the hash of
+# the expected output: As the definitions produce no output, that is the HTML
+# of a single chunk (with the definitions) repeated.
+#
+# Note the test needs few GB of disk space and a while to run.
+
+import argparse
+import hashlib
+import os
+import sys
+import tempfile
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run tests of documents larger than 4 GiB.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to test')
+parser.add_argument('-n', '--size', dest='size', type=int, default=(4 << 30) + (64 << 20),
+        help='minimal size of the test document (in bytes)')
+parser.add_argument('-d', '--dir', dest='dir', default=None,
+        help='directory to create the (temporary) test document in')
+args = parser.parse_args(sys.argv[1:])
+
+
+# Starts with a header so that the copies do not merge with the preceding
+# one (e.g. as a continuation of its list).
+chunk = """# Chapter
+
+Some *emphasis*, **strong emphasis**, `code` and a [link][ref] to the end
+of the document, or [another one], ![image](/img.png "title") and
+<http://example.com>.
+
+> A block quote
+> with [a link][ref] and a lazy
+continuation line.
+
+1. An ordered list
+2. with items
+
+   - and a nested
+   - bullet list
+
+```c
+int main(void) { return 0; }
+```
+
+| Not | a table |
+|-----|---------|
+| as tables | are off |
+
+<div>
+raw *HTML* block
+</div>
+
+"""
+
+defs = """[ref]: /reference "Title"
+[another one]: /another
+"""
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+def run_hashed(cmd, input=None):
+    # Run the command and return the exit code and hash of its output.
+    p = Popen(cmd, stdin=(PIPE if input is not None else DEVNULL), stdout=PIPE, stderr=PIPE)
+    if input is not None:
+        p.stdin.write(input)
+        p.stdin.close()
+    h = hashlib.sha256()
+    while True:
+        data = p.stdout.read(1 << 20)
+        if not data:
+            break
+        h.update(data)
+    err = p.stderr.read()
+    return (p.wait(), h.hexdigest(), err.decode('utf-8', errors='replace'))
+
+
+def write_document(path, n_copies):
+    data = (chunk * 256).encode('utf-8')
+    n = n_copies
+    with open(path, 'wb') as f:
+        while n >= 256:
+            f.write(data)
+            n -= 256
+        f.write((chunk * n + defs).encode('utf-8'))
+
+
+def expected_hash(program, n_copies):
+    p = run(program.split(), input=(chunk + defs).encode('utf-8'), stdout=PIPE, stderr=PIPE)
+    html = p.stdout
+    h = hashlib.sha256()
+    data = html * 256
+    n = n_copies
+    while n >= 256:
+        h.update(data)
+        n -= 256
+    h.update(html * n)
+    return h.hexdigest()
+
+
+chunk_size = len(chunk.encode('utf-8'))
+n_copies = (args.size + chunk_size - 1) // chunk_size
+
+tests = [
+    ("document larger than 4 GiB", ""),
+    ("document larger than 4 GiB (threads)", " --threads=4"),
+]
+
+result_counts = {'pass': 0, 'fail': 0, 'error': 0, 'skip': 0}
+
+fd, path = tempfile.mkstemp(suffix='.md', dir=args.dir)
+os.close(fd)
+try:
+    write_document(path, n_copies)
+
+    for (name, options) in tests:
+        out("%-45s " % (name + ":"))
+
+        (retcode, actual, err) = run_hashed((args.program + options + " --mmap").split() + [path])
+        if retcode != 0  and  "too large" in err:
+            out("[SKIPPED] built without 64-bit offsets\n")
+            result_counts['skip'] += 1
+        elif retcode != 0:
+            out("[ERROR] program returned error code %d\n" % retcode)
+            result_counts['error'] += 1
+        elif actual == expected_hash(args.program + options, n_copies):
+            out("[PASSED]\n")
+            result_counts['pass'] += 1
+        else:
+            out("[FAILED]\n")
+            result_counts['fail'] += 1
+finally:
+    os.unlink(path)
+
+out("{pass} passed, {fail} failed, {error} errored, {skip} skipped\n".format(**result_counts))
+exit(result_counts['fail'] + result_counts['error'])
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Tests of damaged binary images (md2html --write-image, --read-image). The
+# image of a document with all kinds of block and span details is damaged in
+# many ways, one bit at a time. Rendering from the damaged image must never
+# crash (or hang): The image is either rejected, or the damage is harmless.
+#
+# Some damage has to be always detected: Any change of the kind or the type of
+# a block or span event breaks the nesting, and a block or span which needs a
+# detail (e.g. a link) must not lose it.
+
+import argparse
+import random
+import struct
+import sys
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run tests of damaged binary images.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to test')
+parser.add_argument('-t', '--timeout', dest='timeout', type=float, default=10.0,
+        help='time limit for rendering of each image (in seconds)')
+parser.add_argument('-n', '--random', dest='n_random', type=int, default=1000,
+        help='count of random bit flips in the detail arena')
+args = parser.parse_args(sys.argv[1:])
+
+
+doc = """\
+# Header 1
+
+Header 2
+--------
+
+- a
++ b
+
+3) c
+
+4. d
+
+```c++ info
+code
+```
+
+    indented code
+
+> quote
+
+<div>
+html
+</div>
+
+[link](/url "title") ![image *alt*](/src 'title') `code` *em* **strong**
+[ref] &amp; &#35; <span>x</span> <http://example.com>
+
+| a | b | c | d |
+|---|:--|:-:|--:|
+| e | f | g | h |
+
+[ref]: /a&amp;b "&quot;title&quot;"
+"""
+
+# MD_EVENTTYPE
+EVENT_ENTER_BLOCK = 0
+EVENT_LEAVE_BLOCK = 1
+EVENT_ENTER_SPAN = 2
+EVENT_LEAVE_SPAN = 3
+EVENT_TEXT = 4
+
+# Types of the blocks and spans which need a detail.
+BLOCKS_WITH_DETAIL = [2, 3, 6, 7, 14, 15]    # UL, OL, H, CODE, TH, TD
+SPANS_WITH_DETAIL = [2, 3]                  # A, IMG
+
+HASDETAIL = 0x01
+
+
+class Image:
+    def __init__(self, data):
+        self.data = data
+        # See MD_IMAGE_HEADER and md_image_layout().
+        off_size = data[9]
+        self.event_size = data[11]
+        fmt = "=I" if off_size == 4 else "=Q"
+        self.n_events = struct.unpack_from(fmt, data, 24 + off_size)[0]
+        self.arena_size = struct.unpack_from(fmt, data, 24 + 2 * off_size)[0]
+        self.events_off = align(24 + 3 * off_size)
+        self.arena_off = self.events_off + align(self.n_events * self.event_size)
+
+    def event(self, i):
+        off = self.events_off + i * self.event_size
+        return (off, self.data[off], self.data[off + 1], self.data[off + 2])
+
+def align(n):
+    return (n + 7) & ~7
+
+def flip(data, off, bit):
+    damaged = bytearray(data)
+    damaged[off] ^= (1 << bit)
+    return bytes(damaged)
+
+
+def render(image):
+    # Returns the HTML, None if the image is rejected, or the description of
+    # the crash.
+    try:
+        p = run((args.program + " --read-image").split(), input=image,
+                stdout=PIPE, stderr=PIPE, timeout=args.timeout)
+    except TimeoutExpired:
+        return "timeout"
+    if p.returncode < 0:
+        return "crash (signal %d)" % -p.returncode
+    if p.returncode != 0:
+        return None
+    return p.stdout
+
+
+p = run((args.program + " --ftables --write-image").split(), input=doc.encode('utf-8'),
+        stdout=PIPE, stderr=PIPE)
+if p.returncode != 0:
+    print("Cannot write the image.")
+    exit(1)
+image = Image(p.stdout)
+html = run((args.program + " --ftables").split(), input=doc.encode('utf-8'),
+           stdout=PIPE, stderr=PIPE).stdout
+
+# Each test is a list of (description, damaged image, whether the damage has
+# to be detected).
+def intact():
+    return [("intact image", image.data, False)]
+
+def event_flips():
+    for i in range(image.n_events):
+        (off, event, type, flags) = image.event(i)
+        if event == EVENT_TEXT:
+            continue
+        for bit in range(8):
+            yield ("event %d: bit %d of kind" % (i, bit), flip(image.data, off, bit), True)
+            yield ("event %d: bit %d of type" % (i, bit), flip(image.data, off + 1, bit), True)
+
+def flag_flips():
+    for i in range(image.n_events):
+        (off, event, type, flags) = image.event(i)
+        needs_detail = ((event in (EVENT_ENTER_BLOCK, EVENT_LEAVE_BLOCK) and type in BLOCKS_WITH_DETAIL) or
+                        (event in (EVENT_ENTER_SPAN, EVENT_LEAVE_SPAN) and type in SPANS_WITH_DETAIL))
+        for bit in range(8):
+            yield ("event %d: bit %d of flags" % (i, bit), flip(image.data, off + 2, bit),
+                   needs_detail and (1 << bit) == HASDETAIL)
+
+def offset_flips():
+    for i in range(image.n_events):
+        (off, event, type, flags) = image.event(i)
+        for byte in range(4, image.event_size):
+            for bit in range(8):
+                yield ("event %d: bit %d of byte %d" % (i, bit, byte), flip(image.data, off + byte, bit), False)
+
+def arena_flips():
+    rnd = random.Random(1)
+    for i in range(args.n_random):
+        off = image.arena_off + rnd.randrange(image.arena_size)
+        bit = rnd.randrange(8)
+        yield ("arena byte %d: bit %d" % (off, bit), flip(image.data, off, bit), False)
+
+tests = [
+    ("intact image", intact),
+    ("damaged kinds and types of events", event_flips),
+    ("damaged flags of events", flag_flips),
+    ("damaged offsets and sizes of events", offset_flips),
+    ("damaged details", arena_flips),
+]
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+result_counts = {'pass': 0, 'fail': 0, 'error': 0, 'skip': 0}
+
+for (name, damages) in tests:
+    out("%-45s " % (name + ":"))
+
+    failure = None
+    n = 0
+    for (what, damaged, must_reject) in damages():
+        result = render(damaged)
+        n += 1
+        if isinstance(result, str):
+            failure = "%s: %s" % (what, result)
+        elif must_reject and result is not None:
+            failure = "%s: not rejected" % what
+        elif damaged is image.data and result != html:
+            failure = "%s: wrong output" % what
+        if failure is not None:
+            break
+
+    if failure is None:
+        out("[PASSED] %d images\n" % n)
+        result_counts['pass'] += 1
+    else:
+        out("[FAILED] %s\n" % failure)
+        result_counts['fail'] += 1
+
+out("{pass} passed, {fail} failed, {error} errored, {skip} skipped\n".format(**result_counts))
+exit(result_counts['fail'] + result_counts['error'])
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Tests of parsing large documents with multiple threads (md2html --threads).
+# The output has to be exactly the same as when parsed by a single thread.
+#
+# The test documents are made by concatenating the examples from the spec
+# files in a random (but repeatable) order, so the document gets split into
+# parts in all sorts of unusual places: inside of container blocks, fenced
+# code blocks, raw HTML blocks etc.
+
+import argparse
+import random
+import re
+import sys
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run multi-threaded parsing tests.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to test')
+parser.add_argument('-s', '--spec', dest='spec', nargs='*', default=[],
+        help='spec files to take the examples from')
+parser.add_argument('-j', '--threads', dest='threads', type=int, default=4,
+        help='number of threads to use')
+parser.add_argument('-n', '--size', dest='size', type=int, default=2*1024*1024,
+        help='minimal size of each test document (in bytes)')
+args = parser.parse_args(sys.argv[1:])
+
+
+def get_examples(specfile):
+    examples = []
+    example = None
+    with open(specfile, 'r', encoding='utf-8', newline='\n') as f:
+        for line in f:
+            if line.startswith('```````````````````````````````` example'):
+                example = []
+            elif example is not None and line.strip() == '.':
+                examples.append(''.join(example).replace('→', '\t'))
+                example = None
+            elif example is not None:
+                example.append(line)
+    return examples
+
+
+def make_document(examples, seed, separator):
+    rnd = random.Random(seed)
+    parts = []
+    size = 0
+    while size < args.size:
+        part = rnd.choice(examples)
+        parts.append(part)
+        size += len(part) + len(separator)
+    return separator.join(parts)
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+examples = []
+for specfile in args.spec:
+    examples += get_examples(specfile)
+
+tests = [
+    ("separated examples", 1, "\n\n", ""),
+    ("separated examples (tables)", 2, "\n\n", " --ftables"),
+    ("separated examples (no HTML)", 3, "\n\n", " --fno-html --fno-indented-code"),
+    ("concatenated examples", 4, "", ""),
+    ("concatenated examples (tables)", 5, "", " --ftables --fpermissive-autolinks"),
+]
+
+result_counts = {'pass': 0, 'fail': 0, 'error': 0, 'skip': 0}
+
+for (name, seed, separator, options) in tests:
+    doc = make_document(examples, seed, separator).encode('utf-8')
+    out("%-45s " % (name + ":"))
+
+    p1 = run((args.program + options).split(), input=doc, stdout=PIPE, stderr=PIPE)
+    pN = run((args.program + options + " --threads=%d" % args.threads).split(),
+             input=doc, stdout=PIPE, stderr=PIPE)
+
+    if p1.returncode != 0 or pN.returncode != 0:
+        out("[ERROR] program returned error code %d\n" % max(p1.returncode, pN.returncode))
+        result_counts['error'] += 1
+    elif p1.stdout == pN.stdout:
+        out("[PASSED]\n")
+        result_counts['pass'] += 1
+    else:
+        out("[FAILED]\n")
+        result_counts['fail'] += 1
+
+out("{pass} passed, {fail} failed, {error} errored, {skip} skipped\n".format(**result_counts))
+exit(result_counts['fail'] + result_counts['error'])
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Tests of inputs which are known to take quadratic (or worse) time in naive
+# implementations. Each test has to produce the expected output within the
+# time limit.
+#
+# The time limit is the hard threshold: Most of the inputs are large enough so
+# that a quadratic implementation exceeds it by far, even on a fast machine.
+#
+# The time spent on each test is reported so the script also serves as a
+# crude benchmark: For a linear implementation, the time per input byte
+# ("ns/byte") should stay roughly the same as the test inputs grow. For some
+# inputs this is checked too (see 'scaling' below), as even a quadratic
+# implementation may be quite fast for them on a fast machine.
+
+import argparse
+import re
+import sys
+import time
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run pathological input tests.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to test')
+parser.add_argument('-t', '--timeout', dest='timeout', type=float, default=10.0,
+        help='time limit for each test (in seconds)')
+parser.add_argument('-P', '--pattern', dest='pattern', nargs='?', default=None,
+        help='limit to tests matching regex pattern')
+parser.add_argument('-r', '--max-ratio', dest='max_ratio', type=float, default=2.0,
+        help='max. ratio of the time per byte of the larger and smaller input of a scaling pair')
+args = parser.parse_args(sys.argv[1:])
+
+
+def link_ref_defs_test(n):
+    # n link reference definitions, each used twice (once with a different
+    # case and whitespace, which requires the label normalization), and n
+    # uses of undefined references.
+    defs = "".join("[Label %d]: /url%d\n" % (i, i) for i in range(n))
+    uses = "".join("[label  %d][] [LABEL %d] [nolabel %d]\n\n" % (i, i, i) for i in range(n))
+    return (uses + defs,
+            re.compile("(<p><a href=\"/url\\d+\">label  \\d+</a> <a href=\"/url\\d+\">LABEL \\d+</a> \\[nolabel \\d+\\]</p>\n){%d}" % n))
+
+def emph_rule_of_3_test(n):
+    # Each intra-word closer '**' has to skip all the openers '*' (the rule
+    # of 3) before it becomes an opener itself; the following closer '*' then
+    # pairs with the nearest opener '*'.
+    return ("*a " * n + "x**y z*. " * n,
+            re.compile("^<p>(<em>a ){%d}(x\\*\\*y z</em>\\. ){%d}x\\*\\*y z</em>\\.</p>$" % (n, n-1)))
+
+def backtick_test(size):
+    # Unresolved openers of (almost) all possible lengths, followed by a lot of
+    # openers with an escaped first backtick: Each of them looks for an opener
+    # of its full length (and finds none), then it becomes an opener of the
+    # shorter length. So the openers of the same length pile up (and would be
+    # searched through by each following one), until the final closer.
+    head = " ".join("`" * i + "x" for i in range(3, 256)) + " "
+    n = (size - len(head)) // 5
+    return (head + "\\``x " * n + "`",
+            re.compile("^<p>(`+x ){253}(``x ){%d}`<code>x</code></p>$" % (n-1)))
+
+def long_label_test(n):
+    # A link label of n characters (999 at most), each of which case-folds
+    # into 3 codepoints, so the normalized label is as long as it can be.
+    label = "\u0390" * n
+    return ("[%s]: /url\n\n[%s]\n" % (label, label),
+            re.compile("^<p><a href=\"/url\">%s</a></p>$" % label))
+
+pathological = {
+    "many emph openers (100000)":
+            ("*a_" * 100000,
+             re.compile("^<p>(\\*a_){100000}</p>$")),
+    "nested emph and strong (50000)":
+            ("*a **a " * 50000 + "b** b* " * 50000,
+             re.compile("^<p>(<em>a <strong>a ){50000}(b</strong> b</em> ){49999}b</strong> b</em></p>$")),
+    "emph rule of 3 (25000)":               emph_rule_of_3_test(25000),
+    "emph rule of 3 (100000)":              emph_rule_of_3_test(100000),
+    "many backtick openers (256K)":         backtick_test(256 * 1024),
+    "many backtick openers (1M)":           backtick_test(1024 * 1024),
+    "many links (100000)":
+            ("[a](b) " * 100000,
+             re.compile("^<p>(<a href=\"b\">a</a> ){99999}<a href=\"b\">a</a></p>$")),
+    "many reference links (100000)":
+            ("[a] " * 100000 + "\n\n[a]: /url\n",
+             re.compile("^<p>(<a href=\"/url\">a</a> ){99999}<a href=\"/url\">a</a></p>$")),
+    "reference links on many lines (50000)":
+            ("[a]: /url\n'x\n" * 50000,
+             re.compile("^<p>'x\n(<a href=\"/url\">a</a>: /url\n'x\n){49998}<a href=\"/url\">a</a>: /url\n'x</p>$")),
+    "nested images (50000)":
+            ("![" * 50000 + "a" + "](b)" * 50000,
+             re.compile("^<p><img src=\"b\" alt=\"a\"></p>$")),
+    "unclosed link titles (200000)":
+            ("[a](b \"x\n" * 200000,
+             re.compile("^<p>(\\[a\\]\\(b &quot;x\n){199999}\\[a\\]\\(b &quot;x</p>$")),
+    "unclosed link titles in parens (100000)":
+            ("[ (](" * 100000,
+             re.compile("^<p>(\\[ \\(\\]\\(){100000}</p>$")),
+    "link reference definitions (1000)":    link_ref_defs_test(1000),
+    "link reference definitions (5000)":    link_ref_defs_test(5000),
+    "link reference definitions (20000)":   link_ref_defs_test(20000),
+    "longest link label (999)":             long_label_test(999),
+}
+
+# Pairs of tests of the same input in two sizes, for which the time per byte
+# of the larger one must not exceed max_ratio times the one of the smaller one.
+# (For a quadratic implementation, it grows with the ratio of the sizes.) The
+# time of these tests is the best one of few runs, to reduce the noise.
+scaling = [
+    ("emph rule of 3 (25000)",          "emph rule of 3 (100000)"),
+    ("many backtick openers (256K)",    "many backtick openers (1M)"),
+]
+scaling_runs = 3
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+result_counts = {'pass': 0, 'fail': 0, 'error': 0, 'skip': 0}
+pattern_re = re.compile(args.pattern if args.pattern else '.', re.IGNORECASE)
+scaling_names = set(name for pair in scaling for name in pair)
+ns_per_byte = {}
+
+for name in pathological:
+    if not re.search(pattern_re, name):
+        result_counts['skip'] += 1
+        continue
+
+    (inp, regex) = pathological[name]
+    inp_bytes = inp.encode('utf-8')
+    out("%-45s " % (name + ":"))
+
+    elapsed = None
+    try:
+        for i in range(scaling_runs if name in scaling_names else 1):
+            t0 = time.perf_counter()
+            p = run(args.program.split(), input=inp_bytes, stdout=PIPE, stderr=PIPE,
+                    timeout=args.timeout)
+            t = time.perf_counter() - t0
+            if elapsed is None or t < elapsed:
+                elapsed = t
+            if p.returncode != 0:
+                break
+    except TimeoutExpired:
+        out("[TIMEOUT]\n")
+        result_counts['fail'] += 1
+        continue
+
+    if p.returncode != 0:
+        out("[ERROR] program returned error code %d\n" % p.returncode)
+        result_counts['error'] += 1
+    elif re.search(regex, p.stdout.decode('utf-8')):
+        ns_per_byte[name] = elapsed * 1e9 / len(inp_bytes)
+        out("[PASSED] %8.1f ms %8.1f ns/byte\n" % (elapsed * 1e3, ns_per_byte[name]))
+        result_counts['pass'] += 1
+    else:
+        out("[FAILED]\n")
+        result_counts['fail'] += 1
+
+for (small, large) in scaling:
+    if small not in ns_per_byte  or  large not in ns_per_byte:
+        continue
+    ratio = ns_per_byte[large] / ns_per_byte[small]
+    out("%-45s " % ("scaling of " + large + ":"))
+    if ratio <= args.max_ratio:
+        out("[PASSED] %8.2f x ns/byte\n" % ratio)
+        result_counts['pass'] += 1
+    else:
+        out("[FAILED] %8.2f x ns/byte (max. %.2f)\n" % (ratio, args.max_ratio))
+        result_counts['fail'] += 1
+
+out("{pass} passed, {fail} failed, {error} errored, {skip} skipped\n".format(**result_counts))
+exit(result_counts['fail'] + result_counts['error'])
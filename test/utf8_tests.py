@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Tests of the UTF-8 validation (md2html --fvalidate-utf8). Each invalid
+# sequence in the input has to be replaced with U+FFFD, exactly as Python's
+# decoder does it with errors='replace' (both follow the practice recommended
+# by Unicode), so the output has to be the same as for the input repaired by
+# Python and parsed without the validation.
+#
+# Besides some known tricky sequences, the test documents are made of the
+# examples from the spec files with random bytes corrupted. They are large
+# enough to be fed in several chunks with --stream (so the sequences are cut
+# by the chunk boundaries) and to be parsed by multiple threads.
+
+import argparse
+import random
+import sys
+from subprocess import *
+
+parser = argparse.ArgumentParser(description='Run UTF-8 validation tests.')
+parser.add_argument('-p', '--program', dest='program', nargs='?', default=None,
+        help='program to test')
+parser.add_argument('-s', '--spec', dest='spec', nargs='*', default=[],
+        help='spec files to take the examples from')
+parser.add_argument('-n', '--size', dest='size', type=int, default=1024*1024,
+        help='minimal size of each random test document (in bytes)')
+args = parser.parse_args(sys.argv[1:])
+
+
+def get_examples(specfile):
+    examples = []
+    example = None
+    with open(specfile, 'r', encoding='utf-8', newline='\n') as f:
+        for line in f:
+            if line.startswith('```````````````````````````````` example'):
+                example = []
+            elif example is not None and line.strip() == '.':
+                examples.append(''.join(example).replace('→', '\t'))
+                example = None
+            elif example is not None:
+                example.append(line)
+    return examples
+
+
+def make_document(examples, seed):
+    # Besides corrupting random bytes, insert some multi-byte characters so
+    # there are sequences to be cut.
+    rnd = random.Random(seed)
+    parts = []
+    size = 0
+    while size < args.size:
+        part = bytearray(rnd.choice(examples).encode('utf-8') + "é€😀\n\n".encode('utf-8'))
+        for i in range(rnd.randrange(3)):
+            part[rnd.randrange(len(part))] = rnd.randrange(128, 256)
+        parts.append(bytes(part))
+        size += len(part)
+    return b"".join(parts)
+
+
+# Sequences which are invalid as a whole, or only in their part.
+sequences = [
+    b"\x80", b"\xbf", b"\x80\xbf\x80",              # Stray continuations.
+    b"\xc0\xaf", b"\xc1\xbf",                       # Overlong 2-byte.
+    b"\xe0\x80\xaf", b"\xe0\x9f\xbf",               # Overlong 3-byte.
+    b"\xf0\x80\x80\xaf", b"\xf0\x8f\xbf\xbf",       # Overlong 4-byte.
+    b"\xed\xa0\x80", b"\xed\xbf\xbf",               # Surrogates.
+    b"\xf4\x90\x80\x80", b"\xf5\x80", b"\xff",      # Beyond U+10FFFF.
+    b"\xc2", b"\xe2\x82", b"\xf0\x9f\x98",          # Truncated.
+    b"\xe2\x82\xe2\x82\xac", b"\xf0\x9f\xc3\xa9",   # Truncated, then valid.
+]
+
+known = b"".join(b"a" + s + b"b *" + s + b"* [" + s + b"] `" + s + b"`\n\n" for s in sequences)
+known += b"[x\xe2\x82]: /url\n\n[X\xe2\x82]\n\n" + b"\xf0\x9f\x98"
+
+examples = []
+for specfile in args.spec:
+    examples += get_examples(specfile)
+
+tests = [
+    ("known sequences", known, ""),
+    ("known sequences (stream)", known, " --stream"),
+    ("known sequences (tape)", known, " --tape"),
+    ("random corruption", make_document(examples, 1), ""),
+    ("random corruption (stream)", make_document(examples, 2), " --stream"),
+    ("random corruption (image)", make_document(examples, 3), " --image --ftables"),
+    ("random corruption (threads)", make_document(examples, 4), " --threads=4"),
+]
+
+
+def out(str):
+    sys.stdout.buffer.write(str.encode('utf-8'))
+    sys.stdout.flush()
+
+
+result_counts = {'pass': 0, 'fail': 0, 'error': 0, 'skip': 0}
+
+for (name, doc, options) in tests:
+    out("%-45s " % (name + ":"))
+
+    repaired = doc.decode('utf-8', errors='replace').encode('utf-8')
+    p1 = run((args.program + options + " --fvalidate-utf8").split(), input=doc, stdout=PIPE, stderr=PIPE)
+    p2 = run((args.program + options).split(), input=repaired, stdout=PIPE, stderr=PIPE)
+
+    if p1.returncode != 0 or p2.returncode != 0:
+        out("[ERROR] program returned error code %d\n" % max(p1.returncode, p2.returncode))
+        result_counts['error'] += 1
+    elif p1.stdout == p2.stdout:
+        out("[PASSED]\n")
+        result_counts['pass'] += 1
+    else:
+        out("[FAILED]\n")
+        result_counts['fail'] += 1
+
+out("{pass} passed, {fail} failed, {error} errored, {skip} skipped\n".format(**result_counts))
+exit(result_counts['fail'] + result_counts['error'])